@@ -0,0 +1,861 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   AsyncLog.cpp
+ *
+ *   @brief  Logger which passes messages to another logger on a background thread.
+ *
+ ****************************************************************************/
+
+#include "duino_log/AsyncLog.h"
+
+#if LOG_THREADS_ENABLED && (defined(__unix__) || defined(__APPLE__))
+
+#include <sched.h>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <utility>
+
+#include "duino_log/BinaryLog.h"
+#include "duino_log/LogContext.h"
+#include "duino_log/LogStats.h"
+#include "duino_log/Str.h"
+
+//! A message waiting in a ring.
+struct AsyncRecord {
+    uint64_t time;                      //!< When the message was logged (in nsec).
+    Log::Level level;                   //!< Level of the message.
+    Log::Completion* completion;        //!< Called once the message is durable (may be nullptr).
+    const char* fmt;                    //!< Format string of a captured message, or nullptr.
+    uint16_t prefix_len;                //!< Length of the context prefix of a captured message.
+    uint16_t arg_len;                   //!< Length of the arguments of a captured message.
+    //! Null terminated message, or for a captured message, the context prefix
+    //! followed by the arguments encoded by BinaryLog::encode_args().
+    char text[AsyncLog::MAX_MSG_LEN];
+};
+
+//! Single producer/single consumer ring of messages.
+//! @details The logging thread which owns the ring is the only writer of
+//!          `head`, and the background thread is the only writer of `tail`,
+//!          so neither needs a locked instruction. They're kept on separate
+//!          cache lines so the two threads don't contend for them.
+struct AsyncRing {
+    //! Constructor.
+    //! @details The records are zeroed, which touches every page now, so that
+    //!          logging doesn't take page faults.
+    explicit AsyncRing(
+        size_t size  //!< [in] Number of records (a power of 2).
+        )
+        : records{new AsyncRecord[size]()}, mask{size - 1} {}
+
+    //! Destructor.
+    ~AsyncRing() { delete[] this->records; }
+
+    AsyncRing(const AsyncRing&) = delete;
+    AsyncRing& operator=(const AsyncRing&) = delete;
+
+    //! Returns the next free record (called by the owning thread).
+    //! @returns the record, or nullptr if the ring is full.
+    AsyncRecord* reserve() {
+        uint64_t head = this->head.load(std::memory_order_relaxed);
+        if (head - this->cached_tail > this->mask) {
+            this->cached_tail = this->tail.load(std::memory_order_acquire);
+            if (head - this->cached_tail > this->mask) {
+                return nullptr;
+            }
+        }
+        return &this->records[head & this->mask];
+    }
+
+    //! Makes the record returned by reserve() visible to the background thread.
+    void publish() {
+        this->head.store(this->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    //! Determines if the ring is full (called by the owning thread).
+    //! @returns true if the ring is full.
+    bool full() const {
+        return this->head.load(std::memory_order_relaxed) -
+                   this->tail.load(std::memory_order_seq_cst) >
+               this->mask;
+    }
+
+    //! Determines if every message has been consumed.
+    //! @returns true if the ring is empty.
+    bool empty() const {
+        return this->tail.load(std::memory_order_relaxed) ==
+               this->head.load(std::memory_order_acquire);
+    }
+
+    AsyncRecord* records;  //!< The records.
+    size_t mask;           //!< Number of records minus 1.
+
+    alignas(64) std::atomic<uint64_t> head{0};  //!< Number of records published.
+    uint64_t cached_tail = 0;                   //!< Owning thread's copy of `tail`.
+
+    alignas(64) std::atomic<uint64_t> tail{0};  //!< Number of records consumed.
+
+    std::atomic<bool> thread_exited{false};  //!< Set when the owning thread exits.
+    std::atomic<bool> logger_gone{false};    //!< Set when the AsyncLog is destroyed.
+};
+
+//! Messages merged by a pass of the background thread, and the state used by
+//! the formatter pool to format them.
+struct AsyncBatch {
+    //! Number of chunks in a full batch.
+    static constexpr size_t NUM_CHUNKS = AsyncLog::BATCH_SIZE / AsyncLog::CHUNK_SIZE;
+
+    //! A merged message.
+    struct Entry {
+        AsyncRing* ring;      //!< Ring containing the message.
+        AsyncRecord* record;  //!< The message.
+        const char* text;     //!< Formatted message.
+    };
+
+    //! Range of chunks dealt out to a worker, which other workers may steal from.
+    //! @details `state` packs the batch number (in the upper 32 bits), the
+    //!          next chunk to claim and the end of the range (16 bits each),
+    //!          so that a worker which is still looking at the previous batch
+    //!          can't claim a chunk from the next one.
+    struct alignas(64) Queue {
+        std::atomic<uint64_t> state{0};  //!< Packed batch number, next chunk and end.
+    };
+
+    //! Constructor.
+    //! @details The buffers used for formatting are only allocated when
+    //!          there are formatter threads, since messages are only
+    //!          captured (rather than formatted when they're logged) then.
+    explicit AsyncBatch(
+        size_t num_workers  //!< [in] Number of formatter threads plus 1 (the background thread).
+        )
+        : queues(num_workers) {
+        this->entries.reserve(AsyncLog::BATCH_SIZE);
+        if (num_workers > 1) {
+            this->formatted.reset(new char[AsyncLog::BATCH_SIZE * AsyncLog::MAX_MSG_LEN]);
+            this->chunk_done.reset(new std::atomic<uint32_t>[NUM_CHUNKS]());
+        }
+    }
+
+    std::vector<Entry> entries;                          //!< Merged messages.
+    size_t num_captured = 0;                             //!< Number of entries which need formatting.
+    std::unique_ptr<char[]> formatted;                   //!< Formatted text of each entry (pool only).
+    std::unique_ptr<std::atomic<uint32_t>[]> chunk_done;  //!< Number of the batch each chunk was last formatted for.
+    std::vector<Queue> queues;                           //!< Chunks of each worker.
+    uint32_t seq = 0;                                    //!< Number of the current batch.
+
+    std::mutex mutex;            //!< Protects the members below.
+    std::condition_variable cv;  //!< Wakes up the formatter threads.
+    uint32_t posted = 0;         //!< Number of the last batch given to the formatter threads.
+    bool stop = false;           //!< Tells the formatter threads to exit.
+};
+
+//! The rings owned by the calling thread (one per AsyncLog it has logged to).
+struct AsyncThreadRings {
+    //! A ring, and the AsyncLog it belongs to.
+    struct Entry {
+        uint64_t id;                      //!< ID of the AsyncLog.
+        std::shared_ptr<AsyncRing> ring;  //!< The ring.
+    };
+
+    //! Destructor. Lets the background threads release the rings.
+    ~AsyncThreadRings() {
+        for (const Entry& entry : this->entries) {
+            entry.ring->thread_exited.store(true, std::memory_order_release);
+        }
+    }
+
+    std::vector<Entry> entries;      //!< Rings owned by this thread.
+    uint64_t last_id = 0;            //!< ID of the AsyncLog used most recently.
+    AsyncRing* last_ring = nullptr;  //!< Ring of the AsyncLog used most recently.
+};
+
+//! Rings owned by the calling thread.
+static thread_local AsyncThreadRings thread_rings;
+
+//! ID of the next AsyncLog (IDs aren't reused, unlike addresses).
+static std::atomic<uint64_t> next_id{1};
+
+//! ID of the AsyncLog which owns the calling thread (its background or a
+//! formatter thread), or 0 for any other thread. These threads drain the
+//! rings, so they must never wait for room in one.
+static thread_local uint64_t backend_id = 0;
+
+//! Returns the current time.
+//! @returns the time in nsec.
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+//! Tells the CPU that the thread is spinning.
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+//! Waits until `*word` is changed from `value` (and futex_wake is called).
+//! @details Returns immediately if `*word` isn't `value`. Without futexes,
+//!          this sleeps for a short time instead.
+static void futex_wait(std::atomic<uint32_t>* word, uint32_t value) {
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE, value, nullptr,
+            nullptr, 0);
+#else
+    if (word->load(std::memory_order_acquire) == value) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+#endif
+}
+
+//! Wakes every thread waiting in futex_wait on `word`.
+static void futex_wake(std::atomic<uint32_t>* word) {
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr,
+            nullptr, 0);
+#else
+    (void)word;
+#endif
+}
+
+//! Passes a formatted message to a logger's do_log().
+static void sink_log(Log* sink, Log::Level level, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static void sink_log(Log* sink, Log::Level level, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    sink->do_log(level, fmt, args);
+    va_end(args);
+}
+
+AsyncLog::AsyncLog(Log* sink, size_t ring_size, size_t num_formatters, Install install)
+    : Log(install),
+      m_sink{sink},
+      m_id{next_id.fetch_add(1, std::memory_order_relaxed)},
+      m_num_formatters{num_formatters},
+      m_batch{new AsyncBatch(num_formatters + 1)} {
+    this->m_ring_size = 2;
+    while (this->m_ring_size < ring_size) {
+        this->m_ring_size *= 2;
+    }
+    this->start_threads();
+}
+
+void AsyncLog::start_threads() {
+    for (size_t worker = 1; worker <= this->m_num_formatters; worker++) {
+        this->m_formatters.emplace_back(&AsyncLog::formatter, this, worker);
+    }
+    this->m_thread = std::thread(&AsyncLog::background, this);
+}
+
+AsyncLog::~AsyncLog() {
+    this->detach();
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        this->m_stop = true;
+    }
+    this->m_cv.notify_one();
+    this->m_thread.join();
+    {
+        std::lock_guard<std::mutex> lock(this->m_batch->mutex);
+        this->m_batch->stop = true;
+    }
+    this->m_batch->cv.notify_all();
+    for (auto& thread : this->m_formatters) {
+        thread.join();
+    }
+    for (auto& ring : this->m_rings) {
+        ring->logger_gone.store(true, std::memory_order_release);
+    }
+}
+
+AsyncRing* AsyncLog::thread_ring() {
+    AsyncThreadRings& rings = thread_rings;
+    if (rings.last_id == this->m_id) {
+        return rings.last_ring;
+    }
+
+    // Forget the rings of loggers which have been destroyed.
+    rings.entries.erase(
+        std::remove_if(
+            rings.entries.begin(),
+            rings.entries.end(),
+            [](const AsyncThreadRings::Entry& entry) {
+                return entry.ring->logger_gone.load(std::memory_order_acquire);
+            }),
+        rings.entries.end());
+
+    AsyncRing* ring = nullptr;
+    for (const auto& entry : rings.entries) {
+        if (entry.id == this->m_id) {
+            ring = entry.ring.get();
+            break;
+        }
+    }
+    if (ring == nullptr) {
+        auto newRing = std::make_shared<AsyncRing>(this->m_ring_size);
+        ring = newRing.get();
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            this->m_rings.push_back(newRing);
+            this->m_rings_changed = true;
+        }
+        rings.entries.push_back({this->m_id, std::move(newRing)});
+    }
+    rings.last_id = this->m_id;
+    rings.last_ring = ring;
+    return ring;
+}
+
+void AsyncLog::set_backpressure(const Backpressure& policy) {
+    this->m_spins.store(policy.spins, std::memory_order_relaxed);
+    this->m_yields.store(policy.yields, std::memory_order_relaxed);
+    this->m_block_level.store(policy.block_level, std::memory_order_relaxed);
+}
+
+AsyncLog::Backpressure AsyncLog::get_backpressure() const {
+    Backpressure policy;
+    policy.block_level = this->m_block_level.load(std::memory_order_relaxed);
+    policy.spins = this->m_spins.load(std::memory_order_relaxed);
+    policy.yields = this->m_yields.load(std::memory_order_relaxed);
+    return policy;
+}
+
+#if defined(__linux__)
+bool AsyncLog::set_affinity(const std::vector<unsigned>& cpus) {
+    if (cpus.empty()) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned cpu : cpus) {
+        if (cpu >= CPU_SETSIZE) {
+            return false;
+        }
+        CPU_SET(cpu, &set);
+    }
+    bool ok = pthread_setaffinity_np(this->m_thread.native_handle(), sizeof(set), &set) == 0;
+    for (auto& thread : this->m_formatters) {
+        ok = pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0 && ok;
+    }
+    return ok;
+}
+
+bool AsyncLog::set_numa_node(unsigned node) {
+    char path[64];
+    StrPrintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+    FILE* fs = fopen(path, "r");
+    if (fs == nullptr) {
+        return false;
+    }
+    char list[1024];
+    bool ok = fgets(list, sizeof(list), fs) != nullptr;
+    fclose(fs);
+
+    std::vector<unsigned> cpus;
+    return ok && parse_cpu_list(list, &cpus) && this->set_affinity(cpus);
+}
+#endif  // defined(__linux__)
+
+bool AsyncLog::parse_cpu_list(const char* list, std::vector<unsigned>* cpus) {
+    cpus->clear();
+    const char* p = list;
+    while (isdigit(static_cast<unsigned char>(*p))) {
+        char* end;
+        unsigned long first = strtoul(p, &end, 10);
+        unsigned long last = first;
+        p = end;
+        if (*p == '-') {
+            if (!isdigit(static_cast<unsigned char>(*++p))) {
+                return false;
+            }
+            last = strtoul(p, &end, 10);
+            p = end;
+        }
+        if (last < first || last >= 65536) {
+            return false;
+        }
+        for (unsigned long cpu = first; cpu <= last; cpu++) {
+            cpus->push_back(static_cast<unsigned>(cpu));
+        }
+        if (*p != ',') {
+            break;
+        }
+        p++;
+    }
+    while (isspace(static_cast<unsigned char>(*p))) {
+        p++;
+    }
+    return *p == '\0' && !cpus->empty();
+}
+
+AsyncRecord* AsyncLog::reserve(AsyncRing* ring, Level level, bool wait) {
+    AsyncRecord* record = ring->reserve();
+    if (record != nullptr) {
+        return record;
+    }
+
+    // The background and formatter threads can't wait for themselves (i.e.
+    // if the sink or a format conversion logs), so their messages are dropped.
+    if ((!wait && static_cast<uint_fast8_t>(level) >
+                      static_cast<uint_fast8_t>(
+                          this->m_block_level.load(std::memory_order_relaxed))) ||
+        backend_id == this->m_id) {
+        this->m_num_dropped.fetch_add(1, std::memory_order_relaxed);
+        LogStats::record_dropped(level);
+        return nullptr;
+    }
+
+    uint64_t start = LogStats::now();
+    uint32_t spins = this->m_spins.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < spins && record == nullptr; i++) {
+        cpu_relax();
+        record = ring->reserve();
+    }
+    uint32_t yields = this->m_yields.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < yields && record == nullptr; i++) {
+        sched_yield();
+        record = ring->reserve();
+    }
+    while (record == nullptr) {
+        this->park(ring);
+        record = ring->reserve();
+    }
+    uint64_t elapsed = LogStats::now() - start;
+    this->m_num_stalled.fetch_add(1, std::memory_order_relaxed);
+    this->m_stall_ns.fetch_add(elapsed, std::memory_order_relaxed);
+    LogStats::record_latency(LogStats::Timer::STALL, start);
+    return record;
+}
+
+void AsyncLog::park(AsyncRing* ring) {
+    uint32_t seq = this->m_wake_seq.load(std::memory_order_seq_cst);
+    this->m_num_parked.fetch_add(1, std::memory_order_seq_cst);
+    // If the background thread made room after m_wake_seq was read, it will
+    // see m_num_parked and bump m_wake_seq, so futex_wait returns immediately.
+    if (ring->full()) {
+        this->m_cv.notify_one();
+        futex_wait(&this->m_wake_seq, seq);
+    }
+    this->m_num_parked.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void AsyncLog::wake_parked() {
+    if (this->m_num_parked.load(std::memory_order_seq_cst) != 0) {
+        this->m_wake_seq.fetch_add(1, std::memory_order_seq_cst);
+        futex_wake(&this->m_wake_seq);
+    }
+}
+
+void AsyncLog::format(AsyncRecord* record, Level level, const char* fmt, va_list args) {
+    record->time = now_ns();
+    record->level = level;
+    // The context belongs to this thread, so it's captured now rather than by the sink.
+    size_t len = LogContext::copy_prefix(record->text, MAX_MSG_LEN - 1);
+    if (this->m_num_formatters > 0) {
+        record->fmt = fmt;
+        record->prefix_len = len;
+        record->arg_len = BinaryLog::encode_args(
+            fmt, args, reinterpret_cast<uint8_t*>(&record->text[len]), MAX_MSG_LEN - len);
+        return;
+    }
+    record->fmt = nullptr;
+    len += vStrPrintf(&record->text[len], MAX_MSG_LEN - len, fmt, args);
+    record->text[len] = '\0';
+}
+
+void AsyncLog::do_log(Level level, const char* fmt, va_list args) {
+    AsyncRing* ring = this->thread_ring();
+    AsyncRecord* record = this->reserve(ring, level);
+    if (record == nullptr) {
+        return;
+    }
+    this->format(record, level, fmt, args);
+    record->completion = nullptr;
+    ring->publish();
+}
+
+void AsyncLog::do_log_durable(Completion* completion, Level level, const char* fmt, va_list args) {
+    // The background thread can't wait for itself, so it logs straight to the sink.
+    if (std::this_thread::get_id() == this->m_thread.get_id()) {
+        this->m_sink->do_log_durable(completion, level, fmt, args);
+        return;
+    }
+    AsyncRing* ring = this->thread_ring();
+    AsyncRecord* record = this->reserve(ring, level, true);
+    if (record == nullptr) {
+        // Dropped by a formatter thread, which doesn't own the sink either.
+        completion->complete();
+        return;
+    }
+    this->format(record, level, fmt, args);
+    record->completion = completion;
+    ring->publish();
+}
+
+void AsyncLog::do_log_kv(Level level, const char* msg, const KeyValue* kvs, size_t num_kvs) {
+    AsyncRing* ring = this->thread_ring();
+    AsyncRecord* record = this->reserve(ring, level);
+    if (record == nullptr) {
+        return;
+    }
+    record->time = now_ns();
+    record->level = level;
+    record->completion = nullptr;
+    record->fmt = nullptr;
+    if (this->kv_format.load(std::memory_order_relaxed) == KvFormat::JSON) {
+        encode_json(record->text, MAX_MSG_LEN, level, msg, kvs, num_kvs, LogContext::current());
+    } else {
+        encode_logfmt(record->text, MAX_MSG_LEN, level, msg, kvs, num_kvs, LogContext::current());
+    }
+    ring->publish();
+}
+
+void AsyncLog::flush() {
+    std::unique_lock<std::mutex> lock(this->m_mutex);
+    if (this->m_stop) {
+        return;
+    }
+    uint64_t request = ++this->m_flush_requested;
+    this->m_cv.notify_one();
+    this->m_flushed_cv.wait(lock, [this, request] { return this->m_flush_done >= request; });
+}
+
+void AsyncLog::sync() {
+    if (backend_id != this->m_id) {
+        this->flush();
+    }
+    this->m_sink->sync();
+}
+
+void AsyncLog::prepare_fork() {
+    if (backend_id != this->m_id) {
+        this->flush();
+    }
+    this->m_mutex.lock();
+    this->m_batch->mutex.lock();
+    this->m_sink->prepare_fork();
+}
+
+void AsyncLog::parent_after_fork() {
+    this->m_sink->parent_after_fork();
+    this->m_batch->mutex.unlock();
+    this->m_mutex.unlock();
+}
+
+void AsyncLog::child_after_fork() {
+    this->m_sink->child_after_fork();
+
+    // The parent outputs whatever is still in the rings. Only the forking
+    // thread exists in the child, so the other threads' rings are released
+    // once they're empty.
+    AsyncRing* own = nullptr;
+    for (const auto& entry : thread_rings.entries) {
+        if (entry.id == this->m_id) {
+            own = entry.ring.get();
+        }
+    }
+    for (auto& ring : this->m_rings) {
+        ring->tail.store(ring->head.load());
+        if (ring.get() != own) {
+            ring->thread_exited.store(true);
+        }
+    }
+    this->m_drain_rings = this->m_rings;
+    this->m_rings_changed = false;
+    this->m_completions.clear();
+    this->m_flush_done = this->m_flush_requested;
+    this->m_num_parked.store(0);
+
+    AsyncBatch& batch = *this->m_batch;
+    batch.entries.clear();
+    batch.num_captured = 0;
+    for (auto& queue : batch.queues) {
+        queue.state.store(0);
+    }
+    reconstruct_in_child(&batch.cv);
+    batch.mutex.unlock();
+
+    reconstruct_in_child(&this->m_cv);
+    reconstruct_in_child(&this->m_flushed_cv);
+    reconstruct_in_child(&this->m_thread);
+    for (auto& thread : this->m_formatters) {
+        reconstruct_in_child(&thread);
+    }
+    this->m_formatters.clear();
+    this->m_mutex.unlock();
+    this->start_threads();
+}
+
+size_t AsyncLog::num_rings() {
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    return this->m_rings.size();
+}
+
+size_t AsyncLog::drain() {
+    size_t num_rings = this->m_drain_rings.size();
+
+    // Only the messages which are already in the rings are merged, so that
+    // the pass ends even if the other threads keep logging. The messages stay
+    // in their rings until output_batch() has passed them to the sink, so
+    // `next` tracks the merge separately from `tail`.
+    std::vector<uint64_t> next(num_rings);
+    std::vector<uint64_t> ends(num_rings);
+
+    // Time of the oldest unmerged message in each ring which has one, as a min-heap.
+    std::vector<std::pair<uint64_t, size_t>> heap;
+    std::greater<std::pair<uint64_t, size_t>> later;
+
+    for (size_t i = 0; i < num_rings; i++) {
+        const AsyncRing* ring = this->m_drain_rings[i].get();
+        next[i] = ring->tail.load(std::memory_order_relaxed);
+        ends[i] = ring->head.load(std::memory_order_acquire);
+        if (next[i] != ends[i]) {
+            heap.emplace_back(ring->records[next[i] & ring->mask].time, i);
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+
+    AsyncBatch& batch = *this->m_batch;
+    size_t count = 0;
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        size_t i = heap.back().second;
+        heap.pop_back();
+
+        AsyncRing* ring = this->m_drain_rings[i].get();
+        AsyncRecord* record = &ring->records[next[i] & ring->mask];
+        batch.entries.push_back({ring, record, record->text});
+        if (record->fmt != nullptr) {
+            batch.num_captured++;
+        }
+        if (batch.entries.size() == BATCH_SIZE) {
+            this->output_batch(&count);
+        }
+
+        if (++next[i] != ends[i]) {
+            heap.emplace_back(ring->records[next[i] & ring->mask].time, i);
+            std::push_heap(heap.begin(), heap.end(), later);
+        }
+    }
+    this->output_batch(&count);
+    if (count % WAKE_BATCH != 0) {
+        this->wake_parked();
+    }
+
+    // One sync makes every message passed to the sink during the pass durable.
+    if (!this->m_completions.empty()) {
+        this->m_sink->sync();
+        for (Completion* completion : this->m_completions) {
+            completion->complete();
+        }
+        this->m_completions.clear();
+    }
+    return count;
+}
+
+//! Packs the state of an AsyncBatch::Queue.
+//! @returns the packed state.
+static uint64_t queue_state(uint32_t seq, size_t next, size_t end) {
+    return (static_cast<uint64_t>(seq) << 32) | (next << 16) | end;
+}
+
+//! Claims the next chunk from a queue.
+//! @returns true if a chunk was claimed.
+static bool claim_chunk(AsyncBatch::Queue* queue, uint32_t seq, size_t* chunk) {
+    uint64_t state = queue->state.load(std::memory_order_acquire);
+    for (;;) {
+        size_t next = (state >> 16) & 0xffff;
+        if ((state >> 32) != seq || next >= (state & 0xffff)) {
+            return false;
+        }
+        if (queue->state.compare_exchange_weak(
+                state, state + (1 << 16), std::memory_order_acq_rel, std::memory_order_acquire)) {
+            *chunk = next;
+            return true;
+        }
+    }
+}
+
+//! Formats a captured message into `out`.
+static void format_captured(const AsyncRecord& record, char* out, std::string* scratch) {
+    size_t len = record.prefix_len;
+    memcpy(out, record.text, len);
+    BinaryLogDecoder::format(
+        scratch, record.fmt, reinterpret_cast<const uint8_t*>(&record.text[len]), record.arg_len);
+    size_t msgLen = std::min(scratch->size(), AsyncLog::MAX_MSG_LEN - 1 - len);
+    memcpy(&out[len], scratch->data(), msgLen);
+    out[len + msgLen] = '\0';
+}
+
+bool AsyncLog::format_chunk(size_t worker, uint32_t seq) {
+    AsyncBatch& batch = *this->m_batch;
+    size_t num_workers = batch.queues.size();
+    size_t chunk;
+    size_t victim = worker;
+    while (!claim_chunk(&batch.queues[victim], seq, &chunk)) {
+        victim = (victim + 1) % num_workers;
+        if (victim == worker) {
+            return false;
+        }
+    }
+
+    // Reused, so that formatting doesn't allocate once it has warmed up.
+    static thread_local std::string scratch;
+    size_t end = std::min((chunk + 1) * CHUNK_SIZE, batch.entries.size());
+    for (size_t i = chunk * CHUNK_SIZE; i < end; i++) {
+        AsyncBatch::Entry& entry = batch.entries[i];
+        if (entry.record->fmt != nullptr) {
+            char* out = &batch.formatted[i * MAX_MSG_LEN];
+            format_captured(*entry.record, out, &scratch);
+            entry.text = out;
+        }
+    }
+    batch.chunk_done[chunk].store(seq, std::memory_order_release);
+    return true;
+}
+
+void AsyncLog::output_batch(size_t* count) {
+    AsyncBatch& batch = *this->m_batch;
+    size_t num_entries = batch.entries.size();
+    if (num_entries == 0) {
+        return;
+    }
+    size_t num_chunks = (num_entries + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+    uint32_t seq = 0;
+    if (batch.num_captured > 0) {
+        // Deal the chunks out to the workers in contiguous ranges.
+        // 0 means that the entries are already formatted.
+        if (++batch.seq == 0) {
+            batch.seq = 1;
+        }
+        seq = batch.seq;
+        size_t num_workers = batch.queues.size();
+        for (size_t worker = 0; worker < num_workers; worker++) {
+            batch.queues[worker].state.store(
+                queue_state(
+                    seq, num_chunks * worker / num_workers, num_chunks * (worker + 1) / num_workers),
+                std::memory_order_release);
+        }
+        if (num_workers > 1) {
+            {
+                std::lock_guard<std::mutex> lock(batch.mutex);
+                batch.posted = seq;
+            }
+            batch.cv.notify_all();
+        }
+    }
+
+    for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+        if (seq != 0) {
+            // Help with the formatting until this chunk is done.
+            while (batch.chunk_done[chunk].load(std::memory_order_acquire) != seq) {
+                if (!this->format_chunk(0, seq)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        size_t end = std::min((chunk + 1) * CHUNK_SIZE, num_entries);
+        for (size_t i = chunk * CHUNK_SIZE; i < end; i++) {
+            const AsyncBatch::Entry& entry = batch.entries[i];
+            if (this->m_sink->should_log(entry.record->level)) {
+                sink_log(this->m_sink, entry.record->level, "%s", entry.text);
+            }
+            if (entry.record->completion != nullptr) {
+                this->m_completions.push_back(entry.record->completion);
+            }
+            // seq_cst, so that it's ordered with reading m_num_parked (see park()).
+            entry.ring->tail.store(
+                entry.ring->tail.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+            if (++*count % WAKE_BATCH == 0) {
+                this->wake_parked();
+            }
+        }
+    }
+    batch.entries.clear();
+    batch.num_captured = 0;
+}
+
+void AsyncLog::formatter(size_t worker) {
+    backend_id = this->m_id;
+    AsyncBatch& batch = *this->m_batch;
+    uint32_t seen = 0;
+    std::unique_lock<std::mutex> lock(batch.mutex);
+    for (;;) {
+        batch.cv.wait(lock, [&batch, seen] { return batch.stop || batch.posted != seen; });
+        if (batch.stop) {
+            return;
+        }
+        seen = batch.posted;
+        lock.unlock();
+        while (this->format_chunk(worker, seen)) {
+        }
+        lock.lock();
+    }
+}
+
+void AsyncLog::background() {
+    backend_id = this->m_id;
+    std::unique_lock<std::mutex> lock(this->m_mutex);
+    for (;;) {
+        uint64_t flush_requested = this->m_flush_requested;
+        bool stop = this->m_stop;
+
+        // Release the rings of threads which have exited, once they're empty.
+        auto end = std::remove_if(
+            this->m_rings.begin(), this->m_rings.end(), [](const std::shared_ptr<AsyncRing>& ring) {
+                return ring->thread_exited.load(std::memory_order_acquire) && ring->empty();
+            });
+        if (end != this->m_rings.end()) {
+            this->m_rings.erase(end, this->m_rings.end());
+            this->m_rings_changed = true;
+        }
+        if (this->m_rings_changed) {
+            this->m_drain_rings = this->m_rings;
+            this->m_rings_changed = false;
+        }
+
+        lock.unlock();
+        size_t count = this->drain();
+        lock.lock();
+
+        if (this->m_flush_done != flush_requested) {
+            this->m_flush_done = flush_requested;
+            this->m_flushed_cv.notify_all();
+        }
+        if (stop) {
+            return;
+        }
+        if (count == 0 && !this->m_stop && this->m_flush_requested == flush_requested) {
+            this->m_cv.wait_for(lock, POLL_INTERVAL);
+        }
+    }
+}
+
+#endif  // LOG_THREADS_ENABLED && (defined(__unix__) || defined(__APPLE__))
@@ -0,0 +1,567 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   BinaryLog.cpp
+ *
+ *   @brief  Logger which writes a compact binary log, and its decoder.
+ *
+ ****************************************************************************/
+
+#include "duino_log/BinaryLog.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#include <chrono>
+#include <cstring>
+
+#include "duino_log/Str.h"
+
+//! Length modifiers which change the type of an integer argument.
+enum class LenMod : uint8_t {
+    NONE,       //!< int or unsigned
+    LONG,       //!< l
+    LONG_LONG,  //!< ll
+    SIZE,       //!< z
+};
+
+//! A single conversion specification from a format string.
+//! @details This follows the parsing done by vStrXPrintf exactly, so that the
+//!          same arguments are consumed in the same order.
+struct FmtSpec {
+    size_t len;       //!< Length of the specification, starting with the '%'.
+    bool width_star;  //!< Width is taken from an int argument.
+    bool prec_star;   //!< Precision is taken from an int argument.
+    int16_t prec;     //!< Literal precision (-1 if none).
+    LenMod mod;       //!< Length modifier.
+    char type;        //!< Conversion type ('\0' if the format string ended).
+};
+
+//! Parses the conversion specification starting at `fmt`, which points at a '%'.
+static void parse_spec(const char* fmt, FmtSpec* spec) {
+    const char* p = fmt + 1;
+    char c = *p++;
+
+    spec->width_star = false;
+    spec->prec_star = false;
+    spec->prec = -1;
+    spec->mod = LenMod::NONE;
+
+    if (c == '-') {
+        c = *p++;
+    }
+    if (c == '+' || c == ' ' || c == '#') {
+        c = *p++;
+    }
+    if (c == '0') {
+        c = *p++;
+    }
+    if (c == '*') {
+        spec->width_star = true;
+        c = *p++;
+    } else {
+        while ('0' <= c && c <= '9') {
+            c = *p++;
+        }
+    }
+    if (c == '.') {
+        c = *p++;
+        if (c == '*') {
+            spec->prec_star = true;
+            c = *p++;
+        } else {
+            spec->prec = 0;
+            while ('0' <= c && c <= '9') {
+                spec->prec = spec->prec * 10 + c - '0';
+                c = *p++;
+            }
+        }
+    }
+    // vStrXPrintf gives l and ll priority over z.
+    if (c == 'l') {
+        spec->mod = LenMod::LONG;
+        c = *p++;
+        if (c == 'l') {
+            spec->mod = LenMod::LONG_LONG;
+            c = *p++;
+        }
+    }
+    if (c == 'z') {
+        if (spec->mod == LenMod::NONE) {
+            spec->mod = LenMod::SIZE;
+        }
+        c = *p++;
+    }
+    if (c == 'h') {
+        c = *p++;
+        if (c == 'h') {
+            c = *p++;
+        }
+    }
+    spec->type = (c == 'i') ? 'd' : c;
+    spec->len = (c == '\0') ? (p - 1 - fmt) : (p - fmt);
+}
+
+//! Determines if a conversion type takes an integer argument.
+//! @returns true if it does.
+static bool is_int_type(char type) {
+    return type == 'd' || type == 'x' || type == 'X' || type == 'u' || type == 'o' ||
+           type == 'b';
+}
+
+//! Appends a varint to a buffer.
+//! @returns true if the varint fit in the buffer.
+static bool put_varint(uint8_t* buf, size_t bufLen, size_t* pos, uint64_t value) {
+    do {
+        if (*pos >= bufLen) {
+            return false;
+        }
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        buf[(*pos)++] = byte | (value != 0 ? 0x80 : 0);
+    } while (value != 0);
+    return true;
+}
+
+//! Gets a varint from a buffer.
+//! @returns true if a complete varint was available.
+static bool get_varint(const uint8_t* buf, size_t bufLen, size_t* pos, uint64_t* value) {
+    *value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (*pos >= bufLen) {
+            return false;
+        }
+        uint8_t byte = buf[(*pos)++];
+        *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//! Zigzag encodes a signed value, so that small negative values are small.
+//! @returns the encoded value.
+static uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+//! Reverses zigzag().
+//! @returns the decoded value.
+static int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+//! Returns the current time.
+//! @returns the number of microseconds since the epoch.
+static uint64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+BinaryLog::BinaryLog(FILE* log_fs) : m_log_fs{log_fs} {
+    fwrite(MAGIC, 1, sizeof(MAGIC) - 1, this->m_log_fs);
+}
+
+BinaryLog::~BinaryLog() {
+    this->detach();
+    fflush(this->m_log_fs);
+}
+
+size_t BinaryLog::encode_args(const char* fmt, va_list args, uint8_t* buf, size_t bufLen) {
+    size_t pos = 0;
+    while (*fmt != '\0') {
+        if (*fmt != '%') {
+            fmt++;
+            continue;
+        }
+        FmtSpec spec;
+        parse_spec(fmt, &spec);
+        fmt += spec.len;
+        if (spec.type == '\0') {
+            break;
+        }
+
+        // Once the buffer fills up we stop, and the decoder stops formatting
+        // at the first argument which is missing.
+        if (spec.width_star && !put_varint(buf, bufLen, &pos, zigzag(va_arg(args, int)))) {
+            break;
+        }
+        int16_t prec = spec.prec;
+        if (spec.prec_star) {
+            int value = va_arg(args, int);
+            prec = static_cast<int16_t>(value);
+            if (!put_varint(buf, bufLen, &pos, zigzag(value))) {
+                break;
+            }
+        }
+
+        if (is_int_type(spec.type)) {
+            unsigned long long x;  // NOLINT
+            if (spec.mod == LenMod::LONG_LONG) {
+                x = va_arg(args, unsigned long long);  // NOLINT
+            } else if (spec.mod == LenMod::LONG) {
+                x = va_arg(args, unsigned long);  // NOLINT
+            } else if (spec.mod == LenMod::SIZE) {
+                x = va_arg(args, size_t);
+            } else if (spec.type == 'd') {
+                x = va_arg(args, int);
+            } else {
+                x = va_arg(args, unsigned);
+            }
+            uint64_t value = (spec.type == 'd') ? zigzag(static_cast<int64_t>(x)) : x;
+            if (!put_varint(buf, bufLen, &pos, value)) {
+                break;
+            }
+        } else if (spec.type == 'c') {
+            char c = static_cast<char>(va_arg(args, int));
+            if (pos >= bufLen) {
+                break;
+            }
+            buf[pos++] = static_cast<uint8_t>(c);
+        } else if (spec.type == 's') {
+            const char* str = va_arg(args, const char*);
+            if (str == nullptr) {
+                str = "(null)";
+            }
+            // Like vStrXPrintf, don't look past the precision.
+            size_t len = 0;
+            while (str[len] != '\0' && (prec < 0 || len < static_cast<size_t>(prec))) {
+                len++;
+            }
+            size_t lenPos = pos;
+            if (!put_varint(buf, bufLen, &pos, len)) {
+                break;
+            }
+            if (pos + len > bufLen) {
+                // Store as much of the string as fits.
+                pos = lenPos;
+                len = bufLen - pos;
+                len = (len > 2) ? len - 2 : 0;
+                put_varint(buf, bufLen, &pos, len);
+                memcpy(&buf[pos], str, len);
+                pos += len;
+                break;
+            }
+            memcpy(&buf[pos], str, len);
+            pos += len;
+        }
+    }
+    return pos;
+}
+
+void BinaryLog::do_log(Level level, const char* fmt, va_list args) {
+    // Kept in case the message has to be formatted (see MAX_FORMATS).
+    va_list textArgs;
+    va_copy(textArgs, args);
+    uint8_t argBuf[MAX_ARG_LEN];
+    size_t argLen = encode_args(fmt, args, argBuf, sizeof(argBuf));
+
+    // tag + 3 varints
+    uint8_t header[1 + 3 * 10];
+    size_t headerLen = 0;
+
+    const LogContext* context = LogContext::current();
+
+#if LOG_THREADS_ENABLED
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+#endif
+
+    if (!this->m_context.matches(context)) {
+        this->m_context.capture(context);
+        header[headerLen++] = CONTEXT_TAG;
+        put_varint(header, sizeof(header), &headerLen, this->m_context.len);
+        fwrite(header, 1, headerLen, this->m_log_fs);
+        fwrite(this->m_context.prefix, 1, this->m_context.len, this->m_log_fs);
+        headerLen = 0;
+    }
+
+    uint32_t id = this->format_id(fmt);
+    if (id == NO_FORMAT_ID) {
+        // Leave room for the length (a 2 byte varint).
+        char text[MAX_ARG_LEN - 2];
+        size_t textLen = vStrPrintf(text, sizeof(text), fmt, textArgs);
+        id = this->format_id("%s");
+        argLen = 0;
+        put_varint(argBuf, sizeof(argBuf), &argLen, textLen);
+        memcpy(&argBuf[argLen], text, textLen);
+        argLen += textLen;
+    }
+    va_end(textArgs);
+    uint64_t now = now_us();
+    int64_t delta = static_cast<int64_t>(now - this->m_last_time_us);
+    this->m_last_time_us = now;
+
+    header[headerLen++] = RECORD_TAG + static_cast<uint8_t>(level);
+    put_varint(header, sizeof(header), &headerLen, zigzag(delta));
+    put_varint(header, sizeof(header), &headerLen, id);
+    put_varint(header, sizeof(header), &headerLen, argLen);
+    fwrite(header, 1, headerLen, this->m_log_fs);
+    fwrite(argBuf, 1, argLen, this->m_log_fs);
+    if (level == Level::FATAL || level == Level::ERROR) {
+        fflush(this->m_log_fs);
+    }
+}
+
+void BinaryLog::sync() {
+#if LOG_THREADS_ENABLED
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+#endif
+    fflush(this->m_log_fs);
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = fileno(this->m_log_fs);
+    if (fd >= 0) {
+#if defined(__APPLE__)
+        fsync(fd);
+#else
+        fdatasync(fd);
+#endif
+    }
+#endif
+}
+
+void BinaryLog::prepare_fork() {
+#if LOG_THREADS_ENABLED
+    this->m_mutex.lock();
+#endif
+    fflush(this->m_log_fs);
+}
+
+void BinaryLog::parent_after_fork() {
+#if LOG_THREADS_ENABLED
+    this->m_mutex.unlock();
+#endif
+}
+
+void BinaryLog::child_after_fork() {
+#if LOG_THREADS_ENABLED
+    this->m_mutex.unlock();
+#endif
+}
+
+uint32_t BinaryLog::format_id(const char* fmt) {
+    std::string_view key(fmt);
+    auto it = this->m_formats.find(key);
+    if (it != this->m_formats.end()) {
+        return it->second;
+    }
+    // "%s" is allowed past the limit, since it's used for the messages which don't fit.
+    if (this->m_formats.size() >= MAX_FORMATS && key != "%s") {
+        return NO_FORMAT_ID;
+    }
+    uint32_t id = this->m_formats.size();
+    // The string_view refers to the copy, since `fmt` may be reused.
+    this->m_format_strs.emplace_back(key);
+    this->m_formats.emplace(this->m_format_strs.back(), id);
+
+    size_t fmtLen = key.size();
+    uint8_t header[1 + 2 * 10];
+    size_t headerLen = 0;
+    header[headerLen++] = FORMAT_TAG;
+    put_varint(header, sizeof(header), &headerLen, id);
+    put_varint(header, sizeof(header), &headerLen, fmtLen);
+    fwrite(header, 1, headerLen, this->m_log_fs);
+    fwrite(fmt, 1, fmtLen, this->m_log_fs);
+    return id;
+}
+
+//! Function called from StrXBPrintf which appends a character to a std::string.
+//! @returns 1 to indicate that the character was consumed.
+static size_t append_char(
+    void* outParam,  //!< Pointer to the std::string.
+    char ch          //!< Character to output.
+) {
+    reinterpret_cast<std::string*>(outParam)->push_back(ch);
+    return 1;
+}
+
+//! Formats a single conversion specification with the given value.
+//! @details The specification is formatted by vStrXPrintf itself, so the
+//!          output is identical to formatting the original arguments.
+template <typename T>
+static void format_spec(
+    std::string* out,
+    const std::string& spec,
+    const FmtSpec& parsed,
+    int width,
+    int prec,
+    T value) {
+    if (parsed.width_star && parsed.prec_star) {
+        StrXBPrintf(append_char, out, spec.c_str(), width, prec, value);
+    } else if (parsed.width_star) {
+        StrXBPrintf(append_char, out, spec.c_str(), width, value);
+    } else if (parsed.prec_star) {
+        StrXBPrintf(append_char, out, spec.c_str(), prec, value);
+    } else {
+        StrXBPrintf(append_char, out, spec.c_str(), value);
+    }
+}
+
+std::string BinaryLogDecoder::format(const char* fmt, const uint8_t* args, size_t argLen) {
+    std::string out;
+    format(&out, fmt, args, argLen);
+    return out;
+}
+
+void BinaryLogDecoder::format(std::string* out, const char* fmt, const uint8_t* args, size_t argLen) {
+    out->clear();
+    size_t pos = 0;
+    while (*fmt != '\0') {
+        if (*fmt != '%') {
+            out->push_back(*fmt++);
+            continue;
+        }
+        FmtSpec parsed;
+        parse_spec(fmt, &parsed);
+        std::string spec(fmt, parsed.len);
+        fmt += parsed.len;
+        if (parsed.type == '\0') {
+            break;
+        }
+
+        uint64_t value;
+        int width = 0;
+        int prec = 0;
+        if (parsed.width_star) {
+            if (!get_varint(args, argLen, &pos, &value)) {
+                break;
+            }
+            width = static_cast<int>(unzigzag(value));
+        }
+        if (parsed.prec_star) {
+            if (!get_varint(args, argLen, &pos, &value)) {
+                break;
+            }
+            prec = static_cast<int>(unzigzag(value));
+        }
+
+        if (is_int_type(parsed.type)) {
+            if (!get_varint(args, argLen, &pos, &value)) {
+                break;
+            }
+            unsigned long long x =  // NOLINT
+                (parsed.type == 'd') ? static_cast<uint64_t>(unzigzag(value)) : value;
+            switch (parsed.mod) {
+                case LenMod::LONG_LONG:
+                    format_spec(out, spec, parsed, width, prec, x);
+                    break;
+                case LenMod::LONG:
+                    format_spec(out, spec, parsed, width, prec, static_cast<unsigned long>(x));  // NOLINT
+                    break;
+                case LenMod::SIZE:
+                    format_spec(out, spec, parsed, width, prec, static_cast<size_t>(x));
+                    break;
+                case LenMod::NONE:
+                    if (parsed.type == 'd') {
+                        format_spec(out, spec, parsed, width, prec, static_cast<int>(x));
+                    } else {
+                        format_spec(out, spec, parsed, width, prec, static_cast<unsigned>(x));
+                    }
+                    break;
+            }
+        } else if (parsed.type == 'c') {
+            if (pos >= argLen) {
+                break;
+            }
+            format_spec(out, spec, parsed, width, prec, static_cast<int>(static_cast<char>(args[pos++])));
+        } else if (parsed.type == 's') {
+            if (!get_varint(args, argLen, &pos, &value) || value > argLen - pos) {
+                break;
+            }
+            std::string str(reinterpret_cast<const char*>(&args[pos]), value);
+            pos += value;
+            format_spec(out, spec, parsed, width, prec, str.c_str());
+        } else {
+            // Invalid conversion types don't consume an argument.
+            StrXBPrintf(append_char, out, spec.c_str());
+        }
+    }
+}
+
+bool BinaryLogDecoder::read_varint(uint64_t* value) {
+    *value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        int byte = this->m_in.get();
+        if (byte == EOF) {
+            return false;
+        }
+        *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+BinaryLogDecoder::Result BinaryLogDecoder::next() {
+    if (!this->m_header_read) {
+        char magic[sizeof(BinaryLog::MAGIC) - 1];
+        if (!this->m_in.read(magic, sizeof(magic))) {
+            return this->m_in.gcount() == 0 ? Result::END : Result::CORRUPT;
+        }
+        if (memcmp(magic, BinaryLog::MAGIC, sizeof(magic)) != 0) {
+            return Result::CORRUPT;
+        }
+        this->m_header_read = true;
+    }
+
+    for (;;) {
+        int tag = this->m_in.get();
+        if (tag == EOF) {
+            return Result::END;
+        }
+
+        uint64_t id;
+        uint64_t len;
+        if (tag == BinaryLog::FORMAT_TAG) {
+            if (!this->read_varint(&id) || !this->read_varint(&len) ||
+                id != this->m_formats.size()) {
+                return Result::CORRUPT;
+            }
+            std::string fmt(len, '\0');
+            if (!this->m_in.read(&fmt[0], len)) {
+                return Result::CORRUPT;
+            }
+            this->m_formats.push_back(std::move(fmt));
+            continue;
+        }
+
+        if (tag == BinaryLog::CONTEXT_TAG) {
+            if (!this->read_varint(&len) || len >= LogContext::MAX_PREFIX_LEN) {
+                return Result::CORRUPT;
+            }
+            this->m_context.resize(len);
+            if (len > 0 && !this->m_in.read(&this->m_context[0], len)) {
+                return Result::CORRUPT;
+            }
+            continue;
+        }
+
+        if (tag < BinaryLog::RECORD_TAG ||
+            tag > BinaryLog::RECORD_TAG + static_cast<int>(Log::Level::DEBUG)) {
+            return Result::CORRUPT;
+        }
+        uint64_t delta;
+        if (!this->read_varint(&delta) || !this->read_varint(&id) || !this->read_varint(&len) ||
+            id >= this->m_formats.size() || len > BinaryLog::MAX_ARG_LEN) {
+            return Result::CORRUPT;
+        }
+        this->m_args.resize(len);
+        if (len > 0 && !this->m_in.read(reinterpret_cast<char*>(this->m_args.data()), len)) {
+            return Result::CORRUPT;
+        }
+        this->m_level = static_cast<Log::Level>(tag - BinaryLog::RECORD_TAG);
+        this->m_time_us += unzigzag(delta);
+        this->m_message = format(this->m_formats[id].c_str(), this->m_args.data(), len);
+        return Result::RECORD;
+    }
+}
@@ -22,7 +22,9 @@
 #include <cctype>
 #include <cinttypes>
 #include <climits>
+#include <cstring>
 
+#include "duino_log/ConsoleColor.h"
 #include "duino_log/Log.h"
 #include "duino_log/Str.h"
 
@@ -30,7 +32,7 @@
 // ---- Private Constants and Types -----------------------------------------
 
 //! Number of bytes that DumpMem will output per line.
-static constexpr size_t LINE_WIDTH = 16;
+static constexpr size_t LINE_WIDTH = DUMP_LINE_WIDTH;
 
 //! Formatted width of a single line out output.
 //! @details For each byte output, there are 2 hex digits plus a space, along
@@ -38,11 +40,59 @@ static constexpr size_t LINE_WIDTH = 16;
 //!          and misc characters.
 static constexpr size_t FMT_LINE_WIDTH = LINE_WIDTH * 4 + 20;
 
+//! Formatted width of a single line of diff output.
+//! @details For each byte output, there are 2 hex digits plus a separator
+//!          for each of the two buffers, and each byte may be wrapped in a
+//!          color. The +30 allows for the prefix, address and misc characters.
+static constexpr size_t FMT_DIFF_LINE_WIDTH =
+    LINE_WIDTH * 2 * (3 + sizeof(COLOR_RED) - 1 + sizeof(COLOR_NO_COLOR) - 1) + 30;
+
+//! Size of the block that the dump stream operator formats lines into.
+//! @details This needs to hold at least one formatted line plus a newline.
+static constexpr size_t STREAM_BLOCK_SIZE = 1024;
+
+//! Number of bytes compared at a time when skipping over identical regions.
+static constexpr size_t DIFF_CHUNK = 256;
+
 // ---- Private Variables ---------------------------------------------------
 // ---- Private Function Prototypes -----------------------------------------
 // ---- Functions -----------------------------------------------------------
 
-void DumpLine(
+//! Finds the first byte which differs between two buffers.
+//! @returns the offset of the first differing byte, or `numBytes` if the
+//!          buffers are identical.
+static size_t FirstMismatch(
+    const uint8_t* a,  //!< [in] Pointer to the first buffer.
+    const uint8_t* b,  //!< [in] Pointer to the second buffer.
+    size_t numBytes    //!< [in] Number of bytes to compare.
+) {
+    size_t i = 0;
+
+    // memcmp is vectorized by most C libraries, so identical regions are
+    // skipped over a large chunk at a time.
+    while (numBytes - i >= DIFF_CHUNK && memcmp(&a[i], &b[i], DIFF_CHUNK) == 0) {
+        i += DIFF_CHUNK;
+    }
+
+    // Narrow things down to the word containing the mismatch.
+    while (numBytes - i >= sizeof(uint64_t)) {
+        uint64_t wordA;
+        uint64_t wordB;
+        memcpy(&wordA, &a[i], sizeof(wordA));
+        memcpy(&wordB, &b[i], sizeof(wordB));
+        if (wordA != wordB) {
+            break;
+        }
+        i += sizeof(uint64_t);
+    }
+
+    while (i < numBytes && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}  // FirstMismatch
+
+size_t DumpLine(
     const char* prefix,
     size_t address,
     const void* inData,
@@ -51,19 +101,18 @@ void DumpLine(
     char* line) {
     const uint8_t* data = (const uint8_t*)inData;
 
-    int prefixLen = 0;
+    size_t prefixLen = 0;
     if (*prefix != '\0') {
         prefixLen = StrPrintf(line, lineLen, "%s: ", prefix);
     }
 
     if (numBytes == 0) {
-        StrPrintf(&line[prefixLen], lineLen - prefixLen, "No Data");
-        return;
+        return prefixLen + StrPrintf(&line[prefixLen], lineLen - prefixLen, "No Data");
     }
 
-    int len = prefixLen;
+    size_t len = prefixLen;
     if (address != NO_ADDR) {
-        len += StrPrintf(&line[len], lineLen - len, "%04x: ", (unsigned)address);
+        len += StrPrintf(&line[len], lineLen - len, "%04zx: ", address);
     }
 
     // Format the hex portion of the line.
@@ -89,8 +138,9 @@ void DumpLine(
             }
         }
 
-        line[len++] = '\0';
+        line[len] = '\0';
     }
+    return len;
 }  // DumpLine
 
 void DumpMem(const char* prefix, size_t address, const void* inData, size_t numBytes) {
@@ -109,32 +159,152 @@ void DumpMem(const char* prefix, size_t address, const void* inData, size_t numB
         DumpLine(prefix, address, data, bytesThisLine, sizeof(line), line);
         Log::info("%s", line);
 
-        address += bytesThisLine;
+        if (address != NO_ADDR) {
+            address += bytesThisLine;
+        }
         data += bytesThisLine;
     }
 }  // DumpMem
 
+size_t DumpDiffLine(
+    const char* prefix,
+    size_t address,
+    const void* inA,
+    const void* inB,
+    size_t numBytes,
+    bool color,
+    size_t lineLen,
+    char* line) {
+    const uint8_t* a = (const uint8_t*)inA;
+    const uint8_t* b = (const uint8_t*)inB;
+
+    size_t len = 0;
+    if (*prefix != '\0') {
+        len = StrPrintf(line, lineLen, "%s: ", prefix);
+    }
+
+    if (numBytes == 0) {
+        return len + StrPrintf(&line[len], lineLen - len, "No Data");
+    }
+
+    if (address != NO_ADDR) {
+        len += StrPrintf(&line[len], lineLen - len, "%04zx: ", address);
+    }
+
+    // The sides are identified by index, since `a` and `b` may be the same buffer.
+    const uint8_t* sides[] = {a, b};
+    for (int s = 0; s < 2; s++) {
+        const uint8_t* side = sides[s];
+        if (s == 1) {
+            len += StrPrintf(&line[len], lineLen - len, "| ");
+        }
+        for (size_t i = 0; i < LINE_WIDTH; i++) {
+            if (i >= numBytes) {
+                if (s == 1) {
+                    break;
+                }
+                len += StrPrintf(&line[len], lineLen - len, "   ");
+            } else if (a[i] == b[i]) {
+                len += StrPrintf(&line[len], lineLen - len, "%2.2x ", side[i]);
+            } else if (color) {
+                len += StrPrintf(
+                    &line[len], lineLen - len, COLOR_RED "%2.2x" COLOR_NO_COLOR " ", side[i]);
+            } else {
+                len += StrPrintf(&line[len], lineLen - len, "%2.2x*", side[i]);
+            }
+        }
+    }
+    return len;
+}  // DumpDiffLine
+
+void DumpDiff(
+    const char* prefix,
+    size_t address,
+    const void* inA,
+    const void* inB,
+    size_t numBytes,
+    bool color) {
+    auto a = reinterpret_cast<const uint8_t*>(inA);
+    auto b = reinterpret_cast<const uint8_t*>(inB);
+
+    char line[FMT_DIFF_LINE_WIDTH];
+
+    if (numBytes == 0) {
+        DumpDiffLine(prefix, address, a, b, numBytes, color, sizeof(line), line);
+        Log::info("%s", line);
+        return;
+    }
+
+    const char* sep = (*prefix != '\0') ? ": " : "";
+    size_t offset = 0;
+    bool anyDiffs = false;
+    while (offset < numBytes) {
+        size_t mismatch = offset + FirstMismatch(&a[offset], &b[offset], numBytes - offset);
+        if (mismatch >= numBytes) {
+            if (anyDiffs) {
+                // The remainder of the buffers are identical.
+                Log::info("%s%s*", prefix, sep);
+            }
+            break;
+        }
+        size_t lineStart = mismatch - (mismatch % LINE_WIDTH);
+        if (lineStart > offset) {
+            // One or more identical lines were skipped.
+            Log::info("%s%s*", prefix, sep);
+        }
+        anyDiffs = true;
+
+        size_t bytesThisLine = std::min(numBytes - lineStart, LINE_WIDTH);
+        DumpDiffLine(
+            prefix, (address == NO_ADDR) ? NO_ADDR : address + lineStart, &a[lineStart],
+            &b[lineStart], bytesThisLine, color, sizeof(line), line);
+        Log::info("%s", line);
+
+        offset = lineStart + bytesThisLine;
+    }
+
+    if (!anyDiffs) {
+        Log::info("%s%sNo Differences", prefix, sep);
+    }
+}  // DumpDiff
+
 std::ostream& operator<<(std::ostream& out, const dump& d) {
     const uint8_t* data = (const uint8_t*)d.data;
 
-    char line[FMT_LINE_WIDTH];
+    // Lines are accumulated into a block which is written out in one go,
+    // rather than using std::endl, which flushes the stream after every line.
+    char block[STREAM_BLOCK_SIZE];
+    size_t blockLen = 0;
 
-    out << std::endl;
+    block[blockLen++] = '\n';
 
     if (d.numBytes == 0) {
-        DumpLine(d.prefix, d.address, d.data, d.numBytes, sizeof(line), line);
-        out << line << std::endl;
+        blockLen +=
+            DumpLine(d.prefix, d.address, d.data, d.numBytes, FMT_LINE_WIDTH, &block[blockLen]);
+        block[blockLen++] = '\n';
+        out.write(block, blockLen);
+        out.flush();
         return out;
     }
 
-    unsigned address = d.address;
+    size_t address = d.address;
     for (size_t i = 0; i < d.numBytes; i += LINE_WIDTH) {
+        if (sizeof(block) - blockLen < FMT_LINE_WIDTH + 1) {
+            out.write(block, blockLen);
+            blockLen = 0;
+        }
+
         size_t bytesThisLine = std::min(d.numBytes - i, LINE_WIDTH);
-        DumpLine(d.prefix, address, data, bytesThisLine, sizeof(line), line);
-        out << line << std::endl;
+        blockLen +=
+            DumpLine(d.prefix, address, data, bytesThisLine, FMT_LINE_WIDTH, &block[blockLen]);
+        block[blockLen++] = '\n';
 
-        address += bytesThisLine;
+        if (address != NO_ADDR) {
+            address += bytesThisLine;
+        }
         data += bytesThisLine;
     }
+    out.write(block, blockLen);
+    out.flush();
     return out;
 }
@@ -0,0 +1,363 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   KeyValue.cpp
+ *
+ *   @brief  Encoders for structured (key/value) log messages.
+ *
+ ****************************************************************************/
+
+#include "duino_log/KeyValue.h"
+
+#include "duino_log/Log.h"
+#include "duino_log/LogContext.h"
+#include "duino_log/Str.h"
+
+//! Names of the levels, as used in encoded messages.
+static const char* const level_name[] = {
+    "none",     // NONE
+    "fatal",    // FATAL
+    "error",    // ERROR
+    "warning",  // WARNING
+    "info",     // INFO
+    "debug",    // DEBUG
+};
+
+//! Bounded output buffer used by the encoders.
+struct KvWriter {
+    char* out;          //!< Output buffer.
+    size_t pos;         //!< Number of characters stored in `out`.
+    size_t limit;       //!< Maximum number of characters to store.
+    bool overflow;      //!< Set if anything didn't fit.
+
+    //! Appends a character.
+    void put(char c) {
+        if (this->pos < this->limit) {
+            this->out[this->pos++] = c;
+        } else {
+            this->overflow = true;
+        }
+    }
+
+    //! Appends a string.
+    void put(const char* s, size_t len) {
+        size_t room = this->limit - this->pos;
+        if (len > room) {
+            len = room;
+            this->overflow = true;
+        }
+        memcpy(&this->out[this->pos], s, len);
+        this->pos += len;
+    }
+};
+
+// The escaping functions check 8 characters at a time for characters which
+// need special treatment, so that long runs of ordinary characters are copied
+// with a single memcpy. See "Determine if a word has a byte less than n" from
+// https://graphics.stanford.edu/~seander/bithacks.html
+
+//! Each byte of a word set to 0x01.
+static constexpr uint64_t ONES = 0x0101010101010101ULL;
+
+//! Each byte of a word set to 0x80.
+static constexpr uint64_t HIGHS = 0x8080808080808080ULL;
+
+//! Determines if any byte in a word is less than `n` (which must be <= 128).
+//! @returns non-zero if it does.
+static inline uint64_t has_less(uint64_t word, uint8_t n) {
+    return (word - ONES * n) & ~word & HIGHS;
+}
+
+//! Determines if any byte in a word is equal to `c`.
+//! @returns non-zero if it does.
+static inline uint64_t has_byte(uint64_t word, char c) {
+    return has_less(word ^ (ONES * static_cast<uint8_t>(c)), 1);
+}
+
+//! Determines if a character needs to be escaped in a quoted string.
+//! @returns true if it does.
+static inline bool needs_escape(char c) {
+    return static_cast<uint8_t>(c) < 0x20 || c == '"' || c == '\\';
+}
+
+//! Determines the number of leading characters which don't need to be escaped.
+//! @returns the number of characters.
+static size_t safe_len(const char* s, size_t len) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, &s[i], sizeof(word));
+        if (has_less(word, 0x20) | has_byte(word, '"') | has_byte(word, '\\')) {
+            break;
+        }
+    }
+    while (i < len && !needs_escape(s[i])) {
+        i++;
+    }
+    return i;
+}
+
+//! Determines if a logfmt value needs to be quoted.
+//! @returns true if it does.
+static bool logfmt_needs_quotes(const char* s, size_t len) {
+    if (len == 0) {
+        return true;
+    }
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, &s[i], sizeof(word));
+        if (has_less(word, 0x21) | has_byte(word, '"') | has_byte(word, '=') |
+            has_byte(word, '\\')) {
+            return true;
+        }
+    }
+    for (; i < len; i++) {
+        if (needs_escape(s[i]) || s[i] == ' ' || s[i] == '=') {
+            return true;
+        }
+    }
+    return false;
+}
+
+//! Writes a quoted string, escaping it using JSON rules.
+static void put_quoted(KvWriter* w, const char* s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    w->put('"');
+    for (;;) {
+        size_t n = safe_len(s, len);
+        w->put(s, n);
+        if (n == len) {
+            break;
+        }
+        char c = s[n];
+        w->put('\\');
+        switch (c) {
+            case '"':
+            case '\\':
+                w->put(c);
+                break;
+            case '\n':
+                w->put('n');
+                break;
+            case '\r':
+                w->put('r');
+                break;
+            case '\t':
+                w->put('t');
+                break;
+            case '\b':
+                w->put('b');
+                break;
+            case '\f':
+                w->put('f');
+                break;
+            default:
+                w->put("u00", 3);
+                w->put(hex[(c >> 4) & 0x0f]);
+                w->put(hex[c & 0x0f]);
+                break;
+        }
+        s += n + 1;
+        len -= n + 1;
+    }
+    w->put('"');
+}
+
+//! Writes an integer, or a boolean value.
+static void put_number(KvWriter* w, const KeyValue& field) {
+    if (field.type == KeyValue::Type::BOOL) {
+        if (field.b) {
+            w->put("true", 4);
+        } else {
+            w->put("false", 5);
+        }
+        return;
+    }
+    uint64_t u = field.u;
+    if (field.type == KeyValue::Type::SIGNED && field.i < 0) {
+        w->put('-');
+        u = 0 - u;
+    }
+    char digits[24];
+    size_t n = StrUnsignedToDigits(digits + sizeof(digits), u, 10, false);
+    w->put(digits + sizeof(digits) - n, n);
+}
+
+//! Returns the name of a level.
+//! @returns the name.
+static const char* name_of(Log::Level level) {
+    uint_fast8_t int_level = static_cast<uint_fast8_t>(level);
+    return int_level <= static_cast<uint_fast8_t>(Log::Level::DEBUG) ? level_name[int_level] : "";
+}
+
+//! Appends a field using logfmt.
+static void put_logfmt_field(KvWriter* w, const KeyValue& field) {
+    w->put(field.key, strlen(field.key));
+    w->put('=');
+    if (field.type != KeyValue::Type::STRING) {
+        put_number(w, field);
+    } else if (logfmt_needs_quotes(field.s.str, field.s.len)) {
+        put_quoted(w, field.s.str, field.s.len);
+    } else {
+        w->put(field.s.str, field.s.len);
+    }
+}
+
+//! Appends a field as a JSON member (preceded by a comma).
+static void put_json_field(KvWriter* w, const KeyValue& field) {
+    w->put(',');
+    put_quoted(w, field.key, strlen(field.key));
+    w->put(':');
+    if (field.type == KeyValue::Type::STRING) {
+        put_quoted(w, field.s.str, field.s.len);
+    } else {
+        put_number(w, field);
+    }
+}
+
+//! Appends the fields of a context (outermost first) as JSON members.
+//! @details Fields which don't fit are dropped.
+static void put_json_context(KvWriter* w, const LogContext* context) {
+    if (context->parent() != nullptr) {
+        put_json_context(w, context->parent());
+    }
+    if (w->overflow) {
+        return;
+    }
+    size_t start = w->pos;
+    put_json_field(w, context->field());
+    if (w->overflow) {
+        w->pos = start;
+    }
+}
+
+size_t encode_logfmt_field(char* out, size_t maxLen, const KeyValue& field) {
+    if (maxLen == 0) {
+        return 0;
+    }
+    KvWriter w = {out, 0, maxLen - 1, false};
+    put_logfmt_field(&w, field);
+    if (w.overflow) {
+        w.pos = 0;
+    }
+    out[w.pos] = '\0';
+    return w.pos;
+}
+
+size_t Log::encode_logfmt(
+    char* out,
+    size_t maxLen,
+    Level level,
+    const char* msg,
+    const KeyValue* kvs,
+    size_t num_kvs,
+    const LogContext* context) {
+    if (maxLen == 0) {
+        return 0;
+    }
+    KvWriter w = {out, 0, maxLen - 1, false};
+
+    w.put("level=", 6);
+    const char* name = name_of(level);
+    w.put(name, strlen(name));
+    w.put(" msg=", 5);
+    size_t len = strlen(msg);
+    if (logfmt_needs_quotes(msg, len)) {
+        put_quoted(&w, msg, len);
+    } else {
+        w.put(msg, len);
+    }
+
+    if (context != nullptr && context->prefix_len() > 0) {
+        // The prefix is already encoded, with a trailing space rather than a leading one.
+        size_t start = w.pos;
+        w.put(' ');
+        w.put(context->prefix(), context->prefix_len() - 1);
+        if (w.overflow) {
+            w.pos = start;
+        }
+    }
+
+    for (size_t i = 0; i < num_kvs && !w.overflow; i++) {
+        size_t start = w.pos;
+        w.put(' ');
+        put_logfmt_field(&w, kvs[i]);
+        if (w.overflow) {
+            // Drop fields which don't fit.
+            w.pos = start;
+        }
+    }
+    out[w.pos] = '\0';
+    return w.pos;
+}
+
+size_t Log::encode_json(
+    char* out,
+    size_t maxLen,
+    Level level,
+    const char* msg,
+    const KeyValue* kvs,
+    size_t num_kvs,
+    const LogContext* context) {
+    if (maxLen < 3) {
+        // Not even room for "{}".
+        if (maxLen > 0) {
+            out[0] = '\0';
+        }
+        return 0;
+    }
+    // Leave room for the closing brace and the terminating null.
+    KvWriter w = {out, 0, maxLen - 2, false};
+
+    w.put("{\"level\":\"", 10);
+    const char* name = name_of(level);
+    w.put(name, strlen(name));
+    w.put("\",\"msg\":", 8);
+    put_quoted(&w, msg, strlen(msg));
+
+    if (context != nullptr && !w.overflow) {
+        put_json_context(&w, context);
+    }
+
+    for (size_t i = 0; i < num_kvs && !w.overflow; i++) {
+        size_t start = w.pos;
+        put_json_field(&w, kvs[i]);
+        if (w.overflow) {
+            // Drop fields which don't fit, so that the result is still valid.
+            w.pos = start;
+        }
+    }
+    out[w.pos++] = '}';
+    out[w.pos] = '\0';
+    return w.pos;
+}
+
+//! Passes an already formatted message to do_log().
+static void log_line(Log* log, Log::Level level, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static void log_line(Log* log, Log::Level level, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    log->do_log(level, fmt, args);
+    va_end(args);
+}
+
+void Log::do_log_kv(Level level, const char* msg, const KeyValue* kvs, size_t num_kvs) {
+    // do_log() adds the context (if the logger shows it), so it isn't encoded here too.
+    char line[MAX_KV_LEN];
+    if (this->kv_format.load(std::memory_order_relaxed) == KvFormat::JSON) {
+        encode_json(line, sizeof(line), level, msg, kvs, num_kvs);
+    } else {
+        encode_logfmt(line, sizeof(line), level, msg, kvs, num_kvs);
+    }
+    log_line(this, level, "%s", line);
+}
@@ -0,0 +1,180 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   LineLog.cpp
+ *
+ *   @brief  Base class for loggers which output complete lines.
+ *
+ ****************************************************************************/
+
+#include "duino_log/LineLog.h"
+
+#include "duino_log/LogContext.h"
+#include "duino_log/Str.h"
+
+#if LOG_STATS_ENABLED
+#include "duino_log/LogStats.h"
+#endif
+
+const char* LineLog::level_str[] = {
+    "",      // NONE
+    "[F] ",  // FATAL
+    "[E] ",  // ERROR
+    "[W] ",  // WARNING
+    "[I] ",  // INFO
+    "[D] ",  // DEBUG
+};
+
+size_t LineLog::format_line(
+    char* line,
+    size_t lineLen,
+    Level level,
+    const char* fmt,
+    va_list args) {
+    // Leave room for the newline.
+    size_t maxLen = lineLen - 1;
+
+    size_t len = 0;
+    uint_fast8_t int_level = static_cast<uint_fast8_t>(level);
+    if (int_level <= static_cast<uint_fast8_t>(Level::DEBUG)) {
+        len = StrMaxCpyLen(line, level_str[int_level], maxLen);
+    }
+    len += LogContext::copy_prefix(&line[len], maxLen - len);
+    len += vStrPrintf(&line[len], maxLen - len, fmt, args);
+    line[len++] = '\n';
+    line[len] = '\0';
+    return len;
+}
+
+void LineLog::set_dedup(Level level, bool enable) {
+    uint8_t mask = 1 << static_cast<uint_fast8_t>(level);
+    if (enable) {
+        this->m_dedup_levels.fetch_or(mask, std::memory_order_relaxed);
+    } else {
+        this->m_dedup_levels.fetch_and(~mask, std::memory_order_relaxed);
+    }
+}
+
+void LineLog::flush_repeats() {
+#if LOG_THREADS_ENABLED
+    std::lock_guard<std::mutex> lock(this->m_dedup_mutex);
+#endif
+    this->write_repeats();
+    this->m_last_len = 0;
+}
+
+void LineLog::prepare_fork() {
+#if LOG_THREADS_ENABLED
+    this->m_dedup_mutex.lock();
+#endif
+}
+
+void LineLog::parent_after_fork() {
+#if LOG_THREADS_ENABLED
+    this->m_dedup_mutex.unlock();
+#endif
+}
+
+void LineLog::child_after_fork() {
+    this->m_repeats = 0;
+    this->m_last_len = 0;
+#if LOG_THREADS_ENABLED
+    this->m_dedup_mutex.unlock();
+#endif
+}
+
+void LineLog::write_repeats() {
+    if (this->m_repeats == 0) {
+        return;
+    }
+    char line[MAX_LINE_LEN];
+    uint_fast8_t int_level = static_cast<uint_fast8_t>(this->m_last_level);
+    size_t len = StrPrintf(
+        line,
+        sizeof(line),
+        "%slast message repeated %" PRIu32 " times\n",
+        level_str[int_level],
+        this->m_repeats);
+    this->m_repeats = 0;
+    this->write_line(this->m_last_level, line, len);
+}
+
+bool LineLog::collapse(Level level, const char* line, size_t len) {
+    bool dedup = (this->m_dedup_levels.load(std::memory_order_relaxed) >>
+                  static_cast<uint_fast8_t>(level)) &
+                 1;
+
+#if LOG_THREADS_ENABLED
+    std::lock_guard<std::mutex> lock(this->m_dedup_mutex);
+#endif
+    if (dedup && len == this->m_last_len && level == this->m_last_level &&
+        memcmp(line, this->m_last_line, len) == 0) {
+        this->m_repeats++;
+        return true;
+    }
+    this->write_repeats();
+    if (dedup) {
+        memcpy(this->m_last_line, line, len);
+        this->m_last_len = len;
+        this->m_last_level = level;
+    } else {
+        this->m_last_len = 0;
+    }
+    return false;
+}
+
+void LineLog::output(Level level, const char* line, size_t len) {
+    if (this->m_dedup_levels.load(std::memory_order_relaxed) != 0 &&
+        this->collapse(level, line, len)) {
+        return;
+    }
+#if LOG_STATS_ENABLED
+    uint64_t start = LogStats::start(LogStats::Timer::WRITE);
+    this->write_line(level, line, len);
+    LogStats::record_latency(LogStats::Timer::WRITE, start);
+#else
+    this->write_line(level, line, len);
+#endif
+}
+
+void LineLog::do_log(Level level, const char* fmt, va_list args) {
+    char line[MAX_LINE_LEN];
+#if LOG_STATS_ENABLED
+    uint64_t start = LogStats::start(LogStats::Timer::FORMAT);
+    size_t len = format_line(line, sizeof(line), level, fmt, args);
+    LogStats::record_latency(LogStats::Timer::FORMAT, start);
+    LogStats::record_line(len, len == sizeof(line) - 1);
+#else
+    size_t len = format_line(line, sizeof(line), level, fmt, args);
+#endif
+    this->output(level, line, len);
+}
+
+void LineLog::do_log_kv(Level level, const char* msg, const KeyValue* kvs, size_t num_kvs) {
+    char line[MAX_LINE_LEN];
+#if LOG_STATS_ENABLED
+    uint64_t start = LogStats::start(LogStats::Timer::FORMAT);
+#endif
+    // Leave room for the newline.
+    size_t len;
+    if (this->kv_format.load(std::memory_order_relaxed) == KvFormat::JSON) {
+        len = encode_json(line, sizeof(line) - 1, level, msg, kvs, num_kvs, LogContext::current());
+    } else {
+        len = encode_logfmt(
+            line, sizeof(line) - 1, level, msg, kvs, num_kvs, LogContext::current());
+    }
+    line[len++] = '\n';
+    line[len] = '\0';
+#if LOG_STATS_ENABLED
+    LogStats::record_latency(LogStats::Timer::FORMAT, start);
+    LogStats::record_line(len, len == sizeof(line) - 1);
+#endif
+    this->output(level, line, len);
+}
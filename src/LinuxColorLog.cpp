@@ -18,6 +18,7 @@
 
 #include <cstdio>
 
+#include "duino_log/LogContext.h"
 #include "duino_log/Str.h"
 
 const char* LinuxColorLog::level_str[] = {
@@ -42,13 +43,34 @@ size_t LinuxColorLog::log_char_to_file(
     return 1;
 }
 
+void LinuxColorLog::prepare_fork() {
+    flockfile(this->m_log_fs);
+    fflush(this->m_log_fs);
+}
+
+void LinuxColorLog::parent_after_fork() {
+    funlockfile(this->m_log_fs);
+}
+
+void LinuxColorLog::child_after_fork() {
+    funlockfile(this->m_log_fs);
+}
+
 void LinuxColorLog::do_log(Level level, const char* fmt, va_list args) {
+    // Holding the lock for the whole line keeps lines from different threads
+    // apart, and means that prepare_fork() never forks in the middle of one.
+    flockfile(this->m_log_fs);
     uint_fast8_t int_level = static_cast<uint_fast8_t>(level);
     if (int_level <= static_cast<uint_fast8_t>(Level::DEBUG)) {
         fputs(level_str[int_level], this->m_log_fs);
     }
+    const LogContext* context = LogContext::current();
+    if (context != nullptr) {
+        fwrite(context->prefix(), 1, context->prefix_len(), this->m_log_fs);
+    }
     vStrXPrintf(log_char_to_file, this, fmt, args);
     fputs(COLOR_NO_COLOR, this->m_log_fs);
     fputc('\n', this->m_log_fs);
     fflush(this->m_log_fs);
+    funlockfile(this->m_log_fs);
 }
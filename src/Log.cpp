@@ -16,17 +16,246 @@
 
 #include "duino_log/Log.h"
 
+#if LOG_THREADS_ENABLED
+#include <mutex>
+#include <thread>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+#if LOG_STATS_ENABLED
+#include "duino_log/LogStats.h"
+#endif
+
 #if LOGGING_ENABLED
 //! Pointer to the global logger object.
-Log* Log::logger = nullptr;
+std::atomic<Log*> Log::logger{nullptr};
+std::atomic<int> Log::emergency_fd{2};
 #endif  // LOGGING_ENABLED
 
+#if LOG_THREADS_ENABLED
+
+//! Hazard pointer which a thread uses to publish the logger it's calling.
+//! @details Hazards are kept in a list which only grows. When a thread exits,
+//!          its hazard is marked as unused so that a new thread can reuse it.
+struct LogHazard {
+    std::atomic<Log*> log{nullptr};  //!< Logger being called by the owning thread.
+    std::atomic<bool> in_use{true};  //!< Set while a thread owns this hazard.
+    LogHazard* next = nullptr;       //!< Next hazard in the list.
+};
+
+//! List of all of the hazards.
+static std::atomic<LogHazard*> hazards{nullptr};
+
+//! Owns a hazard for the lifetime of a thread.
+class LogHazardHolder {
+ public:
+    //! Constructor. Reuses an unused hazard, or adds a new one to the list.
+    LogHazardHolder() {
+        for (LogHazard* h = hazards.load(std::memory_order_acquire); h != nullptr; h = h->next) {
+            bool in_use = false;
+            if (!h->in_use.load(std::memory_order_relaxed) &&
+                h->in_use.compare_exchange_strong(in_use, true, std::memory_order_acquire)) {
+                this->hazard = h;
+                return;
+            }
+        }
+        this->hazard = new LogHazard;
+        LogHazard* head = hazards.load(std::memory_order_relaxed);
+        do {
+            this->hazard->next = head;
+        } while (!hazards.compare_exchange_weak(head, this->hazard, std::memory_order_release));
+    }
+
+    //! Destructor. Releases the hazard.
+    ~LogHazardHolder() {
+        this->hazard->log.store(nullptr, std::memory_order_release);
+        this->hazard->in_use.store(false, std::memory_order_release);
+    }
+
+    LogHazard* hazard;  //!< Hazard owned by this thread.
+};
+
+//! Hazard for the calling thread.
+static thread_local LogHazardHolder thread_hazard;
+
+//! Pins the current logger for the duration of a logging call.
+//! @details The logger is published in the calling thread's hazard, and the
+//!          global pointer is then checked again, so that detach() either
+//!          sees the hazard, or this sees that the logger was removed.
+class LoggerPin {
+ public:
+    //! Constructor. Pins the current logger.
+    LoggerPin() : m_hazard(&thread_hazard.hazard->log) {
+        // Logging from within do_log pins the same logger again, so restore
+        // whatever was pinned before rather than clearing it.
+        this->m_prev = this->m_hazard->load(std::memory_order_relaxed);
+        Log* log = Log::logger.load(std::memory_order_relaxed);
+        while (log != nullptr) {
+            this->m_hazard->store(log, std::memory_order_seq_cst);
+            Log* current = Log::logger.load(std::memory_order_seq_cst);
+            if (current == log) {
+                break;
+            }
+            log = current;
+        }
+        this->m_log = log;
+    }
+
+    //! Destructor. Unpins the logger.
+    ~LoggerPin() { this->m_hazard->store(this->m_prev, std::memory_order_release); }
+
+    //! Returns the pinned logger.
+    //! @returns the logger, or nullptr if there isn't a current logger.
+    Log* get() const { return this->m_log; }
+
+ private:
+    std::atomic<Log*>* m_hazard;  //!< Hazard of the calling thread.
+    Log* m_prev;                  //!< Previous value of the hazard.
+    Log* m_log;                   //!< The pinned logger.
+};
+
+//! Waits for other threads which have pinned a logger to unpin it.
+//! @details The calling thread may be inside the logger, so its own hazard is skipped.
+static void wait_until_unpinned(const Log* log) {
+    const LogHazard* own = thread_hazard.hazard;
+    for (const LogHazard* h = hazards.load(std::memory_order_acquire); h != nullptr; h = h->next) {
+        while (h != own && h->log.load(std::memory_order_seq_cst) == log) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+#else
+
+//! Returns the current logger for the duration of a logging call.
+//! @details Without threads, the logger can't be replaced while a call is in
+//!          progress, so there's nothing to pin.
+class LoggerPin {
+ public:
+    //! Constructor. Reads the current logger.
+    LoggerPin() : m_log(Log::logger.load(std::memory_order_relaxed)) {}
+
+    //! Returns the current logger.
+    //! @returns the logger, or nullptr if there isn't a current logger.
+    Log* get() const { return this->m_log; }
+
+ private:
+    Log* m_log;  //!< The current logger.
+};
+
+//! Without threads, there aren't any other calls to wait for.
+static void wait_until_unpinned(const Log* log) {
+    (void)log;
+}
+
+#endif  // LOG_THREADS_ENABLED
+
+#if LOG_THREADS_ENABLED && (defined(__unix__) || defined(__APPLE__))
+
+//! Pins the current logger from fork_prepare() until the after fork handlers.
+static LoggerPin* fork_pin = nullptr;
+
+//! Called before the process forks.
+static void fork_prepare() {
+    fork_pin = new LoggerPin;
+    if (fork_pin->get() != nullptr) {
+        fork_pin->get()->prepare_fork();
+    }
+#if LOG_STATS_ENABLED
+    // This is taken last, since preparing the logger may record statistics.
+    LogStats::prepare_fork();
+#endif
+}
+
+//! Called in the parent after the process forks.
+static void fork_parent() {
+#if LOG_STATS_ENABLED
+    LogStats::parent_after_fork();
+#endif
+    if (fork_pin->get() != nullptr) {
+        fork_pin->get()->parent_after_fork();
+    }
+    delete fork_pin;
+    fork_pin = nullptr;
+}
+
+//! Called in the child after the process forks.
+static void fork_child() {
+    // The other threads don't exist in the child, so their hazards are
+    // released, otherwise detach() would wait for them forever.
+    const LogHazard* own = thread_hazard.hazard;
+    for (LogHazard* h = hazards.load(std::memory_order_acquire); h != nullptr; h = h->next) {
+        if (h != own) {
+            h->log.store(nullptr, std::memory_order_relaxed);
+            h->in_use.store(false, std::memory_order_release);
+        }
+    }
+#if LOG_STATS_ENABLED
+    LogStats::child_after_fork();
+#endif
+    if (fork_pin->get() != nullptr) {
+        fork_pin->get()->child_after_fork();
+    }
+    delete fork_pin;
+    fork_pin = nullptr;
+}
+
+#endif
+
+void Log::register_fork_handlers() {
+#if LOG_THREADS_ENABLED && (defined(__unix__) || defined(__APPLE__))
+    static std::once_flag registered;
+    std::call_once(registered, [] { pthread_atfork(fork_prepare, fork_parent, fork_child); });
+#endif
+}
+
+void Log::detach() {
+    if constexpr (LOGGING_ENABLED) {
+        Log* expected = this;
+        logger.compare_exchange_strong(expected, nullptr, std::memory_order_seq_cst);
+        wait_until_unpinned(this);
+    }
+}
+
+Log* Log::replace(Log* log) {
+    if constexpr (LOGGING_ENABLED) {
+        Log* prev = logger.exchange(log, std::memory_order_seq_cst);
+        if (prev != nullptr) {
+            wait_until_unpinned(prev);
+        }
+        return prev;
+    }
+    return nullptr;
+}
+
+//! Passes a message to the logger, recording statistics.
+static inline void call_do_log(Log* logger, Log::Level level, const char* fmt, va_list args)
+    __attribute__((format(printf, 3, 0)));
+
+static inline void call_do_log(Log* logger, Log::Level level, const char* fmt, va_list args) {
+#if LOG_STATS_ENABLED
+    uint64_t start = LogStats::start(LogStats::Timer::TOTAL);
+    logger->do_log(level, fmt, args);
+    LogStats::record_message(level, start);
+#else
+    logger->do_log(level, fmt, args);
+#endif
+}
+
 void Log::debug(const char* fmt, ...) {
     if constexpr (LOGGING_ENABLED) {
-        if (logger != nullptr && logger->should_log(Level::DEBUG)) {
+        LoggerPin pin;
+        Log* current = pin.get();
+        if (current != nullptr && current->should_log(Level::DEBUG, fmt)) {
             va_list args;
             va_start(args, fmt);
-            logger->do_log(Level::DEBUG, fmt, args);
+            call_do_log(current, Level::DEBUG, fmt, args);
             va_end(args);
         }
     }
@@ -34,10 +263,12 @@ void Log::debug(const char* fmt, ...) {
 
 void Log::info(const char* fmt, ...) {
     if constexpr (LOGGING_ENABLED) {
-        if (logger != nullptr && logger->should_log(Level::INFO)) {
+        LoggerPin pin;
+        Log* current = pin.get();
+        if (current != nullptr && current->should_log(Level::INFO, fmt)) {
             va_list args;
             va_start(args, fmt);
-            logger->do_log(Level::INFO, fmt, args);
+            call_do_log(current, Level::INFO, fmt, args);
             va_end(args);
         }
     }
@@ -45,10 +276,12 @@ void Log::info(const char* fmt, ...) {
 
 void Log::warning(const char* fmt, ...) {
     if constexpr (LOGGING_ENABLED) {
-        if (logger != nullptr && logger->should_log(Level::WARNING)) {
+        LoggerPin pin;
+        Log* current = pin.get();
+        if (current != nullptr && current->should_log(Level::WARNING, fmt)) {
             va_list args;
             va_start(args, fmt);
-            logger->do_log(Level::WARNING, fmt, args);
+            call_do_log(current, Level::WARNING, fmt, args);
             va_end(args);
         }
     }
@@ -56,10 +289,12 @@ void Log::warning(const char* fmt, ...) {
 
 void Log::error(const char* fmt, ...) {
     if constexpr (LOGGING_ENABLED) {
-        if (logger != nullptr && logger->should_log(Level::ERROR)) {
+        LoggerPin pin;
+        Log* current = pin.get();
+        if (current != nullptr && current->should_log(Level::ERROR, fmt)) {
             va_list args;
             va_start(args, fmt);
-            logger->do_log(Level::ERROR, fmt, args);
+            call_do_log(current, Level::ERROR, fmt, args);
             va_end(args);
         }
     }
@@ -67,10 +302,12 @@ void Log::error(const char* fmt, ...) {
 
 void Log::fatal(const char* fmt, ...) {
     if constexpr (LOGGING_ENABLED) {
-        if (logger != nullptr && logger->should_log(Level::FATAL)) {
+        LoggerPin pin;
+        Log* current = pin.get();
+        if (current != nullptr && current->should_log(Level::FATAL, fmt)) {
             va_list args;
             va_start(args, fmt);
-            logger->do_log(Level::FATAL, fmt, args);
+            call_do_log(current, Level::FATAL, fmt, args);
             va_end(args);
         }
     }
@@ -78,10 +315,12 @@ void Log::fatal(const char* fmt, ...) {
 
 void Log::log(Level level, const char* fmt, ...) {
     if constexpr (LOGGING_ENABLED) {
-        if (logger != nullptr && logger->should_log(level)) {
+        LoggerPin pin;
+        Log* current = pin.get();
+        if (current != nullptr && current->should_log(level, fmt)) {
             va_list args;
             va_start(args, fmt);
-            logger->do_log(Level::INFO, fmt, args);
+            call_do_log(current, level, fmt, args);
             va_end(args);
         }
     }
@@ -89,8 +328,177 @@ void Log::log(Level level, const char* fmt, ...) {
 
 void Log::vlog(Level level, const char* fmt, va_list args) {
     if constexpr (LOGGING_ENABLED) {
-        if (logger != nullptr && logger->should_log(level)) {
-            logger->do_log(level, fmt, args);
+        LoggerPin pin;
+        Log* current = pin.get();
+        if (current != nullptr && current->should_log(level, fmt)) {
+            call_do_log(current, level, fmt, args);
+        }
+    }
+}
+
+void Log::emergency(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vemergency(fmt, args);
+    va_end(args);
+}
+
+void Log::vemergency(const char* fmt, va_list args) {
+#if LOGGING_ENABLED && (defined(__unix__) || defined(__APPLE__))
+    int fd = emergency_fd.load(std::memory_order_relaxed);
+    if (fd < 0) {
+        return;
+    }
+    // Nothing here may allocate or take a lock, since the interrupted code
+    // may be holding the malloc or stdio locks.
+    static constexpr char PREFIX[] = "[F] ";
+    static constexpr size_t PREFIX_LEN = sizeof(PREFIX) - 1;
+    char line[MAX_EMERGENCY_LEN];
+    memcpy(line, PREFIX, PREFIX_LEN);
+    // Leave room for the newline (vStrPrintf reserves the null's space).
+    size_t len = PREFIX_LEN + vStrPrintf(&line[PREFIX_LEN], sizeof(line) - PREFIX_LEN - 1, fmt, args);
+    line[len++] = '\n';
+
+    int saved_errno = errno;
+    for (size_t written = 0; written < len;) {
+        ssize_t n = write(fd, &line[written], len - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        written += static_cast<size_t>(n);
+    }
+    errno = saved_errno;
+#else
+    (void)fmt;
+    (void)args;
+#endif
+}
+
+bool Log::enabled(Level level) {
+    if constexpr (LOGGING_ENABLED) {
+        LoggerPin pin;
+        Log* current = pin.get();
+        return current != nullptr && current->should_log(level);
+    }
+    return false;
+}
+
+void Log::log_lazy_args(Level level, const char* fmt, LazyArgs* args) {
+    if constexpr (LOGGING_ENABLED) {
+        LoggerPin pin;
+        Log* current = pin.get();
+        if (current != nullptr && current->should_log(level, fmt)) {
+            args->log(current, level, fmt);
+        }
+    }
+}
+
+void Log::log_to(Log* logger, Level level, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    call_do_log(logger, level, fmt, args);
+    va_end(args);
+}
+
+void Log::log_durable(Completion* completion, Level level, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vlog_durable(completion, level, fmt, args);
+    va_end(args);
+}
+
+void Log::vlog_durable(Completion* completion, Level level, const char* fmt, va_list args) {
+    if constexpr (LOGGING_ENABLED) {
+        LoggerPin pin;
+        Log* current = pin.get();
+        if (current != nullptr) {
+            if (current->should_log(level)) {
+#if LOG_STATS_ENABLED
+                uint64_t start = LogStats::start(LogStats::Timer::TOTAL);
+                current->do_log_durable(completion, level, fmt, args);
+                LogStats::record_message(level, start);
+#else
+                current->do_log_durable(completion, level, fmt, args);
+#endif
+                return;
+            }
+            record_suppressed(level);
+        }
+    }
+    completion->complete();
+}
+
+void Log::do_log_durable(Completion* completion, Level level, const char* fmt, va_list args) {
+    this->do_log(level, fmt, args);
+    this->sync();
+    completion->complete();
+}
+
+void Log::log_kv(Level level, const char* msg, const KeyValue* kvs, size_t num_kvs) {
+    if constexpr (LOGGING_ENABLED) {
+        LoggerPin pin;
+        Log* current = pin.get();
+        if (current != nullptr && current->should_log(level, msg)) {
+#if LOG_STATS_ENABLED
+            uint64_t start = LogStats::start(LogStats::Timer::TOTAL);
+            current->do_log_kv(level, msg, kvs, num_kvs);
+            LogStats::record_message(level, start);
+#else
+            current->do_log_kv(level, msg, kvs, num_kvs);
+#endif
         }
     }
 }
+
+#if LOG_COROUTINES_ENABLED
+Log::DurableAwaiter Log::async_debug(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    DurableAwaiter awaiter(Level::DEBUG, fmt, args);
+    va_end(args);
+    return awaiter;
+}
+
+Log::DurableAwaiter Log::async_info(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    DurableAwaiter awaiter(Level::INFO, fmt, args);
+    va_end(args);
+    return awaiter;
+}
+
+Log::DurableAwaiter Log::async_warning(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    DurableAwaiter awaiter(Level::WARNING, fmt, args);
+    va_end(args);
+    return awaiter;
+}
+
+Log::DurableAwaiter Log::async_error(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    DurableAwaiter awaiter(Level::ERROR, fmt, args);
+    va_end(args);
+    return awaiter;
+}
+
+Log::DurableAwaiter Log::async_fatal(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    DurableAwaiter awaiter(Level::FATAL, fmt, args);
+    va_end(args);
+    return awaiter;
+}
+
+Log::DurableAwaiter Log::async_log(Level level, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    DurableAwaiter awaiter(level, fmt, args);
+    va_end(args);
+    return awaiter;
+}
+#endif
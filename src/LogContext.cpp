@@ -0,0 +1,74 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   LogContext.cpp
+ *
+ *   @brief  Per-thread context fields which are attached to each message.
+ *
+ ****************************************************************************/
+
+#include "duino_log/LogContext.h"
+
+#include <cassert>
+
+#include "duino_log/Log.h"
+
+#if LOG_THREADS_ENABLED
+//! Innermost context of the calling thread.
+static thread_local const LogContext* context_top = nullptr;
+#else
+//! Innermost context (there's only one thread).
+static const LogContext* context_top = nullptr;
+#endif
+
+LogContext::LogContext(const KeyValue& field) : m_parent{context_top}, m_field{field} {
+    if (field.type == KeyValue::Type::STRING) {
+        size_t len = field.s.len < MAX_VALUE_LEN - 1 ? field.s.len : MAX_VALUE_LEN - 1;
+        memcpy(this->m_value, field.s.str, len);
+        this->m_value[len] = '\0';
+        this->m_field.s.str = this->m_value;
+        this->m_field.s.len = len;
+    }
+
+    size_t len = 0;
+    if (this->m_parent != nullptr) {
+        len = this->m_parent->m_prefix_len;
+        memcpy(this->m_prefix, this->m_parent->m_prefix, len);
+    }
+    // Leave room for the trailing space.
+    size_t fieldLen = encode_logfmt_field(&this->m_prefix[len], MAX_PREFIX_LEN - len - 1, this->m_field);
+    if (fieldLen > 0) {
+        len += fieldLen;
+        this->m_prefix[len++] = ' ';
+    }
+    this->m_prefix[len] = '\0';
+    this->m_prefix_len = len;
+
+    context_top = this;
+}
+
+LogContext::~LogContext() {
+    assert(context_top == this);
+    context_top = this->m_parent;
+}
+
+const LogContext* LogContext::current() {
+    return context_top;
+}
+
+size_t LogContext::copy_prefix(char* out, size_t maxLen) {
+    const LogContext* context = context_top;
+    if (context == nullptr) {
+        return 0;
+    }
+    size_t len = context->m_prefix_len < maxLen ? context->m_prefix_len : maxLen;
+    memcpy(out, context->m_prefix, len);
+    return len;
+}
@@ -0,0 +1,334 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   LogStats.cpp
+ *
+ *   @brief  Statistics about the logging hot path.
+ *
+ ****************************************************************************/
+
+#include "duino_log/LogStats.h"
+
+#include <atomic>
+#include <cerrno>
+
+#include "duino_log/Str.h"
+
+size_t LogHistogram::bucket(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return value;
+    }
+    uint32_t msb = 63 - __builtin_clzll(value);
+    uint32_t sub = (value >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return (msb - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LogHistogram::bucket_min(size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    uint32_t msb = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    uint64_t sub = bucket % SUB_BUCKETS;
+    return (SUB_BUCKETS + sub) << (msb - SUB_BUCKET_BITS);
+}
+
+uint64_t LogHistogram::total() const {
+    uint64_t total = 0;
+    for (uint64_t count : this->counts) {
+        total += count;
+    }
+    return total;
+}
+
+uint64_t LogHistogram::percentile(double percent) const {
+    uint64_t total = this->total();
+    if (total == 0) {
+        return 0;
+    }
+    // Number of values which need to be at or below the percentile.
+    uint64_t target = static_cast<uint64_t>(percent / 100.0 * static_cast<double>(total) + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NUM_BUCKETS; i++) {
+        seen += this->counts[i];
+        if (seen >= target) {
+            return bucket_min(i);
+        }
+    }
+    return this->max();
+}
+
+uint64_t LogHistogram::max() const {
+    for (size_t i = NUM_BUCKETS; i > 0; i--) {
+        if (this->counts[i - 1] != 0) {
+            return bucket_min(i - 1);
+        }
+    }
+    return 0;
+}
+
+size_t LogStats::format(char* out, size_t maxLen) const {
+    static const char level_char[] = "-FEWID";
+    size_t len = StrMaxCpyLen(out, "log stats: messages", maxLen);
+    for (size_t i = 1; i < NUM_LEVELS; i++) {
+        len += StrPrintf(&out[len], maxLen - len, " %c=%" PRIu64, level_char[i], this->messages[i]);
+    }
+    len = StrMaxAppend(out, len, " suppressed", maxLen);
+    for (size_t i = 1; i < NUM_LEVELS; i++) {
+        len +=
+            StrPrintf(&out[len], maxLen - len, " %c=%" PRIu64, level_char[i], this->suppressed[i]);
+    }
+    uint64_t dropped = 0;
+    for (uint64_t count : this->dropped) {
+        dropped += count;
+    }
+    len += StrPrintf(
+        &out[len],
+        maxLen - len,
+        " dropped=%" PRIu64 " bytes=%" PRIu64 " truncated=%" PRIu64,
+        dropped,
+        this->bytes,
+        this->truncated);
+
+    static const char* const timer_name[NUM_TIMERS] = {"total", "format", "write", "stall"};
+    for (size_t i = 0; i < NUM_TIMERS; i++) {
+        const LogHistogram& hist = this->latency_ns[i];
+        if (hist.total() == 0) {
+            continue;
+        }
+        len += StrPrintf(
+            &out[len],
+            maxLen - len,
+            " %s_ns(p50/p99/max)=%" PRIu64 "/%" PRIu64 "/%" PRIu64,
+            timer_name[i],
+            hist.percentile(50.0),
+            hist.percentile(99.0),
+            hist.max());
+    }
+    return len;
+}
+
+#if LOG_STATS_ENABLED
+
+//! Statistics recorded by a single thread.
+//! @details Only the owning thread writes to the counters, so they're
+//!          updated with a relaxed load and store (no locked instructions).
+//!          They're atomic so that Log::stats() can read them at any time.
+struct LogThreadStats {
+    std::atomic<uint64_t> messages[LogStats::NUM_LEVELS] = {};    //!< See LogStats.
+    std::atomic<uint64_t> suppressed[LogStats::NUM_LEVELS] = {};  //!< See LogStats.
+    std::atomic<uint64_t> dropped[LogStats::NUM_LEVELS] = {};     //!< See LogStats.
+    std::atomic<uint64_t> bytes{0};                               //!< See LogStats.
+    std::atomic<uint64_t> truncated{0};                           //!< See LogStats.
+
+    //! See LogStats.
+    std::atomic<uint64_t> latency_ns[LogStats::NUM_TIMERS][LogHistogram::NUM_BUCKETS] = {};
+
+    LogThreadStats* next = nullptr;  //!< Next entry in the list of live threads.
+
+    //! Adds the counters to a snapshot.
+    void add_to(LogStats* stats) const {
+        for (size_t i = 0; i < LogStats::NUM_LEVELS; i++) {
+            stats->messages[i] += this->messages[i].load(std::memory_order_relaxed);
+            stats->suppressed[i] += this->suppressed[i].load(std::memory_order_relaxed);
+            stats->dropped[i] += this->dropped[i].load(std::memory_order_relaxed);
+        }
+        stats->bytes += this->bytes.load(std::memory_order_relaxed);
+        stats->truncated += this->truncated.load(std::memory_order_relaxed);
+        for (size_t t = 0; t < LogStats::NUM_TIMERS; t++) {
+            for (size_t i = 0; i < LogHistogram::NUM_BUCKETS; i++) {
+                stats->latency_ns[t].counts[i] +=
+                    this->latency_ns[t][i].load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+//! Increments a counter which is only written by the calling thread.
+static inline void bump(std::atomic<uint64_t>& counter, uint64_t amount = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+//! Protects `live_threads` and `retired`.
+static std::mutex registry_mutex;
+
+//! Statistics of the threads which are still running.
+static LogThreadStats* live_threads = nullptr;
+
+//! Statistics accumulated from threads which have exited.
+static LogStats retired;
+
+//! Registers the statistics of a thread while it runs.
+class LogThreadStatsHolder {
+ public:
+    //! Constructor. Adds the statistics to the list of live threads.
+    LogThreadStatsHolder() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        this->stats.next = live_threads;
+        live_threads = &this->stats;
+    }
+
+    //! Destructor. Folds the statistics into `retired`.
+    ~LogThreadStatsHolder() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (LogThreadStats** p = &live_threads; *p != nullptr; p = &(*p)->next) {
+            if (*p == &this->stats) {
+                *p = this->stats.next;
+                break;
+            }
+        }
+        this->stats.add_to(&retired);
+    }
+
+    LogThreadStats stats;  //!< Statistics for this thread.
+};
+
+//! Statistics for the calling thread.
+static thread_local LogThreadStatsHolder thread_stats;
+
+//! Number of operations started by the calling thread, for each timer.
+static thread_local uint32_t thread_ticks[LogStats::NUM_TIMERS];
+
+uint64_t LogStats::start(Timer timer) {
+    if (++thread_ticks[static_cast<size_t>(timer)] % LATENCY_SAMPLE_INTERVAL != 0) {
+        return 0;
+    }
+    return now();
+}
+
+void LogStats::record_message(Log::Level level, uint64_t start) {
+    bump(thread_stats.stats.messages[static_cast<size_t>(level)]);
+    record_latency(Timer::TOTAL, start);
+}
+
+void LogStats::record_suppressed(Log::Level level) {
+    bump(thread_stats.stats.suppressed[static_cast<size_t>(level)]);
+}
+
+void LogStats::record_dropped(Log::Level level) {
+    bump(thread_stats.stats.dropped[static_cast<size_t>(level)]);
+}
+
+void LogStats::record_line(size_t len, bool truncated) {
+    LogThreadStats& stats = thread_stats.stats;
+    bump(stats.bytes, len);
+    if (truncated) {
+        bump(stats.truncated);
+    }
+}
+
+void LogStats::record_latency(Timer timer, uint64_t start) {
+    if (start == 0) {
+        return;
+    }
+    uint64_t elapsed = now() - start;
+    bump(thread_stats.stats.latency_ns[static_cast<size_t>(timer)][LogHistogram::bucket(elapsed)]);
+}
+
+void Log::record_suppressed(Level level) {
+    LogStats::record_suppressed(level);
+}
+
+void LogStats::prepare_fork() {
+    // Make sure that the calling thread is registered before taking the
+    // lock, since registering takes it too.
+    LogThreadStats& own = thread_stats.stats;
+    (void)own;
+    registry_mutex.lock();
+}
+
+void LogStats::parent_after_fork() {
+    registry_mutex.unlock();
+}
+
+void LogStats::child_after_fork() {
+    // Only the calling thread exists in the child, and the other threads'
+    // holders will never be destroyed, so their statistics are retired now.
+    for (LogThreadStats** p = &live_threads; *p != nullptr;) {
+        LogThreadStats* stats = *p;
+        if (stats == &thread_stats.stats) {
+            p = &stats->next;
+        } else {
+            stats->add_to(&retired);
+            *p = stats->next;
+        }
+    }
+    registry_mutex.unlock();
+}
+
+LogStats Log::stats() {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    LogStats stats = retired;
+    for (const LogThreadStats* thread = live_threads; thread != nullptr; thread = thread->next) {
+        thread->add_to(&stats);
+    }
+    return stats;
+}
+
+#else
+
+uint64_t LogStats::start(Timer) {
+    return 0;
+}
+
+void LogStats::record_message(Log::Level, uint64_t) {}
+void LogStats::record_suppressed(Log::Level) {}
+void LogStats::record_dropped(Log::Level) {}
+void LogStats::record_line(size_t, bool) {}
+void LogStats::record_latency(Timer, uint64_t) {}
+
+LogStats Log::stats() {
+    return LogStats();
+}
+
+#endif  // LOG_STATS_ENABLED
+
+#if LOG_STATS_ENABLED
+
+LogStatsDumper::LogStatsDumper(std::chrono::milliseconds interval, int fd)
+    : m_interval(interval), m_fd(fd), m_thread(&LogStatsDumper::run, this) {}
+
+LogStatsDumper::~LogStatsDumper() {
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        this->m_stop = true;
+    }
+    this->m_cv.notify_one();
+    this->m_thread.join();
+}
+
+void LogStatsDumper::dump() const {
+    char line[1024];
+    size_t len = Log::stats().format(line, sizeof(line) - 1);
+    line[len++] = '\n';
+    const char* p = line;
+    while (len > 0) {
+        ssize_t rc = write(this->m_fd, p, len);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        p += rc;
+        len -= rc;
+    }
+}
+
+void LogStatsDumper::run() {
+    std::unique_lock<std::mutex> lock(this->m_mutex);
+    while (!this->m_cv.wait_for(lock, this->m_interval, [this] { return this->m_stop; })) {
+        this->dump();
+    }
+}
+
+#endif  // LOG_STATS_ENABLED
@@ -0,0 +1,255 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   MmapFileLog.cpp
+ *
+ *   @brief  Logger which appends to a memory mapped file.
+ *
+ ****************************************************************************/
+
+#include "duino_log/MmapFileLog.h"
+
+#if defined(__linux__)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <thread>
+
+//! Finds the end of the data in an existing log file.
+//! @details The file may be followed by null characters if the process
+//!          which was logging to it crashed.
+//! @returns the offset just after the last non-null character in the file.
+static uint64_t find_data_end(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return 0;
+    }
+
+    char buf[4096];
+    uint64_t end = st.st_size;
+    while (end > 0) {
+        size_t chunk = end < sizeof(buf) ? end : sizeof(buf);
+        uint64_t start = end - chunk;
+        if (pread(fd, buf, chunk, start) != static_cast<ssize_t>(chunk)) {
+            return end;
+        }
+        for (size_t i = chunk; i > 0; i--) {
+            if (buf[i - 1] != '\0') {
+                return start + i;
+            }
+        }
+        end = start;
+    }
+    return 0;
+}
+
+MmapFileLog::MmapFileLog(const char* path, size_t window_size, SyncPolicy sync_policy)
+    : m_page_size{static_cast<size_t>(sysconf(_SC_PAGESIZE))}, m_sync_policy{sync_policy} {
+    // Round the window up to a whole number of pages.
+    this->m_window_size = (window_size + this->m_page_size - 1) & ~(this->m_page_size - 1);
+    if (this->m_window_size == 0) {
+        this->m_window_size = this->m_page_size;
+    }
+
+    this->m_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (this->m_fd < 0) {
+        return;
+    }
+    uint64_t end = find_data_end(this->m_fd);
+    this->m_cursor.store(end);
+    if (this->map_window(&this->m_windows[0], end)) {
+        this->m_window.store(&this->m_windows[0]);
+    }
+}
+
+MmapFileLog::~MmapFileLog() {
+    this->detach();
+    this->flush_repeats();
+    int fd = this->m_fd;
+    if (fd < 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->m_remap_mutex);
+        this->m_window.store(nullptr);
+        for (auto& window : this->m_windows) {
+            if (window.base != nullptr && this->m_sync_policy != SyncPolicy::NONE) {
+                msync(window.base, this->m_window_size, MS_SYNC);
+            }
+            this->unmap_window(&window);
+        }
+    }
+    // Remove the unused part of the preallocated window. If this fails, the
+    // file is still readable, it just keeps the null filled tail.
+    int rc = ftruncate(fd, this->m_cursor.load());
+    (void)rc;
+    close(fd);
+}
+
+void MmapFileLog::write_line(Level level, const char* line, size_t len) {
+    Window* window = this->acquire_window();
+    if (window == nullptr) {
+        return;
+    }
+
+    uint64_t offset = this->m_cursor.fetch_add(len, std::memory_order_relaxed);
+    if (offset + len <= window->end) {
+        char* dst = window->base + (offset - window->start);
+        memcpy(dst, line, len);
+        this->sync_line(level, dst, len);
+        window->users.fetch_sub(1);
+        return;
+    }
+    window->users.fetch_sub(1);
+    this->write_slow(level, offset, line, len);
+}
+
+void MmapFileLog::sync() {
+    std::lock_guard<std::mutex> lock(this->m_remap_mutex);
+    for (auto& window : this->m_windows) {
+        if (window.base != nullptr) {
+            msync(window.base, this->m_window_size, MS_SYNC);
+        }
+    }
+    if (this->m_fd >= 0) {
+        fdatasync(this->m_fd);
+    }
+}
+
+void MmapFileLog::prepare_fork() {
+    LineLog::prepare_fork();
+    this->m_remap_mutex.lock();
+}
+
+void MmapFileLog::parent_after_fork() {
+    this->m_remap_mutex.unlock();
+    LineLog::parent_after_fork();
+}
+
+void MmapFileLog::child_after_fork() {
+    this->m_window.store(nullptr);
+    for (auto& window : this->m_windows) {
+        // Any users were other threads, which don't exist in the child.
+        window.users.store(0);
+        if (window.base != nullptr) {
+            munmap(window.base, this->m_window_size);
+            window.base = nullptr;
+        }
+    }
+    if (this->m_fd >= 0) {
+        close(this->m_fd);
+        this->m_fd = -1;
+    }
+    this->m_remap_mutex.unlock();
+    LineLog::child_after_fork();
+}
+
+MmapFileLog::Window* MmapFileLog::acquire_window() {
+    // The remapping code only unmaps a window once it's no longer the current
+    // window and has no users, so we need to re-check that the window is still
+    // current after registering as a user.
+    for (;;) {
+        Window* window = this->m_window.load();
+        if (window == nullptr) {
+            return nullptr;
+        }
+        window->users.fetch_add(1);
+        if (this->m_window.load() == window) {
+            return window;
+        }
+        window->users.fetch_sub(1);
+    }
+}
+
+bool MmapFileLog::map_window(Window* window, uint64_t offset) {
+    uint64_t start = offset & ~static_cast<uint64_t>(this->m_page_size - 1);
+
+    // Preallocating means that the pages being written to are always backed
+    // by the file, so we won't get a SIGBUS if the disk fills up.
+    if (posix_fallocate(this->m_fd, start, this->m_window_size) != 0) {
+        return false;
+    }
+    void* base = mmap(
+        nullptr, this->m_window_size, PROT_READ | PROT_WRITE, MAP_SHARED, this->m_fd, start);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    window->base = static_cast<char*>(base);
+    window->start = start;
+    window->end = start + this->m_window_size;
+    return true;
+}
+
+void MmapFileLog::unmap_window(Window* window) {
+    while (window->users.load() != 0) {
+        std::this_thread::yield();
+    }
+    if (window->base != nullptr) {
+        if (this->m_sync_policy != SyncPolicy::NONE) {
+            msync(window->base, this->m_window_size, MS_ASYNC);
+        }
+        munmap(window->base, this->m_window_size);
+        window->base = nullptr;
+    }
+}
+
+void MmapFileLog::write_slow(Level level, uint64_t offset, const char* line, size_t len) {
+    std::lock_guard<std::mutex> lock(this->m_remap_mutex);
+
+    Window* window = this->m_window.load();
+    if (window == nullptr) {
+        return;
+    }
+
+    if (offset >= window->start && offset + len > window->end) {
+        // Move the window forward so that it starts with this line. The
+        // previous window stays mapped for any writers which are still using
+        // it, and the one before that is unmapped and reused.
+        Window* next = (window == &this->m_windows[0]) ? &this->m_windows[1] : &this->m_windows[0];
+        this->unmap_window(next);
+        if (this->map_window(next, offset)) {
+            this->m_window.store(next);
+            window = next;
+        }
+    }
+
+    if (offset >= window->start && offset + len <= window->end) {
+        char* dst = window->base + (offset - window->start);
+        memcpy(dst, line, len);
+        this->sync_line(level, dst, len);
+        return;
+    }
+
+    // The line is before the current window (because another writer moved
+    // the window forward), or the window couldn't be mapped.
+    if (pwrite(this->m_fd, line, len, offset) == static_cast<ssize_t>(len)) {
+        if (this->m_sync_policy == SyncPolicy::LINE ||
+            (this->m_sync_policy == SyncPolicy::ERROR &&
+             (level == Level::FATAL || level == Level::ERROR))) {
+            fdatasync(this->m_fd);
+        }
+    }
+}
+
+void MmapFileLog::sync_line(Level level, char* dst, size_t len) {
+    if (this->m_sync_policy == SyncPolicy::LINE ||
+        (this->m_sync_policy == SyncPolicy::ERROR &&
+         (level == Level::FATAL || level == Level::ERROR))) {
+        // msync needs a page aligned address.
+        uintptr_t page = reinterpret_cast<uintptr_t>(dst) & ~(this->m_page_size - 1);
+        msync(reinterpret_cast<void*>(page), reinterpret_cast<uintptr_t>(dst) + len - page, MS_SYNC);
+    }
+}
+
+#endif  // defined(__linux__)
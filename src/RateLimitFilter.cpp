@@ -0,0 +1,87 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   RateLimitFilter.cpp
+ *
+ *   @brief  Filter which limits the rate of messages from each call site.
+ *
+ ****************************************************************************/
+
+#include "duino_log/RateLimitFilter.h"
+
+#include <chrono>
+
+//! Maximum number of slots to probe before giving up.
+static constexpr size_t MAX_PROBES = 16;
+
+void RateLimitFilter::set_limit(Log::Level level, uint32_t per_sec, uint32_t burst) {
+    Limit& limit = this->m_limits[static_cast<size_t>(level)];
+    if (per_sec == 0) {
+        limit.interval.store(0, std::memory_order_relaxed);
+        return;
+    }
+    if (burst == 0) {
+        burst = 1;
+    }
+    int64_t interval = 1000000000 / per_sec;
+    limit.tolerance.store(interval * (burst - 1), std::memory_order_relaxed);
+    limit.interval.store(interval, std::memory_order_relaxed);
+}
+
+RateLimitFilter::Slot* RateLimitFilter::find_slot(const char* fmt) {
+    // Fibonacci hashing of the pointer (the low bits are mostly alignment).
+    uint64_t hash = (reinterpret_cast<uintptr_t>(fmt) >> 3) * 0x9e3779b97f4a7c15ULL;
+    size_t idx = hash >> (64 - 10);
+    static_assert(NUM_SLOTS == 1 << 10, "NUM_SLOTS doesn't match the hash");
+
+    for (size_t probe = 0; probe < MAX_PROBES; probe++) {
+        Slot* slot = &this->m_slots[(idx + probe) & (NUM_SLOTS - 1)];
+        const char* owner = slot->fmt.load(std::memory_order_acquire);
+        if (owner == nullptr) {
+            if (slot->fmt.compare_exchange_strong(owner, fmt, std::memory_order_acq_rel)) {
+                return slot;
+            }
+            // Another thread claimed the slot. `owner` now contains its format string.
+        }
+        if (owner == fmt) {
+            return slot;
+        }
+    }
+    return nullptr;
+}
+
+bool RateLimitFilter::allow(Log::Level level, const char* fmt) {
+    const Limit& limit = this->m_limits[static_cast<size_t>(level)];
+    int64_t interval = limit.interval.load(std::memory_order_relaxed);
+    if (interval == 0) {
+        return true;
+    }
+    int64_t tolerance = limit.tolerance.load(std::memory_order_relaxed);
+
+    Slot* slot = this->find_slot(fmt);
+    if (slot == nullptr) {
+        return true;
+    }
+
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+    int64_t tat = slot->tat.load(std::memory_order_relaxed);
+    for (;;) {
+        int64_t start = tat > now ? tat : now;
+        if (start - now > tolerance) {
+            this->m_num_suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (slot->tat.compare_exchange_weak(tat, start + interval, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+}
@@ -0,0 +1,174 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   RingBufferLog.cpp
+ *
+ *   @brief  Logger which keeps the most recent lines in memory.
+ *
+ ****************************************************************************/
+
+#include "duino_log/RingBufferLog.h"
+
+#include <cstring>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+//! Signals which cause the buffer to be dumped.
+static constexpr int CRASH_SIGNALS[] = {SIGSEGV, SIGABRT, SIGBUS, SIGILL, SIGFPE};
+
+//! Handlers which were installed before ours, indexed like CRASH_SIGNALS.
+static struct sigaction old_actions[std::size(CRASH_SIGNALS)];
+
+//! Logger which installed the crash handlers.
+static std::atomic<RingBufferLog*> crash_log{nullptr};
+
+//! Writes all of `data`, retrying after partial writes and interruptions.
+//! @details This is async-signal-safe.
+static void write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        len -= written;
+    }
+}
+
+//! DumpFunc which writes to the file descriptor pointed to by `param`.
+static void write_to_fd(void* param, const char* data, size_t len) {
+    write_all(*static_cast<const int*>(param), data, len);
+}
+#endif
+
+RingBufferLog::RingBufferLog(size_t size, int dump_fd) : m_dump_fd{dump_fd} {
+    size_t bufSize = MAX_LINE_LEN;
+    while (bufSize < size) {
+        bufSize *= 2;
+    }
+    this->m_mask = bufSize - 1;
+    this->m_buf = new char[bufSize];
+
+    // Touch every page now, so that logging doesn't take page faults.
+    memset(this->m_buf, 0, bufSize);
+}
+
+RingBufferLog::~RingBufferLog() {
+    this->detach();
+    this->flush_repeats();
+#if defined(__unix__) || defined(__APPLE__)
+    this->remove_crash_handlers();
+#endif
+    delete[] this->m_buf;
+}
+
+void RingBufferLog::write_line(Level level, const char* line, size_t len) {
+    uint64_t head = this->m_head.fetch_add(len, std::memory_order_relaxed);
+    size_t offset = head & this->m_mask;
+    size_t first = this->size() - offset;
+    if (len <= first) {
+        memcpy(&this->m_buf[offset], line, len);
+    } else {
+        memcpy(&this->m_buf[offset], line, first);
+        memcpy(this->m_buf, line + first, len - first);
+    }
+
+    if (level == Level::FATAL) {
+#if defined(__unix__) || defined(__APPLE__)
+        this->dump();
+#endif
+    }
+}
+
+void RingBufferLog::dump(DumpFunc func, void* param) const {
+    uint64_t head = this->m_head.load(std::memory_order_acquire);
+    uint64_t start = 0;
+    if (head > this->size()) {
+        // The oldest line has been partially overwritten, so start with the
+        // line after it.
+        start = head - this->size();
+        while (start < head && this->m_buf[start & this->m_mask] != '\n') {
+            start++;
+        }
+        start++;
+    }
+    if (start >= head) {
+        return;
+    }
+
+    size_t offset = start & this->m_mask;
+    size_t len = head - start;
+    size_t first = this->size() - offset;
+    if (len <= first) {
+        func(param, &this->m_buf[offset], len);
+    } else {
+        func(param, &this->m_buf[offset], first);
+        func(param, this->m_buf, len - first);
+    }
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+void RingBufferLog::dump(int fd) const {
+    this->dump(write_to_fd, &fd);
+}
+
+bool RingBufferLog::install_crash_handlers() {
+    RingBufferLog* expected = nullptr;
+    if (!crash_log.compare_exchange_strong(expected, this)) {
+        return expected == this;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = crash_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_NODEFER;
+    for (size_t i = 0; i < std::size(CRASH_SIGNALS); i++) {
+        sigaction(CRASH_SIGNALS[i], &action, &old_actions[i]);
+    }
+    return true;
+}
+
+void RingBufferLog::remove_crash_handlers() {
+    if (crash_log.load() != this) {
+        return;
+    }
+    for (size_t i = 0; i < std::size(CRASH_SIGNALS); i++) {
+        sigaction(CRASH_SIGNALS[i], &old_actions[i], nullptr);
+    }
+    crash_log.store(nullptr);
+}
+
+void RingBufferLog::crash_handler(int sig) {
+    // Only dump once, even if dumping crashes or another thread crashes too.
+    RingBufferLog* log = crash_log.exchange(nullptr);
+    if (log != nullptr) {
+        log->dump();
+    }
+
+    // Let the previous handler (usually the default, which terminates the
+    // process) deal with the signal.
+    for (size_t i = 0; i < std::size(CRASH_SIGNALS); i++) {
+        if (CRASH_SIGNALS[i] == sig) {
+            sigaction(sig, &old_actions[i], nullptr);
+        }
+    }
+    raise(sig);
+}
+
+#endif  // defined(__unix__) || defined(__APPLE__)
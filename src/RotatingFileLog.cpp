@@ -0,0 +1,288 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   RotatingFileLog.cpp
+ *
+ *   @brief  Logger which writes to a file which is rotated by size or age.
+ *
+ ****************************************************************************/
+
+#include "duino_log/RotatingFileLog.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+
+#if defined(DUINO_LOG_ZLIB)
+#include <zlib.h>
+#endif
+
+//! Flags used to open log files.
+static constexpr int LOG_OPEN_FLAGS = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+
+//! Permissions used when creating log files.
+static constexpr mode_t LOG_MODE = 0644;
+
+//! Maximum time the background thread sleeps before checking for work.
+//! @details The logging thread doesn't take the background thread's mutex
+//!          when it hands over a file, so a wakeup can occasionally be missed.
+static constexpr std::chrono::milliseconds BG_POLL_INTERVAL{100};
+
+#if defined(DUINO_LOG_ZLIB)
+
+//! Compresses a file using gzip.
+//! @returns true if the file was compressed successfully.
+static bool gzip_compress(const char* src, const char* dst) {
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return false;
+    }
+    // "e" opens the file with O_CLOEXEC.
+    gzFile out = gzopen(dst, "wbe");
+    if (out == nullptr) {
+        close(in);
+        return false;
+    }
+
+    bool ok = true;
+    char buf[16384];
+    ssize_t n;
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        if (gzwrite(out, buf, static_cast<unsigned>(n)) != n) {
+            ok = false;
+            break;
+        }
+    }
+    if (n < 0) {
+        ok = false;
+    }
+    close(in);
+    if (gzclose(out) != Z_OK) {
+        ok = false;
+    }
+    return ok;
+}
+
+const RotatingFileCodec RotatingFileLog::gzip_codec = {".gz", gzip_compress};
+
+#endif  // DUINO_LOG_ZLIB
+
+RotatingFileLog::RotatingFileLog(
+    const char* path,
+    size_t max_bytes,
+    unsigned num_generations,
+    time_t max_age_secs,
+    const RotatingFileCodec* codec)
+    : m_path{path},
+      m_next_path{m_path + ".next"},
+      m_max_bytes{max_bytes},
+      m_num_generations{num_generations},
+      m_max_age_secs{max_age_secs},
+      m_codec{codec} {
+    this->recover_next();
+    this->m_fd = open(path, LOG_OPEN_FLAGS, LOG_MODE);
+    if (this->m_fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(this->m_fd, &st) == 0) {
+        this->m_size = st.st_size;
+    }
+    this->m_open_time = time(nullptr);
+    this->m_thread = std::thread(&RotatingFileLog::background, this);
+}
+
+RotatingFileLog::~RotatingFileLog() {
+    this->detach();
+    this->flush_repeats();
+    if (this->m_thread.joinable()) {
+        this->m_stop.store(true, std::memory_order_release);
+        this->m_bg_cv.notify_one();
+        this->m_thread.join();
+    }
+    int next_fd = this->m_next_fd.exchange(-1);
+    if (next_fd >= 0) {
+        close(next_fd);
+        unlink(this->m_next_path.c_str());
+    }
+    if (this->m_fd >= 0) {
+        close(this->m_fd);
+    }
+}
+
+void RotatingFileLog::write_line(Level level, const char* line, size_t len) {
+    (void)level;
+    std::lock_guard<std::mutex> lock(this->m_write_mutex);
+
+    if (this->m_fd < 0) {
+        return;
+    }
+
+    bool rotate = (this->m_max_bytes > 0 && this->m_size > 0 &&
+                   this->m_size + len > this->m_max_bytes) ||
+                  (this->m_max_age_secs > 0 &&
+                   time(nullptr) - this->m_open_time >= this->m_max_age_secs);
+    if (rotate) {
+        // If the background thread hasn't opened the next file yet, then we
+        // just keep writing to the current one.
+        int next_fd = this->m_next_fd.exchange(-1, std::memory_order_acq_rel);
+        if (next_fd >= 0) {
+            this->m_retired_fd.store(this->m_fd, std::memory_order_release);
+            this->m_fd = next_fd;
+            this->m_size = 0;
+            this->m_open_time = time(nullptr);
+            this->m_bg_cv.notify_one();
+        }
+    }
+
+    ssize_t written = write(this->m_fd, line, len);
+    if (written > 0) {
+        this->m_size += written;
+    }
+}
+
+void RotatingFileLog::sync() {
+    std::lock_guard<std::mutex> lock(this->m_write_mutex);
+    if (this->m_fd >= 0) {
+#if defined(__APPLE__)
+        fsync(this->m_fd);
+#else
+        fdatasync(this->m_fd);
+#endif
+    }
+}
+
+void RotatingFileLog::prepare_fork() {
+    LineLog::prepare_fork();
+    this->m_write_mutex.lock();
+}
+
+void RotatingFileLog::parent_after_fork() {
+    this->m_write_mutex.unlock();
+    LineLog::parent_after_fork();
+}
+
+void RotatingFileLog::child_after_fork() {
+    this->m_max_bytes = 0;
+    this->m_max_age_secs = 0;
+    // These belong to the parent's background thread, which isn't in the child.
+    int next_fd = this->m_next_fd.exchange(-1);
+    if (next_fd >= 0) {
+        close(next_fd);
+    }
+    int retired_fd = this->m_retired_fd.exchange(-1);
+    if (retired_fd >= 0) {
+        close(retired_fd);
+    }
+    reconstruct_in_child(&this->m_bg_mutex);
+    reconstruct_in_child(&this->m_bg_cv);
+    reconstruct_in_child(&this->m_thread);
+    this->m_write_mutex.unlock();
+    LineLog::child_after_fork();
+}
+
+void RotatingFileLog::background() {
+    // Tracked here rather than by checking m_next_fd, since write_line()
+    // takes the next file before it hands over the retired one. Seeing
+    // m_next_fd empty in between would reopen the file just switched to.
+    bool need_next = true;
+    for (;;) {
+        int retired_fd = this->m_retired_fd.exchange(-1, std::memory_order_acq_rel);
+        if (retired_fd >= 0) {
+            close(retired_fd);
+            this->rotate_files();
+            this->m_num_rotations.fetch_add(1, std::memory_order_release);
+            need_next = true;
+        }
+
+        // The next file is only opened once the previous one has been renamed
+        // to m_path, since they both use m_next_path.
+        if (need_next) {
+            // This isn't truncated, since if the process crashed after
+            // rotating to it, it holds the latest lines (see recover_next()).
+            int next_fd = open(this->m_next_path.c_str(), LOG_OPEN_FLAGS, LOG_MODE);
+            this->m_next_fd.store(next_fd, std::memory_order_release);
+            need_next = next_fd < 0;
+        }
+
+        if (this->m_stop.load(std::memory_order_acquire)) {
+            break;
+        }
+        std::unique_lock<std::mutex> lock(this->m_bg_mutex);
+        this->m_bg_cv.wait_for(lock, BG_POLL_INTERVAL, [this] {
+            return this->m_stop.load(std::memory_order_acquire) ||
+                   this->m_retired_fd.load(std::memory_order_acquire) >= 0;
+        });
+    }
+}
+
+void RotatingFileLog::recover_next() {
+    struct stat st;
+    if (stat(this->m_next_path.c_str(), &st) != 0) {
+        return;
+    }
+    if (st.st_size == 0) {
+        // It was pre-opened, but never rotated to.
+        unlink(this->m_next_path.c_str());
+    } else if (access(this->m_path.c_str(), F_OK) != 0) {
+        // The process crashed after m_path was renamed to the first generation.
+        rename(this->m_next_path.c_str(), this->m_path.c_str());
+    } else {
+        // The process crashed after rotating to it, but before the rename.
+        this->rotate_files();
+    }
+}
+
+std::string RotatingFileLog::generation_name(unsigned gen, bool compressed) const {
+    std::string name = this->m_path + "." + std::to_string(gen);
+    if (compressed && this->m_codec != nullptr) {
+        name += this->m_codec->ext;
+    }
+    return name;
+}
+
+void RotatingFileLog::rotate_files() {
+    // Shift the existing generations, dropping the oldest. A file which failed
+    // to compress keeps its uncompressed name, so both names are shifted.
+    if (this->m_num_generations > 0) {
+        for (bool compressed : {false, true}) {
+            if (compressed && this->m_codec == nullptr) {
+                break;
+            }
+            unlink(this->generation_name(this->m_num_generations, compressed).c_str());
+            for (unsigned gen = this->m_num_generations - 1; gen > 0; gen--) {
+                rename(
+                    this->generation_name(gen, compressed).c_str(),
+                    this->generation_name(gen + 1, compressed).c_str());
+            }
+        }
+        rename(this->m_path.c_str(), this->generation_name(1, false).c_str());
+    } else {
+        unlink(this->m_path.c_str());
+    }
+    rename(this->m_next_path.c_str(), this->m_path.c_str());
+
+    if (this->m_num_generations > 0 && this->m_codec != nullptr) {
+        std::string rotated = this->generation_name(1, false);
+        std::string compressed = this->generation_name(1, true);
+        if (this->m_codec->compress(rotated.c_str(), compressed.c_str())) {
+            unlink(rotated.c_str());
+        } else {
+            unlink(compressed.c_str());
+        }
+    }
+}
+
+#endif  // defined(__unix__) || defined(__APPLE__)
@@ -0,0 +1,97 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   SamplingFilter.cpp
+ *
+ *   @brief  Filter which logs a random sample of messages.
+ *
+ ****************************************************************************/
+
+#include "duino_log/SamplingFilter.h"
+
+#include <chrono>
+
+#if LOG_THREADS_ENABLED
+//! State of the calling thread's random number generator.
+static thread_local uint64_t rng_state = 0;
+
+//! Stripe of counters used by the calling thread.
+static thread_local uint32_t thread_stripe = 0;
+#else
+//! State of the random number generator (there's only one thread).
+static uint64_t rng_state = 0;
+
+//! Stripe of counters used (there's only one thread).
+static uint32_t thread_stripe = 0;
+#endif
+
+//! Used to assign stripes to threads.
+static std::atomic<uint32_t> next_stripe{0};
+
+//! Returns the next random number for the calling thread.
+//! @returns a random number.
+static inline uint64_t next_random() {
+    uint64_t x = rng_state;
+    if (x == 0) {
+        // Seed each thread differently, using splitmix64 to spread the bits.
+        x = reinterpret_cast<uintptr_t>(&rng_state) ^
+            static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        x = (x ^ (x >> 31)) | 1;
+        thread_stripe = next_stripe.fetch_add(1, std::memory_order_relaxed);
+    }
+    // xorshift64
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    rng_state = x;
+    return x;
+}
+
+void SamplingFilter::set_one_in(Log::Level level, uint32_t n) {
+    uint64_t threshold = n <= 1 ? ALL : ALL / n;
+    this->m_threshold[static_cast<size_t>(level)].store(threshold, std::memory_order_relaxed);
+}
+
+void SamplingFilter::set_percent(Log::Level level, double percent) {
+    uint64_t threshold;
+    if (percent >= 100.0) {
+        threshold = ALL;
+    } else if (percent <= 0.0) {
+        threshold = 0;
+    } else {
+        threshold = static_cast<uint64_t>(percent / 100.0 * static_cast<double>(ALL));
+    }
+    this->m_threshold[static_cast<size_t>(level)].store(threshold, std::memory_order_relaxed);
+}
+
+double SamplingFilter::sample_rate(Log::Level level) const {
+    uint64_t threshold = this->m_threshold[static_cast<size_t>(level)].load(std::memory_order_relaxed);
+    return static_cast<double>(threshold) / static_cast<double>(ALL);
+}
+
+bool SamplingFilter::allow(Log::Level level, const char* fmt) {
+    size_t idx = static_cast<size_t>(level);
+    uint64_t threshold = this->m_threshold[idx].load(std::memory_order_relaxed);
+    if (threshold < ALL && (next_random() >> 32) >= threshold) {
+        this->m_stripes[thread_stripe % NUM_STRIPES].sampled_out[idx].fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return this->m_next == nullptr || this->m_next->allow(level, fmt);
+}
+
+uint64_t SamplingFilter::num_sampled_out(Log::Level level) const {
+    uint64_t total = 0;
+    for (const auto& stripe : this->m_stripes) {
+        total += stripe.sampled_out[static_cast<size_t>(level)].load(std::memory_order_relaxed);
+    }
+    return total;
+}
@@ -167,6 +167,13 @@ size_t StrXPrintf(StrXPrintfFunc outFunc, void* outParm, const char* fmt, ...) {
 size_t vStrPrintf(char* outStr, size_t maxLen, const char* fmt, va_list args) {
     str::StrPrintfParms strParm;
 
+    if (maxLen == 0) {
+        return 0;
+    }
+    // StrPrintfFunc terminates the string after each character, so this
+    // covers the case where nothing is output.
+    outStr[0] = '\0';
+
     strParm.str = outStr;
     strParm.maxLen = maxLen - 1; /* Leave space for temrinating null char   */
 
@@ -353,18 +360,9 @@ size_t vStrXPrintf(StrXPrintfFunc outFunc, void* outParm, const char* fmt, va_li
                         x = -(long long)x;  // NOLINT
                     }
 
-                    do {
-                        int c;
-                        c = x % base + '0';
-                        if (c > '9') {
-                            if (IsOptionSet(&p, str::FmtOption::CAPITAL_HEX)) {
-                                c += 'A' - '9' - 1;
-                            } else {
-                                c += 'a' - '9' - 1;
-                            }
-                        }
-                        buffer[sizeof(buffer) - 1 - p.editedStringLen++] = (char)c;
-                    } while ((x /= base) != 0);
+                    p.editedStringLen = (int16_t)StrUnsignedToDigits(
+                        buffer + sizeof(buffer), x, (uint8_t)base,
+                        IsOptionSet(&p, str::FmtOption::CAPITAL_HEX));
 
                     if ((precision >= 0) && (precision > p.editedStringLen)) {
                         p.leadingZeros = precision - p.editedStringLen;
@@ -383,6 +381,28 @@ size_t vStrXPrintf(StrXPrintfFunc outFunc, void* outParm, const char* fmt, va_li
     return p.numOutputChars;
 }
 
+size_t StrUnsignedToDigits(char* bufEnd, unsigned long long x, uint8_t base, bool capitalHex) {
+    const char* digits = capitalHex ? "0123456789ABCDEF" : "0123456789abcdef";
+    char* s = bufEnd;
+
+    // Dividing by a constant is much cheaper than dividing by a variable, so
+    // the common bases get their own loops.
+    if (base == 10) {
+        do {
+            *--s = (char)('0' + x % 10);
+        } while ((x /= 10) != 0);
+    } else if (base == 16) {
+        do {
+            *--s = digits[x & 0x0f];
+        } while ((x >>= 4) != 0);
+    } else {
+        do {
+            *--s = digits[x % base];
+        } while ((x /= base) != 0);
+    }
+    return bufEnd - s;
+}
+
 //!@}
 
 /**
@@ -0,0 +1,231 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   SyslogSocketLog.cpp
+ *
+ *   @brief  Logger which sends syslog records to a local datagram socket.
+ *
+ ****************************************************************************/
+
+#include "duino_log/SyslogSocketLog.h"
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <ctime>
+
+#include "duino_log/LogContext.h"
+#include "duino_log/LogStats.h"
+#include "duino_log/Str.h"
+
+SyslogSocketLog::SyslogSocketLog(
+    const char* app_name,
+    Format format,
+    const char* path,
+    int facility)
+    : m_format{format}, m_facility{facility}, m_app_name{app_name}, m_pid{static_cast<unsigned>(getpid())} {
+    char hostname[256];
+    if (gethostname(hostname, sizeof(hostname)) == 0) {
+        hostname[sizeof(hostname) - 1] = '\0';
+        this->m_hostname = hostname;
+    } else {
+        this->m_hostname = "-";
+    }
+
+    memset(&this->m_addr, 0, sizeof(this->m_addr));
+    this->m_addr.sun_family = AF_UNIX;
+    StrMaxCpy(this->m_addr.sun_path, path, sizeof(this->m_addr.sun_path));
+
+    this->m_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (this->m_fd < 0) {
+        return;
+    }
+    // If the collector isn't running yet, we try again when sending.
+    connect(this->m_fd, reinterpret_cast<struct sockaddr*>(&this->m_addr), sizeof(this->m_addr));
+    this->m_thread = std::thread(&SyslogSocketLog::background, this);
+}
+
+SyslogSocketLog::~SyslogSocketLog() {
+    this->detach();
+    if (this->m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            this->m_stop = true;
+        }
+        this->m_cv.notify_one();
+        this->m_thread.join();
+    }
+    if (this->m_fd >= 0) {
+        close(this->m_fd);
+    }
+}
+
+int SyslogSocketLog::severity(Level level) {
+    switch (level) {
+        case Level::FATAL:
+            return LOG_CRIT;
+        case Level::ERROR:
+            return LOG_ERR;
+        case Level::WARNING:
+            return LOG_WARNING;
+        case Level::INFO:
+            return LOG_INFO;
+        case Level::DEBUG:
+            return LOG_DEBUG;
+        case Level::NONE:
+            break;
+    }
+    return LOG_NOTICE;
+}
+
+size_t SyslogSocketLog::format_record(
+    char* record,
+    size_t maxLen,
+    Level level,
+    const char* fmt,
+    va_list args) const {
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    struct tm tm;
+    char timeStr[32];
+    int pri = this->m_facility | severity(level);
+
+    size_t len;
+    if (this->m_format == Format::RFC5424) {
+        strftime(timeStr, sizeof(timeStr), "%Y-%m-%dT%H:%M:%S", gmtime_r(&now.tv_sec, &tm));
+        len = StrPrintf(
+            record, maxLen, "<%d>1 %s.%06uZ %s %s %u - - ", pri, timeStr,
+            static_cast<unsigned>(now.tv_usec), this->m_hostname.c_str(), this->m_app_name.c_str(),
+            this->m_pid);
+    } else {
+        strftime(timeStr, sizeof(timeStr), "%b %e %H:%M:%S", localtime_r(&now.tv_sec, &tm));
+        len = StrPrintf(
+            record, maxLen, "<%d>%s %s[%u]: ", pri, timeStr, this->m_app_name.c_str(),
+            this->m_pid);
+    }
+    if (len + 1 < maxLen) {
+        len += LogContext::copy_prefix(&record[len], maxLen - len - 1);
+        len += vStrPrintf(&record[len], maxLen - len, fmt, args);
+    }
+    return len;
+}
+
+void SyslogSocketLog::do_log(Level level, const char* fmt, va_list args) {
+    if (this->m_fd < 0) {
+        return;
+    }
+
+    // Format outside of the lock, so that other threads only wait for the copy.
+    Record record;
+    record.len = this->format_record(record.data, sizeof(record.data), level, fmt, args);
+
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    Record* slot = &this->m_batch[this->m_count++];
+    slot->len = record.len;
+    slot->level = level;
+    memcpy(slot->data, record.data, record.len);
+    if (this->m_count == BATCH_SIZE || level == Level::FATAL || level == Level::ERROR) {
+        this->send_batch();
+    } else if (this->m_count == 1) {
+        this->m_cv.notify_one();
+    }
+}
+
+void SyslogSocketLog::flush() {
+    std::lock_guard<std::mutex> lock(this->m_mutex);
+    this->send_batch();
+}
+
+void SyslogSocketLog::prepare_fork() {
+    this->m_mutex.lock();
+    this->send_batch();
+}
+
+void SyslogSocketLog::parent_after_fork() {
+    this->m_mutex.unlock();
+}
+
+void SyslogSocketLog::child_after_fork() {
+    this->m_pid = static_cast<unsigned>(getpid());
+    reconstruct_in_child(&this->m_cv);
+    reconstruct_in_child(&this->m_thread);
+    this->m_mutex.unlock();
+    if (this->m_fd >= 0) {
+        this->m_thread = std::thread(&SyslogSocketLog::background, this);
+    }
+}
+
+void SyslogSocketLog::send_batch() {
+    if (this->m_count == 0) {
+        return;
+    }
+
+    struct iovec iov[BATCH_SIZE];
+    struct mmsghdr msgs[BATCH_SIZE];
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < this->m_count; i++) {
+        iov[i].iov_base = this->m_batch[i].data;
+        iov[i].iov_len = this->m_batch[i].len;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    size_t sent = 0;
+    bool reconnected = false;
+    while (sent < this->m_count) {
+        int n = sendmmsg(this->m_fd, &msgs[sent], this->m_count - sent, MSG_DONTWAIT);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && !reconnected &&
+            (errno == ENOTCONN || errno == ECONNREFUSED || errno == ENOENT)) {
+            // The collector was restarted (or wasn't running when we started).
+            reconnected = true;
+            if (connect(
+                    this->m_fd, reinterpret_cast<struct sockaddr*>(&this->m_addr),
+                    sizeof(this->m_addr)) == 0) {
+                continue;
+            }
+        }
+        // EAGAIN means that the collector's queue is full.
+        break;
+    }
+    this->m_num_sent.fetch_add(sent, std::memory_order_relaxed);
+    this->m_num_dropped.fetch_add(this->m_count - sent, std::memory_order_relaxed);
+    for (size_t i = sent; i < this->m_count; i++) {
+        LogStats::record_dropped(this->m_batch[i].level);
+    }
+    this->m_count = 0;
+}
+
+void SyslogSocketLog::background() {
+    std::unique_lock<std::mutex> lock(this->m_mutex);
+    for (;;) {
+        this->m_cv.wait(lock, [this] { return this->m_stop || this->m_count > 0; });
+        if (!this->m_stop) {
+            // Give the batch a chance to fill up.
+            this->m_cv.wait_for(lock, FLUSH_INTERVAL, [this] { return this->m_stop; });
+        }
+        this->send_batch();
+        if (this->m_stop) {
+            break;
+        }
+    }
+}
+
+#endif  // defined(__linux__)
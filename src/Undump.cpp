@@ -0,0 +1,239 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   Undump.cpp
+ *
+ *   @brief  Routines for converting DumpMem output back into binary data.
+ *
+ ****************************************************************************/
+
+// ---- Include Files -------------------------------------------------------
+
+#include "duino_log/Undump.h"
+
+#include <cctype>
+#include <cstring>
+#include <string>
+
+#include "duino_log/ConsoleColor.h"
+#include "duino_log/DumpMem.h"
+
+// ---- Public Variables ----------------------------------------------------
+// ---- Private Constants and Types -----------------------------------------
+
+//! Number of characters in the hex portion of a line ("xx " per byte).
+static constexpr size_t HEX_WIDTH = DUMP_LINE_WIDTH * 3;
+
+//! Value stored in the hex table for characters which aren't hex digits.
+static constexpr uint8_t NOT_HEX = 0x80;
+
+//! Number of bytes UndumpStream accumulates before writing to the output stream.
+static constexpr size_t UNDUMP_BLOCK_SIZE = 4096;
+
+//! String logged by DumpLine when there is no data.
+static constexpr char NO_DATA_STR[] = "No Data";
+
+//! Lookup table which maps an ASCII character to its hex digit value.
+struct HexTable {
+    uint8_t value[256];  //!< Value of each character, or NOT_HEX.
+
+    //! Constructor which fills in the table at compile time.
+    constexpr HexTable() : value{} {
+        for (size_t i = 0; i < sizeof(value); i++) {
+            value[i] = NOT_HEX;
+        }
+        for (uint8_t i = 0; i < 10; i++) {
+            value['0' + i] = i;
+        }
+        for (uint8_t i = 0; i < 6; i++) {
+            value['a' + i] = 10 + i;
+            value['A' + i] = 10 + i;
+        }
+    }
+};
+
+// ---- Private Variables ---------------------------------------------------
+
+//! Table used to decode hex digits.
+static constexpr HexTable hexTable;
+
+// ---- Private Function Prototypes -----------------------------------------
+// ---- Functions -----------------------------------------------------------
+
+//! Decodes the hex portion of a line.
+//! @details The hex portion consists of one "xx " entry per byte, padded out
+//!          to DUMP_LINE_WIDTH entries with spaces.
+//! @returns the number of bytes decoded, or 0 if the hex portion is invalid.
+static size_t DecodeHex(
+    const char* hex,  //!< [in] Start of the hex portion of the line.
+    uint8_t* data     //!< [out] Place to store the decoded bytes.
+) {
+    auto in = reinterpret_cast<const uint8_t*>(hex);
+
+    size_t numBytes = 0;
+    for (; numBytes < DUMP_LINE_WIDTH; numBytes++, in += 3) {
+        uint8_t hi = hexTable.value[in[0]];
+        uint8_t lo = hexTable.value[in[1]];
+        if (((hi | lo) & NOT_HEX) != 0) {
+            break;
+        }
+        if (in[2] != ' ') {
+            return 0;
+        }
+        data[numBytes] = (hi << 4) | lo;
+    }
+    if (memcmp(in, "                                                ", HEX_WIDTH - numBytes * 3) !=
+        0) {
+        return 0;
+    }
+    return numBytes;
+}  // DecodeHex
+
+//! Parses the portion of a line which precedes the data.
+//! @returns true if the header is valid.
+static bool ParseHeader(
+    const char* line,    //!< [in] Start of the line.
+    size_t headerLen,    //!< [in] Number of characters before the data.
+    const char* prefix,  //!< [in] Expected prefix, or nullptr to detect it.
+    size_t* address      //!< [out] Address from the header, or NO_ADDR.
+) {
+    *address = NO_ADDR;
+
+    if (prefix != nullptr) {
+        size_t prefixLen = strlen(prefix);
+        if (prefixLen > 0) {
+            if (headerLen < prefixLen + 2 || memcmp(line, prefix, prefixLen) != 0 ||
+                memcmp(&line[prefixLen], ": ", 2) != 0) {
+                return false;
+            }
+            line += prefixLen + 2;
+            headerLen -= prefixLen + 2;
+        }
+        if (headerLen == 0) {
+            return true;
+        }
+    } else if (headerLen == 0) {
+        return true;
+    }
+
+    if (headerLen < 2 || memcmp(&line[headerLen - 2], ": ", 2) != 0) {
+        return false;
+    }
+
+    // Find the start of the last field, which is the address if it's all hex digits.
+    size_t fieldEnd = headerLen - 2;
+    size_t fieldStart = fieldEnd;
+    while (fieldStart > 0 && (hexTable.value[static_cast<uint8_t>(line[fieldStart - 1])] &
+                              NOT_HEX) == 0) {
+        fieldStart--;
+    }
+    size_t numDigits = fieldEnd - fieldStart;
+    bool isAddr = numDigits >= 4 && numDigits <= sizeof(size_t) * 2 &&
+                  (fieldStart == 0 || (fieldStart >= 2 && line[fieldStart - 2] == ':' &&
+                                       line[fieldStart - 1] == ' '));
+    if (!isAddr) {
+        // The whole header is the prefix (with NO_ADDR), which is only allowed
+        // when detecting the prefix.
+        return prefix == nullptr;
+    }
+    if (prefix != nullptr && fieldStart != 0) {
+        return false;
+    }
+
+    size_t addr = 0;
+    for (size_t i = fieldStart; i < fieldEnd; i++) {
+        addr = (addr << 4) | hexTable.value[static_cast<uint8_t>(line[i])];
+    }
+    *address = addr;
+    return true;
+}  // ParseHeader
+
+UndumpResult ParseDumpLine(
+    const char* line,
+    size_t lineLen,
+    const char* prefix,
+    size_t* address,
+    uint8_t* data,
+    size_t* numBytes) {
+    *address = NO_ADDR;
+    *numBytes = 0;
+
+    while (lineLen > 0 && (line[lineLen - 1] == '\n' || line[lineLen - 1] == '\r')) {
+        lineLen--;
+    }
+    static constexpr size_t noColorLen = sizeof(COLOR_NO_COLOR) - 1;
+    if (lineLen >= noColorLen &&
+        memcmp(&line[lineLen - noColorLen], COLOR_NO_COLOR, noColorLen) == 0) {
+        lineLen -= noColorLen;
+    }
+
+    // The line ends with one ASCII character per byte, which is preceded by
+    // the fixed width hex portion. Full lines are by far the most common, so
+    // try those first.
+    for (size_t n = DUMP_LINE_WIDTH; n > 0; n--) {
+        if (lineLen < HEX_WIDTH + n) {
+            continue;
+        }
+        size_t hexStart = lineLen - n - HEX_WIDTH;
+        if (DecodeHex(&line[hexStart], data) != n) {
+            continue;
+        }
+        const char* ascii = &line[lineLen - n];
+        bool asciiMatches = true;
+        for (size_t i = 0; i < n; i++) {
+            char ch = std::isprint(data[i]) ? data[i] : '.';
+            if (ascii[i] != ch) {
+                asciiMatches = false;
+                break;
+            }
+        }
+        if (asciiMatches && ParseHeader(line, hexStart, prefix, address)) {
+            *numBytes = n;
+            return UndumpResult::OK;
+        }
+    }
+
+    // This is only checked once the line isn't a data line, since the ASCII
+    // portion of a data line can end in "No Data" too.
+    static constexpr size_t noDataLen = sizeof(NO_DATA_STR) - 1;
+    if (lineLen >= noDataLen && memcmp(&line[lineLen - noDataLen], NO_DATA_STR, noDataLen) == 0) {
+        size_t unused;
+        if (ParseHeader(line, lineLen - noDataLen, prefix, &unused)) {
+            *address = NO_ADDR;
+            return UndumpResult::NO_DATA;
+        }
+    }
+    return UndumpResult::INVALID;
+}  // ParseDumpLine
+
+size_t UndumpStream(std::istream& in, std::ostream& out, const char* prefix) {
+    std::string line;
+    uint8_t block[UNDUMP_BLOCK_SIZE];
+    size_t blockLen = 0;
+    size_t totalBytes = 0;
+
+    while (std::getline(in, line)) {
+        size_t address;
+        size_t numBytes;
+        auto result =
+            ParseDumpLine(line.data(), line.size(), prefix, &address, &block[blockLen], &numBytes);
+        if (result != UndumpResult::OK) {
+            continue;
+        }
+        blockLen += numBytes;
+        totalBytes += numBytes;
+        if (sizeof(block) - blockLen < DUMP_LINE_WIDTH) {
+            out.write(reinterpret_cast<const char*>(block), blockLen);
+            blockLen = 0;
+        }
+    }
+    out.write(reinterpret_cast<const char*>(block), blockLen);
+    return totalBytes;
+}  // UndumpStream
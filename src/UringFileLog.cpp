@@ -0,0 +1,487 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   UringFileLog.cpp
+ *
+ *   @brief  Logger which writes to a file from a dedicated thread using io_uring.
+ *
+ ****************************************************************************/
+
+#include "duino_log/UringFileLog.h"
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+
+// liburing isn't required, the few system calls needed are made directly.
+#if __has_include(<linux/io_uring.h>)
+#define DUINO_LOG_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#else
+#define DUINO_LOG_URING 0
+#endif
+
+//! Writes all of `len` bytes at `offset`, retrying after partial writes.
+static void pwrite_all(int fd, const char* data, size_t len, uint64_t offset) {
+    while (len > 0) {
+        ssize_t written = pwrite(fd, data, len, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        len -= written;
+        offset += written;
+    }
+}
+
+#if DUINO_LOG_URING
+
+//! io_uring submission and completion queues.
+struct UringRing {
+    int fd = -1;                            //!< io_uring file descriptor.
+    void* sq_ptr = MAP_FAILED;              //!< Submission queue ring mapping.
+    size_t sq_size = 0;                     //!< Size of the submission queue ring mapping.
+    void* cq_ptr = MAP_FAILED;              //!< Completion queue ring mapping.
+    size_t cq_size = 0;                     //!< Size of the completion queue ring mapping.
+    struct io_uring_sqe* sqes = nullptr;    //!< Submission queue entries.
+    size_t sqes_size = 0;                   //!< Size of the submission queue entries mapping.
+    unsigned* sq_tail = nullptr;            //!< Submission queue tail.
+    unsigned* sq_mask = nullptr;            //!< Submission queue index mask.
+    unsigned* sq_array = nullptr;           //!< Submission queue index array.
+    unsigned* cq_head = nullptr;            //!< Completion queue head.
+    unsigned* cq_tail = nullptr;            //!< Completion queue tail.
+    unsigned* cq_mask = nullptr;            //!< Completion queue index mask.
+    struct io_uring_cqe* cqes = nullptr;    //!< Completion queue entries.
+};
+
+//! Releases an io_uring.
+static void ring_destroy(UringRing* ring) {
+    if (ring->sqes != nullptr) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ptr != MAP_FAILED && ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_size);
+    }
+    if (ring->sq_ptr != MAP_FAILED) {
+        munmap(ring->sq_ptr, ring->sq_size);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    delete ring;
+}
+
+//! Creates an io_uring with `file_fd` registered as fixed file 0 and `iov` as the fixed buffers.
+//! @returns the ring, or nullptr if io_uring isn't available.
+static UringRing* ring_create(int file_fd, const struct iovec* iov, unsigned num_iov) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, num_iov, &params));
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    auto ring = new UringRing;
+    ring->fd = fd;
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && ring->cq_size > ring->sq_size) {
+        ring->sq_size = ring->cq_size;
+    }
+
+    ring->sq_ptr = mmap(
+        nullptr, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+        IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring_destroy(ring);
+        return nullptr;
+    }
+    if (single_mmap) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(
+            nullptr, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+            IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            ring_destroy(ring);
+            return nullptr;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(
+        nullptr, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+        IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        ring_destroy(ring);
+        return nullptr;
+    }
+    ring->sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(ring->sq_ptr);
+    ring->sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring->sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring->sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(ring->cq_ptr);
+    ring->cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring->cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring->cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iov, num_iov) != 0 ||
+        syscall(__NR_io_uring_register, fd, IORING_REGISTER_FILES, &file_fd, 1) != 0) {
+        ring_destroy(ring);
+        return nullptr;
+    }
+    return ring;
+}
+
+//! Writes buffers using fixed buffer writes, and waits for them to complete.
+//! @returns true if the writes were submitted.
+static bool ring_write(
+    UringRing* ring,
+    int file_fd,
+    const struct iovec* iov,
+    const unsigned* buf_index,
+    const uint64_t* offsets,
+    unsigned count) {
+    unsigned tail = *ring->sq_tail;
+    for (unsigned i = 0; i < count; i++) {
+        unsigned index = (tail + i) & *ring->sq_mask;
+        struct io_uring_sqe* sqe = &ring->sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->flags = IOSQE_FIXED_FILE;
+        sqe->fd = 0;
+        sqe->addr = reinterpret_cast<uint64_t>(iov[i].iov_base);
+        sqe->len = iov[i].iov_len;
+        sqe->off = offsets[i];
+        sqe->buf_index = buf_index[i];
+        sqe->user_data = i;
+        ring->sq_array[index] = index;
+    }
+    __atomic_store_n(ring->sq_tail, tail + count, __ATOMIC_RELEASE);
+
+    unsigned submitted = 0;
+    unsigned completed = 0;
+    while (completed < count) {
+        int rc = static_cast<int>(syscall(
+            __NR_io_uring_enter, ring->fd, count - submitted, count - completed,
+            IORING_ENTER_GETEVENTS, nullptr, 0));
+        if (rc < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            return false;
+        }
+        submitted += rc;
+
+        unsigned head = *ring->cq_head;
+        unsigned cq_tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != cq_tail) {
+            struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+            unsigned i = static_cast<unsigned>(cqe->user_data);
+            size_t done = cqe->res > 0 ? cqe->res : 0;
+            if (done < iov[i].iov_len) {
+                // Short write or error: finish the write synchronously.
+                pwrite_all(
+                    file_fd, static_cast<char*>(iov[i].iov_base) + done, iov[i].iov_len - done,
+                    offsets[i] + done);
+            }
+            head++;
+            completed++;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return true;
+}
+
+#else
+
+//! Placeholder when io_uring isn't available.
+struct UringRing {};
+
+#endif  // DUINO_LOG_URING
+
+UringFileLog::UringFileLog(const char* path, bool use_uring) {
+    // O_APPEND isn't used, since each buffer is written at an explicit offset.
+    this->m_fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (this->m_fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(this->m_fd, &st) == 0) {
+        this->m_offset = st.st_size;
+    }
+
+    struct iovec iov[NUM_BUFFERS];
+    for (size_t i = 0; i < NUM_BUFFERS; i++) {
+        this->m_buffers[i].data = static_cast<char*>(aligned_alloc(4096, BUFFER_SIZE));
+        if (this->m_buffers[i].data == nullptr) {
+            // Treated like a failed open (the destructor frees the other buffers).
+            close(this->m_fd);
+            this->m_fd = -1;
+            return;
+        }
+        memset(this->m_buffers[i].data, 0, BUFFER_SIZE);
+        iov[i].iov_base = this->m_buffers[i].data;
+        iov[i].iov_len = BUFFER_SIZE;
+    }
+    this->m_buffers[0].state = State::FILLING;
+
+#if DUINO_LOG_URING
+    if (use_uring) {
+        this->m_ring.store(ring_create(this->m_fd, iov, NUM_BUFFERS), std::memory_order_release);
+    }
+#else
+    (void)use_uring;
+#endif
+    this->m_thread = std::thread(&UringFileLog::background, this);
+}
+
+UringFileLog::~UringFileLog() {
+    this->detach();
+    this->flush_repeats();
+    if (this->m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            this->m_stop = true;
+        }
+        this->m_bg_cv.notify_one();
+        this->m_thread.join();
+    }
+#if DUINO_LOG_URING
+    UringRing* ring = this->m_ring.load(std::memory_order_acquire);
+    if (ring != nullptr) {
+        ring_destroy(ring);
+    }
+#endif
+    for (auto& buffer : this->m_buffers) {
+        free(buffer.data);
+    }
+    if (this->m_fd >= 0) {
+        close(this->m_fd);
+    }
+}
+
+void UringFileLog::write_line(Level level, const char* line, size_t len) {
+    (void)level;
+    if (this->m_fd < 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(this->m_mutex);
+    for (;;) {
+        Buffer* buffer = &this->m_buffers[this->m_fill];
+        if (buffer->state != State::FILLING) {
+            // Another thread is waiting for the next buffer to be written.
+            this->m_free_cv.wait(lock);
+            continue;
+        }
+        if (buffer->len + len > BUFFER_SIZE) {
+            this->next_buffer(lock);
+            continue;
+        }
+        bool was_empty = buffer->len == 0;
+        memcpy(&buffer->data[buffer->len], line, len);
+        buffer->len += len;
+        if (was_empty) {
+            // Start the logging thread's flush timer.
+            this->m_bg_cv.notify_one();
+        }
+        return;
+    }
+}
+
+void UringFileLog::flush() {
+    std::unique_lock<std::mutex> lock(this->m_mutex);
+    if (!this->m_thread.joinable()) {
+        return;
+    }
+    Buffer* buffer = &this->m_buffers[this->m_fill];
+    if (buffer->state == State::FILLING && buffer->len > 0) {
+        this->next_buffer(lock);
+    }
+    uint64_t filled = this->m_filled;
+    this->m_free_cv.wait(lock, [this, filled] { return this->m_written >= filled; });
+}
+
+void UringFileLog::sync() {
+    this->flush();
+    if (this->m_fd >= 0) {
+        fdatasync(this->m_fd);
+    }
+}
+
+void UringFileLog::prepare_fork() {
+    LineLog::prepare_fork();
+    this->flush();
+    this->m_mutex.lock();
+}
+
+void UringFileLog::parent_after_fork() {
+    this->m_mutex.unlock();
+    LineLog::parent_after_fork();
+}
+
+void UringFileLog::child_after_fork() {
+#if DUINO_LOG_URING
+    // The mappings and the descriptor are the child's own copies, so this
+    // doesn't affect the parent's ring.
+    UringRing* ring = this->m_ring.exchange(nullptr, std::memory_order_acq_rel);
+    if (ring != nullptr) {
+        ring_destroy(ring);
+    }
+#endif
+    if (this->m_fd >= 0) {
+        close(this->m_fd);
+        this->m_fd = -1;
+    }
+    for (auto& buffer : this->m_buffers) {
+        buffer.len = 0;
+        buffer.state = State::FREE;
+    }
+    this->m_buffers[this->m_fill].state = State::FILLING;
+    this->m_write = this->m_fill;
+    this->m_written = this->m_filled;
+    reconstruct_in_child(&this->m_bg_cv);
+    reconstruct_in_child(&this->m_free_cv);
+    reconstruct_in_child(&this->m_thread);
+    this->m_mutex.unlock();
+    LineLog::child_after_fork();
+}
+
+void UringFileLog::next_buffer(std::unique_lock<std::mutex>& lock) {
+    this->m_buffers[this->m_fill].state = State::READY;
+    this->m_filled++;
+    this->m_bg_cv.notify_one();
+
+    size_t next = (this->m_fill + 1) % NUM_BUFFERS;
+    this->m_free_cv.wait(lock, [this, next] { return this->m_buffers[next].state == State::FREE; });
+    this->m_buffers[next].state = State::FILLING;
+    this->m_fill = next;
+    this->m_free_cv.notify_all();
+}
+
+void UringFileLog::background() {
+    std::unique_lock<std::mutex> lock(this->m_mutex);
+    for (;;) {
+        this->m_bg_cv.wait(lock, [this] {
+            return this->m_stop || this->m_buffers[this->m_write].state == State::READY ||
+                   this->m_buffers[this->m_fill].len > 0;
+        });
+        if (!this->m_stop && this->m_buffers[this->m_write].state != State::READY) {
+            // Only a partially filled buffer, so give it a chance to fill up.
+            this->m_bg_cv.wait_for(lock, FLUSH_INTERVAL, [this] {
+                return this->m_stop || this->m_buffers[this->m_write].state == State::READY;
+            });
+        }
+        if (this->m_buffers[this->m_write].state != State::READY && this->m_write == this->m_fill &&
+            this->m_buffers[this->m_fill].len > 0) {
+            // Every other buffer has been written, so the next one is free.
+            this->next_buffer(lock);
+        }
+
+        size_t first = this->m_write;
+        size_t count = 0;
+        while (count < NUM_BUFFERS &&
+               this->m_buffers[(first + count) % NUM_BUFFERS].state == State::READY) {
+            this->m_buffers[(first + count) % NUM_BUFFERS].state = State::WRITING;
+            count++;
+        }
+        if (count > 0) {
+            lock.unlock();
+            this->write_buffers(first, count);
+            lock.lock();
+            for (size_t i = 0; i < count; i++) {
+                Buffer* buffer = &this->m_buffers[(first + i) % NUM_BUFFERS];
+                buffer->len = 0;
+                buffer->state = State::FREE;
+            }
+            this->m_write = (first + count) % NUM_BUFFERS;
+            this->m_written += count;
+            this->m_free_cv.notify_all();
+        }
+
+        if (this->m_stop && this->m_buffers[this->m_write].state != State::READY &&
+            this->m_buffers[this->m_fill].len == 0) {
+            break;
+        }
+    }
+}
+
+void UringFileLog::write_buffers(size_t first, size_t count) {
+    struct iovec iov[NUM_BUFFERS];
+    uint64_t offsets[NUM_BUFFERS];
+    unsigned buf_index[NUM_BUFFERS];
+    uint64_t offset = this->m_offset;
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t index = (first + i) % NUM_BUFFERS;
+        iov[i].iov_base = this->m_buffers[index].data;
+        iov[i].iov_len = this->m_buffers[index].len;
+        offsets[i] = offset;
+        buf_index[i] = index;
+        offset += iov[i].iov_len;
+        total += iov[i].iov_len;
+    }
+    this->m_offset = offset;
+
+#if DUINO_LOG_URING
+    // Only this thread changes m_ring while it's running.
+    UringRing* ring = this->m_ring.load(std::memory_order_relaxed);
+    if (ring != nullptr) {
+        if (ring_write(ring, this->m_fd, iov, buf_index, offsets, count)) {
+            return;
+        }
+        // Stop using io_uring. Rewriting the buffers is harmless, since each
+        // one is written at its own offset.
+        this->m_ring.store(nullptr, std::memory_order_release);
+        ring_destroy(ring);
+    }
+#endif
+
+    struct iovec* vec = iov;
+    offset = offsets[0];
+    while (total > 0) {
+        ssize_t written = pwritev(this->m_fd, vec, count, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        total -= written;
+        offset += written;
+        while (count > 0 && static_cast<size_t>(written) >= vec->iov_len) {
+            written -= vec->iov_len;
+            vec++;
+            count--;
+        }
+        if (count > 0) {
+            vec->iov_base = static_cast<char*>(vec->iov_base) + written;
+            vec->iov_len -= written;
+        }
+    }
+}
+
+#endif  // defined(__linux__)
@@ -0,0 +1,334 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   AsyncLog.h
+ *
+ *   @brief  Logger which passes messages to another logger on a background thread.
+ *
+ ****************************************************************************/
+
+#pragma once
+
+#include "duino_log/Log.h"
+
+#if LOG_THREADS_ENABLED && (defined(__unix__) || defined(__APPLE__))
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! Message in an AsyncRing (defined in AsyncLog.cpp).
+struct AsyncRecord;
+
+//! Per-thread ring used by AsyncLog (defined in AsyncLog.cpp).
+struct AsyncRing;
+
+//! Messages being formatted by AsyncLog's formatter pool (defined in AsyncLog.cpp).
+struct AsyncBatch;
+
+//! Logger which formats messages on the calling thread, and passes them to
+//! another logger (the sink) on a background thread.
+//! @details Each logging thread owns a single producer/single consumer ring,
+//!          which is created the first time the thread logs, and released
+//!          once the thread exits and its ring has been drained. Logging
+//!          formats the message (preceded by the thread's LogContext prefix)
+//!          straight into the ring, so the only shared state which is
+//!          written is the thread's own ring; there's no queue which all of
+//!          the threads contend for.
+//!
+//!          The background thread merges the rings by timestamp, and passes
+//!          each message to the sink's do_log(). Messages are ordered
+//!          within each pass over the rings, so a message logged just after
+//!          a pass starts may be output after a later one from another
+//!          thread.
+//!
+//!          What a thread does when its ring is full is controlled by
+//!          set_backpressure(). By default the message is dropped (and
+//!          counted), but messages of the more severe levels can be made to
+//!          wait for room instead, so that errors aren't lost during overload.
+//!          The background and formatter threads never wait, since they're
+//!          the ones which make room: if the sink logs through this logger,
+//!          the message is dropped when their ring is full (a durable
+//!          message from the background thread goes straight to the sink).
+//!
+//!          With a formatter pool (`num_formatters` > 0), logging only
+//!          captures the arguments (encoded as BinaryLog does), and the
+//!          messages are formatted on the consumer side instead. Each pass
+//!          merges up to BATCH_SIZE messages, and splits them into chunks
+//!          which are dealt out to the formatter threads and the background
+//!          thread. A thread which runs out of chunks steals them from the
+//!          others. The background thread then passes the chunks to the sink
+//!          in merge order (formatting chunks itself while it waits), so each
+//!          thread's messages still reach the sink in order. The format
+//!          strings need to remain valid until the messages are output
+//!          (string literals always are), and %s arguments are copied.
+//!
+//!          On machines with more than one NUMA node, set_numa_node() (or
+//!          set_affinity()) keeps the background and formatter threads on the
+//!          node where the logging threads run. Each ring is zeroed by the
+//!          thread which owns it when it's created, so with the kernel's
+//!          default first touch policy its memory is local to that thread's
+//!          node.
+//!
+//!          When the process forks, the messages logged so far are passed to
+//!          the sink first. The child discards anything logged after that
+//!          (the parent outputs it), and starts its own background and
+//!          formatter threads.
+//!
+//!          Messages logged with log_durable() always wait for room. Once a
+//!          pass has passed them to the sink, the sink's sync() is called
+//!          (once for the whole pass) and then their completions are called,
+//!          on the background thread.
+//!
+//!          The sink shouldn't be the current logger, so it should be
+//!          constructed with Install::LATER. Logging isn't async-signal-safe.
+//!
+//!          Only available on POSIX systems with threads enabled (see
+//!          DISABLE_LOG_THREADS). set_affinity() and set_numa_node() are
+//!          only available on Linux.
+class AsyncLog : public Log {
+ public:
+    //! Maximum length of a message (including the context prefix and the
+    //! terminating null). Longer messages are truncated.
+    static constexpr size_t MAX_MSG_LEN = 240;
+
+    //! Default number of messages each thread's ring can hold.
+    static constexpr size_t DEFAULT_RING_SIZE = 256;
+
+    //! Maximum time a message waits before the background thread looks for it.
+    static constexpr std::chrono::milliseconds POLL_INTERVAL{1};
+
+    //! Number of messages the background thread passes to the sink between
+    //! waking the threads which are parked waiting for room.
+    static constexpr size_t WAKE_BATCH = 32;
+
+    //! Maximum number of messages merged before they're passed to the sink.
+    static constexpr size_t BATCH_SIZE = 1024;
+
+    //! Number of messages in each unit of work given to the formatter pool.
+    static constexpr size_t CHUNK_SIZE = 16;
+
+    //! What a logging thread does when its ring is full.
+    //! @details Messages at `block_level` or more severe wait for room: the
+    //!          thread checks again `spins` times (with a pause instruction in
+    //!          between), then yields the CPU `yields` times, and then parks
+    //!          (on a futex on Linux) until the background thread has made
+    //!          room. Less severe messages are dropped.
+    struct Backpressure {
+        Level block_level = Level::NONE;  //!< Least severe level which waits (NONE drops everything).
+        uint32_t spins = 100;             //!< Number of times to spin before yielding.
+        uint32_t yields = 10;             //!< Number of times to yield before parking.
+    };
+
+    //! Constructor. Starts the background thread.
+    explicit AsyncLog(
+        Log* sink,                             //!< [in] Logger to pass messages to.
+        size_t ring_size = DEFAULT_RING_SIZE,  //!< [in] Messages per thread (rounded up to a power of 2).
+        size_t num_formatters = 0,             //!< [in] Formatter threads (0 formats when logging).
+        Install install = Install::NOW         //!< [in] When to make this the current logger.
+    );
+
+    //! Destructor. Passes any remaining messages to the sink and stops the thread.
+    ~AsyncLog() override;
+
+    //! Waits until the messages logged so far have been passed to the sink.
+    void flush();
+
+    //! Waits until the messages logged so far have been passed to the sink,
+    //! and then calls the sink's sync().
+    void sync() override;
+
+    //! Passes the messages logged so far to the sink, and takes the locks
+    //! (including the sink's, through its prepare_fork()).
+    void prepare_fork() override;
+
+    //! Releases the locks.
+    void parent_after_fork() override;
+
+    //! Releases the locks, discards the messages in the rings, and starts
+    //! the background and formatter threads again.
+    void child_after_fork() override;
+
+    //! Returns the number of messages dropped because a ring was full.
+    //! @returns the number of messages dropped.
+    uint64_t num_dropped() const { return this->m_num_dropped.load(std::memory_order_relaxed); }
+
+    //! Sets what logging threads do when their ring is full.
+    void set_backpressure(
+        const Backpressure& policy  //!< [in] Policy to use.
+    );
+
+    //! Returns what logging threads do when their ring is full.
+    //! @returns the policy.
+    Backpressure get_backpressure() const;
+
+    //! Returns the number of messages which had to wait for room in a ring.
+    //! @returns the number of messages.
+    uint64_t num_stalled() const { return this->m_num_stalled.load(std::memory_order_relaxed); }
+
+    //! Returns the total time logging threads spent waiting for room in a ring.
+    //! @details Stalls are also recorded in the STALL histogram of Log::stats().
+    //! @returns the time in nsec.
+    uint64_t stall_ns() const { return this->m_stall_ns.load(std::memory_order_relaxed); }
+
+#if defined(__linux__)
+    //! Restricts the background and formatter threads to a set of CPUs.
+    //! @details Only available on Linux.
+    //! @returns true if the affinity was set.
+    bool set_affinity(
+        const std::vector<unsigned>& cpus  //!< [in] CPUs which the threads may run on.
+    );
+
+    //! Restricts the background and formatter threads to the CPUs of a NUMA node.
+    //! @details The node's CPUs are read from sysfs. Only available on Linux.
+    //! @returns true if the affinity was set.
+    bool set_numa_node(
+        unsigned node  //!< [in] Node number.
+    );
+#endif
+
+    //! Parses a list of CPUs in the kernel's format (i.e. "0-3,8,10-11").
+    //! @returns true if the list was parsed and isn't empty.
+    static bool parse_cpu_list(
+        const char* list,            //!< [in] List to parse (trailing whitespace is ignored).
+        std::vector<unsigned>* cpus  //!< [out] CPUs in the list.
+    );
+
+    //! Returns the number of formatter threads.
+    //! @returns the number of threads (0 if messages are formatted when they're logged).
+    size_t num_formatters() const { return this->m_num_formatters; }
+
+    //! Returns the number of threads which currently have a ring.
+    //! @returns the number of rings.
+    size_t num_rings();
+
+ protected:
+    //! Formats a message into the calling thread's ring.
+    void do_log(
+        Level level,      //!< Logging level associated with this message.
+        const char* fmt,  //!< Printf style format string
+        va_list args      //!< Arguments associated with format string.
+        ) override;
+
+    //! Encodes a structured message into the calling thread's ring.
+    //! @details The sink receives the encoded message through do_log().
+    void do_log_kv(
+        Level level,          //!< [in] Level associated with this message.
+        const char* msg,      //!< [in] Message.
+        const KeyValue* kvs,  //!< [in] Fields.
+        size_t num_kvs        //!< [in] Number of fields.
+        ) override;
+
+    //! Formats a message into the calling thread's ring, waiting for room if
+    //! needed. `completion` is called by the background thread once the
+    //! sink has synced the message.
+    void do_log_durable(
+        Completion* completion,  //!< [in] Notified once the message is durable.
+        Level level,             //!< [in] Level associated with this message.
+        const char* fmt,         //!< [in] printf style format string.
+        va_list args             //!< [in] List of parameters
+        ) override;
+
+ private:
+    //! Returns the calling thread's ring, creating it if needed.
+    //! @returns the ring.
+    AsyncRing* thread_ring();
+
+    //! Returns the next free record in the calling thread's ring, applying
+    //! the backpressure policy if it's full.
+    //! @returns the record, or nullptr if the message was dropped.
+    AsyncRecord* reserve(
+        AsyncRing* ring,   //!< [in] The calling thread's ring.
+        Level level,       //!< [in] Level of the message.
+        bool wait = false  //!< [in] Wait for room whatever the level.
+    );
+
+    //! Formats a message into a record, preceded by the calling thread's
+    //! context. With a formatter pool, the arguments are captured instead.
+    void format(
+        AsyncRecord* record,  //!< [out] Record to fill in.
+        Level level,          //!< [in] Level associated with this message.
+        const char* fmt,      //!< [in] printf style format string.
+        va_list args          //!< [in] List of parameters
+        ) __attribute__((format(printf, 4, 0)));
+
+    //! Waits until the background thread has consumed a message from a ring.
+    void park(
+        AsyncRing* ring  //!< [in] Ring which is full.
+    );
+
+    //! Wakes up the threads which are parked waiting for room.
+    void wake_parked();
+
+    //! Entry point for the background thread.
+    void background();
+
+    //! Starts the background and formatter threads.
+    void start_threads();
+
+    //! Passes the messages which are currently in the rings to the sink.
+    //! @returns the number of messages passed to the sink.
+    size_t drain();
+
+    //! Formats the merged messages (using the formatter pool if they were
+    //! captured), passes them to the sink, and removes them from their rings.
+    void output_batch(
+        size_t* count  //!< [in,out] Number of messages passed to the sink so far.
+    );
+
+    //! Claims a chunk of the current batch, preferring `worker`'s own chunks,
+    //! and formats it.
+    //! @returns false if there were no chunks left to claim.
+    bool format_chunk(
+        size_t worker,  //!< [in] Index of the calling thread (0 is the background thread).
+        uint32_t seq    //!< [in] Number of the batch being formatted.
+    );
+
+    //! Entry point for the formatter threads.
+    void formatter(
+        size_t worker  //!< [in] Index of the formatter (from 1).
+    );
+
+    Log* m_sink;              //!< Logger which the messages are passed to.
+    size_t m_ring_size;       //!< Number of messages in each ring.
+    uint64_t m_id;            //!< Identifies this logger in the per-thread ring lists.
+    size_t m_num_formatters;  //!< Number of formatter threads.
+
+    std::mutex m_mutex;                               //!< Protects the members below.
+    std::condition_variable m_cv;                     //!< Wakes up the background thread.
+    std::condition_variable m_flushed_cv;             //!< Signalled when a pass completes.
+    std::vector<std::shared_ptr<AsyncRing>> m_rings;  //!< Rings of the registered threads.
+    uint64_t m_flush_requested = 0;                   //!< Number of flushes requested.
+    uint64_t m_flush_done = 0;                        //!< Number of flushes completed.
+    bool m_rings_changed = false;                     //!< Set when m_rings changes.
+    bool m_stop = false;                              //!< Tells the background thread to exit.
+
+    std::vector<std::shared_ptr<AsyncRing>> m_drain_rings;  //!< Background thread's copy of m_rings.
+    std::vector<Completion*> m_completions;                 //!< Completions to call after the sink syncs.
+    std::unique_ptr<AsyncBatch> m_batch;                    //!< Messages merged by the current pass.
+    std::vector<std::thread> m_formatters;                  //!< Formatter threads.
+    std::atomic<uint64_t> m_num_dropped{0};                 //!< Number of messages dropped.
+    std::atomic<uint64_t> m_num_stalled{0};                 //!< Number of messages which waited.
+    std::atomic<uint64_t> m_stall_ns{0};                    //!< Total time spent waiting.
+
+    std::atomic<Level> m_block_level{Level::NONE};  //!< See Backpressure.
+    std::atomic<uint32_t> m_spins{100};             //!< See Backpressure.
+    std::atomic<uint32_t> m_yields{10};             //!< See Backpressure.
+    std::atomic<uint32_t> m_num_parked{0};          //!< Number of threads parked (or about to park).
+    std::atomic<uint32_t> m_wake_seq{0};            //!< Futex word, bumped to wake parked threads.
+    std::thread m_thread;                                   //!< Background thread.
+};
+
+#endif  // LOG_THREADS_ENABLED && (defined(__unix__) || defined(__APPLE__))
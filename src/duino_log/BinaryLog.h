@@ -0,0 +1,216 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   BinaryLog.h
+ *
+ *   @brief  Logger which writes a compact binary log, and its decoder.
+ *
+ *   Rather than formatting each message, BinaryLog writes the level, a
+ *   timestamp, an ID for the format string and the raw argument values.
+ *   Each format string is written to the file once, the first time it's
+ *   used. Format strings are identified by their contents, so they don't
+ *   need to be literals. BinaryLogDecoder (and the tools/duino_logdecode.cpp host tool)
+ *   converts the records back into text using the StrPrintf engine, so the
+ *   text is identical to what a text logger would have produced.
+ *
+ *   File layout:
+ *
+ *       "DLOGBIN1"                                        File header
+ *       0x01 id len format-bytes                          Format record
+ *       0x02 len context-bytes                            Context record
+ *       0x10+level timestamp-delta id len arg-bytes       Log record
+ *
+ *   All of the numbers are LEB128 style varints. The timestamp delta is the
+ *   zigzag encoded number of microseconds since the previous log record (or
+ *   since the epoch for the first record). Integer arguments are stored as
+ *   varints (zigzag encoded for signed conversions), %c arguments as a
+ *   single byte, and %s arguments as a length followed by the characters.
+ *
+ *   A context record holds the LogContext prefix of the log records which
+ *   follow it. It's only written when the prefix changes, so files which
+ *   don't use LogContext don't contain any.
+ *
+ ****************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "duino_log/Log.h"
+#include "duino_log/LogContext.h"
+
+#if LOG_THREADS_ENABLED
+#include <mutex>
+#endif
+
+//! Logger which writes a compact binary log to a file.
+class BinaryLog : public Log {
+ public:
+    //! Magic string at the start of each binary log file.
+    static constexpr char MAGIC[] = "DLOGBIN1";
+
+    //! Record tag for a format string record.
+    static constexpr uint8_t FORMAT_TAG = 0x01;
+
+    //! Record tag for a context record.
+    static constexpr uint8_t CONTEXT_TAG = 0x02;
+
+    //! Record tag for a log record (the level is added to this).
+    static constexpr uint8_t RECORD_TAG = 0x10;
+
+    //! Maximum number of bytes of argument data in a single record.
+    //! @details Arguments which don't fit are dropped, which truncates the
+    //!          decoded message, much like a text logger truncates long lines.
+    static constexpr size_t MAX_ARG_LEN = 512;
+
+    //! Maximum number of distinct format strings in a file.
+    //! @details Once there are this many, messages with a new format string
+    //!          are formatted and written using the format "%s" instead, so
+    //!          formats built at runtime can't grow the registry without bound.
+    static constexpr size_t MAX_FORMATS = 4096;
+
+    //! Constructor.
+    explicit BinaryLog(
+        FILE* log_fs  //!< [in] File to write the binary log to.
+    );
+
+    //! Destructor.
+    ~BinaryLog() override;
+
+    //! Encodes the arguments for a format string.
+    //! @returns the number of bytes stored in `buf`.
+    static size_t encode_args(
+        const char* fmt,  //!< [in] printf style format string.
+        va_list args,     //!< [in] Arguments associated with the format string.
+        uint8_t* buf,     //!< [out] Place to store the encoded arguments.
+        size_t bufLen     //!< [in] Size of `buf`.
+        ) __attribute__((format(printf, 1, 0)));
+
+    //! Flushes the file, and syncs it to storage (if it's backed by one, on
+    //! POSIX systems).
+    void sync() override;
+
+    //! Takes the lock and flushes the file, so that the child doesn't write
+    //! the parent's buffered records again.
+    //! @details The parent and child shouldn't both keep logging to the same
+    //!          file, since their records would be interleaved.
+    void prepare_fork() override;
+
+    //! Releases the lock.
+    void parent_after_fork() override;
+
+    //! Releases the lock.
+    void child_after_fork() override;
+
+ protected:
+    //! Writes a binary log record.
+    void do_log(
+        Level level,      //!< Logging level associated with this message.
+        const char* fmt,  //!< Printf style format string
+        va_list args      //!< Arguments associated with format string.
+        ) override;
+
+ private:
+    //! Returned by format_id() when there's no room for another format string.
+    static constexpr uint32_t NO_FORMAT_ID = UINT32_MAX;
+
+    //! Returns the ID of a format string, writing a format record the first time it's used.
+    //! @returns the ID for `fmt`, or NO_FORMAT_ID if there are already MAX_FORMATS.
+    uint32_t format_id(
+        const char* fmt  //!< [in] Format string.
+    );
+
+    FILE* m_log_fs;  //!< File being logged to.
+#if LOG_THREADS_ENABLED
+    std::mutex m_mutex;  //!< Serializes writes.
+#endif
+    std::deque<std::string> m_format_strs;                     //!< Format strings seen so far.
+    std::unordered_map<std::string_view, uint32_t> m_formats;  //!< IDs of m_format_strs.
+    uint64_t m_last_time_us = 0;                               //!< Timestamp of the previous record.
+    LogContext::Snapshot m_context;                            //!< Context of the previous record.
+};
+
+//! Decodes the records written by BinaryLog.
+class BinaryLogDecoder {
+ public:
+    //! Result of decoding a record.
+    enum class Result : uint8_t {
+        RECORD,   //!< A log record was decoded.
+        END,      //!< The end of the input was reached.
+        CORRUPT,  //!< The input isn't a valid binary log.
+    };
+
+    //! Constructor.
+    explicit BinaryLogDecoder(
+        std::istream& in  //!< [in] Stream containing the binary log.
+        )
+        : m_in{in} {}
+
+    //! Decodes the next log record.
+    //! @returns the result of decoding.
+    Result next();
+
+    //! Returns the level of the last decoded record.
+    //! @returns the level.
+    Log::Level level() const { return this->m_level; }
+
+    //! Returns the timestamp of the last decoded record.
+    //! @returns the number of microseconds since the epoch.
+    uint64_t timestamp_us() const { return this->m_time_us; }
+
+    //! Returns the formatted message of the last decoded record.
+    //! @returns the message (without any level prefix, context or newline).
+    const std::string& message() const { return this->m_message; }
+
+    //! Returns the LogContext prefix of the last decoded record.
+    //! @returns the prefix (empty if the record didn't have a context).
+    const std::string& context() const { return this->m_context; }
+
+    //! Formats a message from a format string and encoded arguments.
+    //! @returns the formatted message.
+    static std::string format(
+        const char* fmt,      //!< [in] Format string.
+        const uint8_t* args,  //!< [in] Arguments encoded by BinaryLog::encode_args.
+        size_t argLen         //!< [in] Number of bytes in `args`.
+    );
+
+    //! Formats a message from a format string and encoded arguments.
+    //! @details `out` is cleared first, so the same string can be reused to
+    //!          avoid allocating for each message.
+    static void format(
+        std::string* out,     //!< [out] Formatted message.
+        const char* fmt,      //!< [in] Format string.
+        const uint8_t* args,  //!< [in] Arguments encoded by BinaryLog::encode_args.
+        size_t argLen         //!< [in] Number of bytes in `args`.
+    );
+
+ private:
+    //! Reads a varint from the input.
+    //! @returns true if the varint was read successfully.
+    bool read_varint(
+        uint64_t* value  //!< [out] Value read.
+    );
+
+    std::istream& m_in;                   //!< Stream being decoded.
+    bool m_header_read = false;           //!< Has the file header been read?
+    std::vector<std::string> m_formats;  //!< Format strings indexed by ID.
+    std::vector<uint8_t> m_args;          //!< Argument bytes of the current record.
+    Log::Level m_level = Log::Level::NONE;  //!< Level of the last record.
+    uint64_t m_time_us = 0;                 //!< Timestamp of the last record.
+    std::string m_message;                  //!< Message of the last record.
+    std::string m_context;                  //!< Context of the following records.
+};
@@ -30,8 +30,13 @@
 //! Constant to suppress printing of the address.
 static constexpr size_t NO_ADDR = SIZE_MAX;
 
+//! Number of bytes of data formatted on each line by DumpLine().
+static constexpr size_t DUMP_LINE_WIDTH = 16;
+
 //! Formats a line of dump data into a buffer.
-void DumpLine(
+//! @returns the number of characters stored in `line`, not including the
+//!          terminating null character.
+size_t DumpLine(
     char const* prefix,  //!< [in] String to prefix each line of output with.
     size_t address,      //!< [in] Address to print for the first byteof the data.
     const void* data,    //!< [in] Pointer to the data.
@@ -48,6 +53,35 @@ void DumpMem(
     size_t numBytes      //!< [in] number of bytes of data.
 );
 
+//! Formats a line of diff data comparing two buffers into a buffer.
+//! @details The bytes from `a` are shown on the left and the bytes from `b`
+//!          on the right. Bytes which differ are highlighted with color if
+//!          `color` is true, otherwise they're followed by a `*`.
+//! @returns the number of characters stored in `line`, not including the
+//!          terminating null character.
+size_t DumpDiffLine(
+    char const* prefix,  //!< [in] String to prefix each line of output with.
+    size_t address,      //!< [in] Address to print for the first byte of the data.
+    const void* a,       //!< [in] Pointer to the first buffer.
+    const void* b,       //!< [in] Pointer to the second buffer.
+    size_t numBytes,     //!< [in] number of bytes of data.
+    bool color,          //!< [in] Highlight differences using ConsoleColor.h colors.
+    size_t lineLen,      //!< [in] Length of output buffer.
+    char* line           //!< [out] Place to store formatted line.
+);
+
+//! Logs the lines where two buffers differ.
+//! @details Lines where both buffers are identical are skipped, and a line
+//!          containing a single `*` is logged in place of each skipped region.
+void DumpDiff(
+    char const* prefix,  //!< [in] String to prefix each line of output with.
+    size_t address,      //!< [in] Address to print for the first byte of the data.
+    const void* a,       //!< [in] Pointer to the first buffer.
+    const void* b,       //!< [in] Pointer to the second buffer.
+    size_t numBytes,     //!< [in] number of bytes in each buffer.
+    bool color = false   //!< [in] Highlight differences using ConsoleColor.h colors.
+);
+
 //! Streaming object which allows outut to be sent to a stream.
 class dump {
  public:
@@ -0,0 +1,117 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   KeyValue.h
+ *
+ *   @brief  Fields for structured (key/value) logging.
+ *
+ ****************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+//! A single field of a structured log message.
+//! @details Fields are created using kv(), and only refer to the key and
+//!          string values, so they should only be used for the duration of
+//!          the logging call.
+struct KeyValue {
+    //! Type of the value.
+    enum class Type : uint8_t {
+        SIGNED,    //!< Signed integer.
+        UNSIGNED,  //!< Unsigned integer.
+        BOOL,      //!< Boolean.
+        STRING,    //!< String.
+    };
+
+    const char* key;  //!< Name of the field.
+    Type type;        //!< Type of the value.
+    union {
+        int64_t i;   //!< SIGNED value.
+        uint64_t u;  //!< UNSIGNED value.
+        bool b;      //!< BOOL value.
+        struct {
+            const char* str;  //!< STRING value (not necessarily null terminated).
+            size_t len;       //!< Length of `str`.
+        } s;                  //!< STRING value.
+    };
+};
+
+//! Creates an integer field.
+//! @returns the field.
+template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+inline KeyValue kv(
+    const char* key,  //!< [in] Name of the field.
+    T value           //!< [in] Value of the field.
+) {
+    KeyValue field;
+    field.key = key;
+    if constexpr (std::is_same<T, bool>::value) {
+        field.type = KeyValue::Type::BOOL;
+        field.b = value;
+    } else if constexpr (std::is_signed<T>::value) {
+        field.type = KeyValue::Type::SIGNED;
+        field.i = value;
+    } else {
+        field.type = KeyValue::Type::UNSIGNED;
+        field.u = value;
+    }
+    return field;
+}
+
+//! Creates a string field.
+//! @returns the field.
+inline KeyValue kv(
+    const char* key,   //!< [in] Name of the field.
+    const char* value  //!< [in] Value of the field (nullptr is logged as "(null)").
+) {
+    KeyValue field;
+    field.key = key;
+    field.type = KeyValue::Type::STRING;
+    field.s.str = value != nullptr ? value : "(null)";
+    field.s.len = strlen(field.s.str);
+    return field;
+}
+
+//! Creates a string field from a string which isn't null terminated.
+//! @returns the field.
+inline KeyValue kv(
+    const char* key,    //!< [in] Name of the field.
+    const char* value,  //!< [in] Value of the field.
+    size_t len          //!< [in] Length of `value`.
+) {
+    KeyValue field;
+    field.key = key;
+    field.type = KeyValue::Type::STRING;
+    field.s.str = value;
+    field.s.len = len;
+    return field;
+}
+
+//! Creates a string field from a string class (i.e. std::string or std::string_view).
+//! @returns the field.
+template <typename T, typename std::enable_if<!std::is_integral<T>::value, int>::type = 0>
+inline auto kv(
+    const char* key,  //!< [in] Name of the field.
+    const T& value    //!< [in] Value of the field.
+    ) -> decltype(value.data(), value.size(), KeyValue()) {
+    return kv(key, value.data(), value.size());
+}
+
+//! Encodes a single field using logfmt (`key=value`).
+//! @details The value is quoted if it contains spaces, quotes, '=' or control characters.
+//! @returns the length of the encoded field, or 0 (and an empty string) if it doesn't fit.
+size_t encode_logfmt_field(
+    char* out,             //!< [out] Place to store the encoded field.
+    size_t maxLen,         //!< [in] Size of `out`.
+    const KeyValue& field  //!< [in] Field to encode.
+);
@@ -0,0 +1,138 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   LineLog.h
+ *
+ *   @brief  Base class for loggers which output complete lines.
+ *
+ ****************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+#include "duino_log/Log.h"
+
+#if LOG_THREADS_ENABLED
+#include <mutex>
+#endif
+
+//! Base class for loggers which format each message into a line before outputting it.
+//! @details The line is formatted into a buffer on the stack, so do_log is
+//!          reentrant, and derived classes only need to implement write_line.
+//!
+//!          Identical consecutive lines can be collapsed (see set_dedup()).
+//!          Derived classes should call flush_repeats() from their destructor
+//!          (after detach()) so that a pending count isn't lost.
+class LineLog : public Log {
+ public:
+    using Log::Log;
+
+    //! Maximum length of a formatted line, including the newline and terminating null.
+    //! @details Longer messages are truncated.
+    static constexpr size_t MAX_LINE_LEN = 256;
+
+    //! Array of prefixes to use for each logging level.
+    static const char* level_str[];
+
+    //! Formats a log message into a line.
+    //! @details The line consists of the level prefix, the prefix of the calling
+    //!          thread's LogContext, the formatted message and a newline.
+    //!          `lineLen` needs to be at least 2.
+    //! @returns the number of characters stored in `line`, not including the
+    //!          terminating null character.
+    static size_t format_line(
+        char* line,       //!< [out] Place to store the formatted line.
+        size_t lineLen,   //!< [in] Size of `line`.
+        Level level,      //!< [in] Logging level associated with this message.
+        const char* fmt,  //!< [in] Printf style format string.
+        va_list args      //!< [in] Arguments associated with format string.
+        ) __attribute__((format(printf, 4, 0)));
+
+    //! Enables or disables collapsing of repeated lines for a level.
+    //! @details When enabled, a line which is identical to the previous line
+    //!          is counted rather than output. The count is output as a
+    //!          "last message repeated N times" line when a different line is
+    //!          logged, or when flush_repeats() is called.
+    void set_dedup(
+        Level level,  //!< [in] Level to enable or disable collapsing for.
+        bool enable   //!< [in] true to collapse repeated lines.
+    );
+
+    //! Outputs the count of any collapsed lines.
+    void flush_repeats();
+
+    //! Takes the lock which protects the collapsed lines (if threads are enabled).
+    //! @details Derived classes which override this should call it before
+    //!          taking their own locks (which are taken in write_line()).
+    void prepare_fork() override;
+
+    //! Releases the lock taken by prepare_fork().
+    void parent_after_fork() override;
+
+    //! Releases the lock taken by prepare_fork(), and forgets any collapsed
+    //! lines (the parent outputs their count).
+    void child_after_fork() override;
+
+ protected:
+    //! Formats the message and passes it to write_line.
+    void do_log(
+        Level level,      //!< Logging level associated with this message.
+        const char* fmt,  //!< Printf style format string
+        va_list args      //!< Arguments associated with format string.
+        ) override;
+
+    //! Encodes a structured message and passes it to write_line.
+    //! @details The encoded message (including the calling thread's LogContext
+    //!          fields) is output as is, without a level prefix.
+    void do_log_kv(
+        Level level,          //!< [in] Level associated with this message.
+        const char* msg,      //!< [in] Message.
+        const KeyValue* kvs,  //!< [in] Fields.
+        size_t num_kvs        //!< [in] Number of fields.
+        ) override;
+
+    //! Outputs a formatted line.
+    virtual void write_line(
+        Level level,       //!< [in] Logging level associated with this line.
+        const char* line,  //!< [in] Formatted line, including the trailing newline.
+        size_t len         //!< [in] Length of `line`.
+        ) = 0;
+
+ private:
+    //! Passes a line to write_line, unless it's collapsed.
+    void output(
+        Level level,       //!< [in] Logging level associated with this line.
+        const char* line,  //!< [in] Formatted line, including the trailing newline.
+        size_t len         //!< [in] Length of `line`.
+    );
+
+    //! Checks if a line repeats the previous line.
+    //! @returns true if the line was collapsed, and shouldn't be output.
+    bool collapse(
+        Level level,       //!< [in] Logging level associated with this line.
+        const char* line,  //!< [in] Formatted line.
+        size_t len         //!< [in] Length of `line`.
+    );
+
+    //! Outputs the number of times the previous line was repeated.
+    //! @details m_dedup_mutex must be held.
+    void write_repeats();
+
+    std::atomic<uint8_t> m_dedup_levels{0};  //!< Bit mask of levels to collapse.
+#if LOG_THREADS_ENABLED
+    std::mutex m_dedup_mutex;  //!< Protects the remaining members.
+#endif
+    Level m_last_level = Level::NONE;        //!< Level of the previous line.
+    size_t m_last_len = 0;                   //!< Length of the previous line (0 if not collapsible).
+    uint32_t m_repeats = 0;                  //!< Number of times the previous line was repeated.
+    char m_last_line[MAX_LINE_LEN];          //!< The previous line.
+};
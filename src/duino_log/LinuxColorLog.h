@@ -33,6 +33,17 @@ class LinuxColorLog : public Log {
         )
         : m_log_fs{log_fs} {}
 
+    //! Locks and flushes the file, so that the child doesn't inherit the
+    //! stdio lock in the middle of a line, or output which the parent will
+    //! also write.
+    void prepare_fork() override;
+
+    //! Unlocks the file.
+    void parent_after_fork() override;
+
+    //! Unlocks the file.
+    void child_after_fork() override;
+
  protected:
     //! Implements the actual logging function.
     void do_log(
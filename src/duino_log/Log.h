@@ -18,9 +18,16 @@
 
 #include <stdarg.h>
 
+#include <atomic>
 #include <cassert>
 #include <cinttypes>
+#include <cstring>
+#include <new>
+#include <string>
+#include <tuple>
+#include <utility>
 
+#include "duino_log/KeyValue.h"
 #include "duino_log/Str.h"
 
 #if !defined(DISABLE_LOGGING)
@@ -31,7 +38,57 @@
 //! Define the positive variant, which can be used in constexpr and preprocssor
 #define LOGGING_ENABLED (!DISABLE_LOGGING)
 
+#if !defined(DISABLE_LOG_THREADS)
+//! Define DISABLE_LOG_THREADS to use the single threaded logging path, which
+//! doesn't need <mutex>, <thread> or thread_local. It's the default on
+//! targets without an operating system (i.e. AVR or the pico).
+#if defined(__unix__) || defined(__APPLE__) || defined(_WIN32)
+#define DISABLE_LOG_THREADS 0
+#else
+#define DISABLE_LOG_THREADS 1
+#endif
+#endif
+
+//! Define the positive variant, which can be used in constexpr and preprocssor
+#define LOG_THREADS_ENABLED (LOGGING_ENABLED && !DISABLE_LOG_THREADS)
+
+#if !defined(DISABLE_LOG_STATS)
+//! Define DISABLE_LOG_STATS to compile out the logging statistics (see LogStats.h).
+//! The statistics are recorded per thread, so they're also compiled out
+//! along with the threading support.
+#if defined(AVR) || DISABLE_LOG_THREADS
+#define DISABLE_LOG_STATS 1
+#else
+#define DISABLE_LOG_STATS 0
+#endif
+#endif
+
+//! Define the positive variant, which can be used in constexpr and preprocssor
+#define LOG_STATS_ENABLED (LOG_THREADS_ENABLED && !DISABLE_LOG_STATS)
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+//! Set when the awaitable logging functions (Log::async_info() etc) are available.
+#define LOG_COROUTINES_ENABLED 1
+#endif
+#endif
+#if !defined(LOG_COROUTINES_ENABLED)
+#define LOG_COROUTINES_ENABLED 0
+#endif
+
+class LogContext;
+struct LogStats;
+
 //! Abstract Logging class.
+//! @details The logging functions may be called from any thread. The current
+//!          logger, level, filter and `kv_format` are atomic, so they can be
+//!          changed while other threads are logging. Each call pins the
+//!          logger it uses (using a per-thread hazard pointer), so that
+//!          detach() can wait for calls which are still in progress before
+//!          the logger is destroyed. No locks are taken on the logging path.
+//!          When DISABLE_LOG_THREADS is set, the logger is used without
+//!          pinning it, so it must only be replaced from the thread which logs.
 class Log {
  public:
     //! Logging levels.
@@ -44,34 +101,158 @@ class Log {
         DEBUG,    //!< Debug
     };
 
+    //! Encodings used for structured (key/value) messages.
+    enum class KvFormat : uint8_t {
+        LOGFMT,  //!< `level=info msg="Request done" id=42`
+        JSON,    //!< `{"level":"info","msg":"Request done","id":42}`
+    };
+
+    //! Interface for deciding whether individual messages should be logged.
+    //! @details The filter is consulted after the level check, but before the
+    //!          message is formatted (see RateLimitFilter).
+    class Filter {
+     public:
+        //! Destructor.
+        virtual ~Filter() = default;
+
+        //! Determines if a message should be logged.
+        //! @returns true if the message should be logged.
+        virtual bool allow(
+            Level level,     //!< [in] Level associated with the message.
+            const char* fmt  //!< [in] Format string (or message) identifying the call site.
+            ) = 0;
+    };
+
+    //! Interface for finding out when a message passed to log_durable() has
+    //! been written out.
+    class Completion {
+     public:
+        //! Destructor.
+        virtual ~Completion() = default;
+
+        //! Called once the message is durable (or has been discarded).
+        //! @details This may be called on the logging thread before
+        //!          log_durable() returns, or later on another thread (such
+        //!          as AsyncLog's background thread).
+        virtual void complete() = 0;
+    };
+
+    //! When a newly constructed logger becomes the current logger.
+    enum class Install : uint8_t {
+        NOW,    //!< The constructor makes it the current logger.
+        LATER,  //!< It's made the current logger by calling replace().
+    };
+
     //! Constructor.
-    Log() {
-        assert(logger == nullptr);
-        this->logger = this;
+    //! @details The constructor makes the logger current before the derived
+    //!          class has been constructed, so Install::NOW should only be
+    //!          used while no other threads are logging. To replace the logger
+    //!          while other threads are logging, construct the new logger with
+    //!          Install::LATER and pass it to replace().
+    explicit Log(
+        Install install = Install::NOW  //!< [in] When to make this the current logger.
+    ) {
+        register_fork_handlers();
+        if (install == Install::NOW) {
+            assert(logger == nullptr);
+            logger.store(this, std::memory_order_release);
+        }
     }
 
     //! Destructor.
-    virtual ~Log() { logger = nullptr; }
+    virtual ~Log() { this->detach(); }
+
+    //! Stops this from being the current logger.
+    //! @details Waits for calls on other threads which are still using this
+    //!          logger to return, after which it's safe to destroy it (or to
+    //!          create a replacement). Derived classes should call this at the
+    //!          start of their destructor, so that they aren't used while
+    //!          they're being torn down. Calling it more than once is harmless.
+    void detach();
+
+    //! Replaces the current logger.
+    //! @details Waits for calls on other threads which are still using the
+    //!          previous logger to return, so that it can be destroyed.
+    //! @returns the previous logger (or nullptr if there wasn't one).
+    static Log* replace(
+        Log* log  //!< [in] New logger (may be nullptr).
+    );
 
     //! Determines if a log level is enabled.
     //! @returns Returns true if `level` should be logged based on the current logging level.
     bool should_log(
         Level level  //!< [in] Log level to test.
     ) const {
-        return static_cast<uint_fast8_t>(level) <= static_cast<uint_fast8_t>(this->curr_level);
+        return static_cast<uint_fast8_t>(level) <=
+               static_cast<uint_fast8_t>(this->curr_level.load(std::memory_order_relaxed));
+    }
+
+    //! Determines if a message should be logged.
+    //! @details Messages which shouldn't be logged are counted as suppressed
+    //!          in the statistics.
+    //! @returns Returns true if `level` is enabled, and the filter (if any) allows the message.
+    bool should_log(
+        Level level,     //!< [in] Log level to test.
+        const char* fmt  //!< [in] Format string of the message.
+    ) const {
+        if (this->should_log(level)) {
+            Filter* filter = this->filter.load(std::memory_order_acquire);
+            if (filter == nullptr || filter->allow(level, fmt)) {
+                return true;
+            }
+        }
+        record_suppressed(level);
+        return false;
+    }
+
+    //! Returns a snapshot of the logging statistics.
+    //! @returns the statistics.
+    static LogStats stats();
+
+    //! Sets the filter used to decide whether individual messages are logged.
+    //! @details The filter isn't owned by the logger, and needs to outlive it.
+    void set_filter(
+        Filter* filter  //!< [in] Filter to use, or nullptr to log every message.
+    ) {
+        this->filter.store(filter, std::memory_order_release);
     }
 
     //! Returns the current logging level.
     //! @returns the current logging level.
-    Level get_level() const { return this->curr_level; }
+    Level get_level() const { return this->curr_level.load(std::memory_order_relaxed); }
 
     //! Sets the current logging level.
     void set_level(
         Level level  //!< [in] Level to set the current logging level to.
     ) {
-        this->curr_level = level;
+        this->curr_level.store(level, std::memory_order_relaxed);
     }
 
+    //! Waits until the messages logged so far are durable.
+    //! @details For file based loggers this flushes any buffered output and
+    //!          syncs the file to storage. The default does nothing, which
+    //!          suits loggers whose output is durable as soon as do_log()
+    //!          returns (or which have nowhere durable to put it).
+    virtual void sync() {}
+
+    //! Called (through pthread_atfork) on the current logger before the process forks.
+    //! @details Loggers which have locks, buffers or threads should flush
+    //!          their buffers and take their locks here, so that the child
+    //!          doesn't inherit a lock held by a thread which doesn't exist
+    //!          in it, or output which the parent will also write. Loggers
+    //!          which pass messages to another logger should pass the call on.
+    virtual void prepare_fork() {}
+
+    //! Called in the parent after the process forks. Releases what prepare_fork() took.
+    virtual void parent_after_fork() {}
+
+    //! Called in the child after the process forks.
+    //! @details Only the forking thread exists in the child, so loggers
+    //!          should release what prepare_fork() took, and re-create their
+    //!          threads (or stop using anything they can't share with the
+    //!          parent).
+    virtual void child_after_fork() {}
+
     //! Prints a debug level log.
     static void debug(
         const char* fmt,  //!< [in] printf style format string.
@@ -102,6 +283,214 @@ class Log {
         ...               //!< [in] varadic list of parameters
         ) __attribute__((format(printf, 1, 2)));
 
+    //! Determines if a message of the indicated level would be logged.
+    //! @details Only the level is checked (the filter is consulted by the
+    //!          logging calls themselves). See LOG_IF_ENABLED().
+    //! @returns true if there's a logger and `level` is enabled.
+    static bool enabled(
+        Level level  //!< [in] Log level to test.
+    );
+
+    //! Prints a debug level log whose arguments are only computed if it's logged.
+    //! @details `fn` is called once the level and filter checks have passed,
+    //!          and returns the argument for `fmt`, or a std::tuple of them,
+    //!          i.e. `Log::debug_lazy("Cache: %s", [&] { return cache.summary(); })`.
+    //!          std::string values are passed as C strings. Note that the
+    //!          compiler can't check the arguments against `fmt`.
+    template <typename Fn>
+    static void debug_lazy(
+        const char* fmt,  //!< [in] printf style format string.
+        Fn&& fn           //!< [in] Returns the arguments.
+    ) {
+        log_lazy(Level::DEBUG, fmt, std::forward<Fn>(fn));
+    }
+
+    //! Prints a debug level log whose message is only computed if it's logged.
+    //! @details `fn` returns the message (a std::string or C string). These
+    //!          messages all use the "%s" format string, so a filter treats
+    //!          them as a single call site.
+    template <typename Fn>
+    static void debug_lazy(
+        Fn&& fn  //!< [in] Returns the message.
+    ) {
+        log_lazy(Level::DEBUG, "%s", std::forward<Fn>(fn));
+    }
+
+    //! Prints an info level log whose arguments are only computed if it's logged.
+    template <typename Fn>
+    static void info_lazy(
+        const char* fmt,  //!< [in] printf style format string.
+        Fn&& fn           //!< [in] Returns the arguments.
+    ) {
+        log_lazy(Level::INFO, fmt, std::forward<Fn>(fn));
+    }
+
+    //! Prints an info level log whose message is only computed if it's logged.
+    template <typename Fn>
+    static void info_lazy(
+        Fn&& fn  //!< [in] Returns the message.
+    ) {
+        log_lazy(Level::INFO, "%s", std::forward<Fn>(fn));
+    }
+
+    //! Prints a warning level log whose arguments are only computed if it's logged.
+    template <typename Fn>
+    static void warning_lazy(
+        const char* fmt,  //!< [in] printf style format string.
+        Fn&& fn           //!< [in] Returns the arguments.
+    ) {
+        log_lazy(Level::WARNING, fmt, std::forward<Fn>(fn));
+    }
+
+    //! Prints a warning level log whose message is only computed if it's logged.
+    template <typename Fn>
+    static void warning_lazy(
+        Fn&& fn  //!< [in] Returns the message.
+    ) {
+        log_lazy(Level::WARNING, "%s", std::forward<Fn>(fn));
+    }
+
+    //! Prints an error level log whose arguments are only computed if it's logged.
+    template <typename Fn>
+    static void error_lazy(
+        const char* fmt,  //!< [in] printf style format string.
+        Fn&& fn           //!< [in] Returns the arguments.
+    ) {
+        log_lazy(Level::ERROR, fmt, std::forward<Fn>(fn));
+    }
+
+    //! Prints an error level log whose message is only computed if it's logged.
+    template <typename Fn>
+    static void error_lazy(
+        Fn&& fn  //!< [in] Returns the message.
+    ) {
+        log_lazy(Level::ERROR, "%s", std::forward<Fn>(fn));
+    }
+
+    //! Prints a fatal level log whose arguments are only computed if it's logged.
+    template <typename Fn>
+    static void fatal_lazy(
+        const char* fmt,  //!< [in] printf style format string.
+        Fn&& fn           //!< [in] Returns the arguments.
+    ) {
+        log_lazy(Level::FATAL, fmt, std::forward<Fn>(fn));
+    }
+
+    //! Prints a fatal level log whose message is only computed if it's logged.
+    template <typename Fn>
+    static void fatal_lazy(
+        Fn&& fn  //!< [in] Returns the message.
+    ) {
+        log_lazy(Level::FATAL, "%s", std::forward<Fn>(fn));
+    }
+
+    //! Logs a message of the indicated level whose arguments are only computed if it's logged.
+    //! @details See debug_lazy().
+    template <typename Fn>
+    static void log_lazy(
+        Level level,      //!< [in] Level associated with this message.
+        const char* fmt,  //!< [in] printf style format string.
+        Fn&& fn           //!< [in] Returns the arguments.
+    ) {
+        if constexpr (LOGGING_ENABLED) {
+            LazyArgsFn<Fn> args(fn);
+            log_lazy_args(level, fmt, &args);
+        }
+    }
+
+    //! Prints a structured debug level log.
+    //! @details Each field is created using kv(), i.e.
+    //!          `Log::debug_kv("Request done", kv("id", 42), kv("path", path))`
+    template <typename... Fields>
+    static void debug_kv(
+        const char* msg,         //!< [in] Message.
+        const Fields&... fields  //!< [in] Fields created using kv().
+    ) {
+        const KeyValue kvs[] = {fields..., KeyValue()};
+        log_kv(Level::DEBUG, msg, kvs, sizeof...(fields));
+    }
+
+    //! Prints a structured info level log.
+    template <typename... Fields>
+    static void info_kv(
+        const char* msg,         //!< [in] Message.
+        const Fields&... fields  //!< [in] Fields created using kv().
+    ) {
+        const KeyValue kvs[] = {fields..., KeyValue()};
+        log_kv(Level::INFO, msg, kvs, sizeof...(fields));
+    }
+
+    //! Prints a structured warning level log.
+    template <typename... Fields>
+    static void warning_kv(
+        const char* msg,         //!< [in] Message.
+        const Fields&... fields  //!< [in] Fields created using kv().
+    ) {
+        const KeyValue kvs[] = {fields..., KeyValue()};
+        log_kv(Level::WARNING, msg, kvs, sizeof...(fields));
+    }
+
+    //! Prints a structured error level log.
+    template <typename... Fields>
+    static void error_kv(
+        const char* msg,         //!< [in] Message.
+        const Fields&... fields  //!< [in] Fields created using kv().
+    ) {
+        const KeyValue kvs[] = {fields..., KeyValue()};
+        log_kv(Level::ERROR, msg, kvs, sizeof...(fields));
+    }
+
+    //! Prints a structured fatal level log.
+    template <typename... Fields>
+    static void fatal_kv(
+        const char* msg,         //!< [in] Message.
+        const Fields&... fields  //!< [in] Fields created using kv().
+    ) {
+        const KeyValue kvs[] = {fields..., KeyValue()};
+        log_kv(Level::FATAL, msg, kvs, sizeof...(fields));
+    }
+
+    //! Logs a structured message of the indicated level.
+    static void log_kv(
+        Level level,          //!< [in] Level associated with this message.
+        const char* msg,      //!< [in] Message.
+        const KeyValue* kvs,  //!< [in] Fields.
+        size_t num_kvs        //!< [in] Number of fields.
+    );
+
+    //! Encodes a structured message using logfmt.
+    //! @details Values containing spaces, quotes, '=' or control characters
+    //!          are quoted. Fields which don't fit are dropped, and the output
+    //!          is always null terminated.
+    //!          The fields of `context` (and the contexts enclosing it) are
+    //!          placed between the message and `kvs`.
+    //! @returns the length of the encoded message.
+    static size_t encode_logfmt(
+        char* out,                           //!< [out] Place to store the encoded message.
+        size_t maxLen,                       //!< [in] Size of `out`.
+        Level level,                         //!< [in] Level associated with this message.
+        const char* msg,                     //!< [in] Message.
+        const KeyValue* kvs,                 //!< [in] Fields.
+        size_t num_kvs,                      //!< [in] Number of fields.
+        const LogContext* context = nullptr  //!< [in] Context to include (see LogContext).
+    );
+
+    //! Encodes a structured message as a single line JSON object.
+    //! @details Fields which don't fit are dropped, so the output is always
+    //!          valid JSON unless `msg` itself doesn't fit.
+    //!          The fields of `context` (and the contexts enclosing it) are
+    //!          placed between the message and `kvs`.
+    //! @returns the length of the encoded message.
+    static size_t encode_json(
+        char* out,                           //!< [out] Place to store the encoded message.
+        size_t maxLen,                       //!< [in] Size of `out`.
+        Level level,                         //!< [in] Level associated with this message.
+        const char* msg,                     //!< [in] Message.
+        const KeyValue* kvs,                 //!< [in] Fields.
+        size_t num_kvs,                      //!< [in] Number of fields.
+        const LogContext* context = nullptr  //!< [in] Context to include (see LogContext).
+    );
+
     //! Logs a message of the indicated level using varadic arguments.
     static void log(
         Level level,      //!< [in] Level associated with this message.
@@ -116,6 +505,55 @@ class Log {
         va_list args      //!< [in] List of parameters
         ) __attribute__((format(printf, 2, 0)));
 
+    //! Logs a message, and calls `completion->complete()` once it's durable.
+    //! @details Only the level is checked: the filter isn't consulted, since
+    //!          messages which must be persisted shouldn't be rate limited.
+    //!          If the message isn't logged, complete() is called right away.
+    static void log_durable(
+        Completion* completion,  //!< [in] Notified once the message is durable.
+        Level level,             //!< [in] Level associated with this message.
+        const char* fmt,         //!< [in] printf style format string.
+        ...                      //!< [in] varadic list of parameters
+        ) __attribute__((format(printf, 3, 4)));
+
+    //! Logs a message using a va_list, and calls `completion->complete()` once it's durable.
+    static void vlog_durable(
+        Completion* completion,  //!< [in] Notified once the message is durable.
+        Level level,             //!< [in] Level associated with this message.
+        const char* fmt,         //!< [in] printf style format string.
+        va_list args             //!< [in] List of parameters
+        ) __attribute__((format(printf, 3, 0)));
+
+    //! Maximum length of a message logged by emergency(), including the
+    //! level prefix and newline (longer messages are truncated).
+    static constexpr size_t MAX_EMERGENCY_LEN = 256;
+
+    //! Logs a fatal message directly to the emergency file descriptor.
+    //! @details This is async-signal-safe, so it can be called from crash
+    //!          (i.e. SIGSEGV) handlers: the message is formatted into a stack
+    //!          buffer using vStrPrintf, and written with a single write(2)
+    //!          call. The current logger, level, filter, statistics and any
+    //!          queues or locks are bypassed, and errno is preserved.
+    static void emergency(
+        const char* fmt,  //!< [in] printf style format string.
+        ...               //!< [in] varadic list of parameters
+        ) __attribute__((format(printf, 1, 2)));
+
+    //! Logs a fatal message directly to the emergency file descriptor using a va_list.
+    static void vemergency(
+        const char* fmt,  //!< [in] printf style format string.
+        va_list args      //!< [in] List of parameters
+        ) __attribute__((format(printf, 1, 0)));
+
+    //! Sets the file descriptor that emergency() writes to (stderr by default).
+    //! @details This should be called before installing the signal handlers
+    //!          which use emergency(). The descriptor isn't owned by Log.
+    static void set_emergency_fd(
+        int fd  //!< [in] File descriptor to write to, or -1 to discard emergency messages.
+    ) {
+        emergency_fd.store(fd, std::memory_order_relaxed);
+    }
+
  public:
     //! Function which performs the actual logging.
     virtual void do_log(
@@ -124,6 +562,252 @@ class Log {
         va_list args      //!< [in] List of parameters
         ) __attribute__((format(printf, 3, 0))) = 0;
 
-    Level curr_level = Level::DEBUG;  //!< Current logging level.
-    static Log* logger;               //!< Pointer to the current logger.
+    //! Function which performs the actual logging of structured messages.
+    //! @details The default implementation encodes the message using
+    //!          `kv_format` and passes it to do_log(), which adds the calling
+    //!          thread's LogContext the same way as for any other message.
+    virtual void do_log_kv(
+        Level level,          //!< [in] Level associated with this message.
+        const char* msg,      //!< [in] Message.
+        const KeyValue* kvs,  //!< [in] Fields.
+        size_t num_kvs        //!< [in] Number of fields.
+    );
+
+    //! Function which logs a message and notifies `completion` once it's durable.
+    //! @details The default implementation calls do_log(), sync() and then
+    //!          `completion->complete()`.
+    virtual void do_log_durable(
+        Completion* completion,  //!< [in] Notified once the message is durable.
+        Level level,             //!< [in] Level associated with this message.
+        const char* fmt,         //!< [in] printf style format string.
+        va_list args             //!< [in] List of parameters
+        ) __attribute__((format(printf, 4, 0)));
+
+    //! Maximum length of an encoded structured message.
+    static constexpr size_t MAX_KV_LEN = 256;
+
+    //! Registers the pthread_atfork handlers which call prepare_fork() and
+    //! friends on the current logger (the first time it's called).
+    static void register_fork_handlers();
+
+    //! Constructs an object (i.e. a std::thread or std::condition_variable)
+    //! again in a child process, without destroying it first.
+    //! @details Their destructors may wait for (or try to join) threads which
+    //!          don't exist in the child, so the old object is just forgotten.
+    template <typename T>
+    static void reconstruct_in_child(
+        T* object  //!< [in] Object to construct again.
+    ) {
+        new (object) T();
+    }
+
+    //! Computes the arguments of a message logged by log_lazy().
+    class LazyArgs {
+     public:
+        //! Computes the arguments and logs the message to `logger`.
+        virtual void log(
+            Log* logger,     //!< [in] Logger to pass the message to.
+            Level level,     //!< [in] Level associated with this message.
+            const char* fmt  //!< [in] printf style format string.
+            ) = 0;
+    };
+
+    //! LazyArgs which calls a function to compute the arguments.
+    template <typename Fn>
+    class LazyArgsFn : public LazyArgs {
+     public:
+        //! Constructor.
+        explicit LazyArgsFn(
+            Fn& fn  //!< [in] Returns the arguments.
+            )
+            : m_fn{fn} {}
+
+        void log(Log* logger, Level level, const char* fmt) override {
+            const auto result = this->m_fn();
+            log_result(logger, level, fmt, result);
+        }
+
+     private:
+        //! Logs a message with the arguments in a tuple.
+        template <typename... Args>
+        static void log_result(Log* logger, Level level, const char* fmt, const std::tuple<Args...>& args) {
+            std::apply(
+                [&](const auto&... arg) { log_to(logger, level, fmt, lazy_arg(arg)...); }, args);
+        }
+
+        //! Logs a message with a single argument.
+        template <typename Arg>
+        static void log_result(Log* logger, Level level, const char* fmt, const Arg& arg) {
+            log_to(logger, level, fmt, lazy_arg(arg));
+        }
+
+        //! Converts an argument into something which can be passed to printf.
+        //! @returns the argument.
+        template <typename Arg>
+        static const Arg& lazy_arg(const Arg& arg) {
+            return arg;
+        }
+
+        //! Converts a string into something which can be passed to printf.
+        //! @returns the string as a C string.
+        static const char* lazy_arg(const std::string& arg) { return arg.c_str(); }
+
+        Fn& m_fn;  //!< Returns the arguments.
+    };
+
+    //! Logs a message whose arguments are computed by `args`, if it passes
+    //! the level and filter checks.
+    static void log_lazy_args(
+        Level level,      //!< [in] Level associated with this message.
+        const char* fmt,  //!< [in] printf style format string.
+        LazyArgs* args    //!< [in] Computes the arguments.
+    );
+
+    //! Passes a message to a particular logger (which has already decided to log it).
+    static void log_to(
+        Log* logger,      //!< [in] Logger to pass the message to.
+        Level level,      //!< [in] Level associated with this message.
+        const char* fmt,  //!< [in] printf style format string.
+        ...               //!< [in] varadic list of parameters
+        ) __attribute__((format(printf, 3, 4)));
+
+#if LOG_STATS_ENABLED
+    //! Records a suppressed message in the statistics.
+    static void record_suppressed(
+        Level level  //!< [in] Level of the message.
+    );
+#else
+    //! Records a suppressed message in the statistics.
+    static void record_suppressed(
+        Level level  //!< [in] Level of the message.
+    ) {
+        (void)level;
+    }
+#endif
+
+    std::atomic<KvFormat> kv_format{KvFormat::LOGFMT};  //!< Encoding used for structured messages.
+    std::atomic<Level> curr_level{Level::DEBUG};       //!< Current logging level.
+    std::atomic<Filter*> filter{nullptr};  //!< Filter applied to each message (may be nullptr).
+    static std::atomic<Log*> logger;       //!< Pointer to the current logger.
+    static std::atomic<int> emergency_fd;  //!< File descriptor emergency() writes to.
+
+#if LOG_COROUTINES_ENABLED
+    //! Awaitable returned by async_info() and friends.
+    //! @details The message is formatted when the awaiter is created. Awaiting
+    //!          it logs the message using log_durable(), and the coroutine is
+    //!          resumed once the message is durable. With AsyncLog, the
+    //!          coroutine is resumed on AsyncLog's background thread, so it
+    //!          should reschedule itself onto its executor if it has more than
+    //!          a little work to do. Otherwise the message is written (and
+    //!          synced) by the awaiting thread, and the coroutine continues
+    //!          without suspending.
+    class DurableAwaiter : public Completion {
+     public:
+        //! Maximum length of the message (including the terminating null).
+        static constexpr size_t MAX_MSG_LEN = 256;
+
+        //! Constructor.
+        DurableAwaiter(
+            Level level,      //!< [in] Level associated with this message.
+            const char* fmt,  //!< [in] printf style format string.
+            va_list args      //!< [in] List of parameters
+            ) __attribute__((format(printf, 3, 0)))
+            : m_level{level} {
+            size_t len = vStrPrintf(this->m_text, sizeof(this->m_text), fmt, args);
+            this->m_text[len] = '\0';
+        }
+
+        //! Move constructor (only valid before the awaiter is awaited).
+        DurableAwaiter(DurableAwaiter&& rhs) noexcept : m_level{rhs.m_level} {
+            memcpy(this->m_text, rhs.m_text, sizeof(this->m_text));
+        }
+
+        DurableAwaiter(const DurableAwaiter&) = delete;
+        DurableAwaiter& operator=(const DurableAwaiter&) = delete;
+
+        //! Always suspends, since logging may complete asynchronously.
+        bool await_ready() const noexcept { return false; }
+
+        //! Logs the message.
+        //! @returns true if the coroutine should stay suspended until complete() is called.
+        bool await_suspend(
+            std::coroutine_handle<> handle  //!< [in] The awaiting coroutine.
+        ) {
+            this->m_handle = handle;
+            log_durable(this, this->m_level, "%s", this->m_text);
+            return this->m_state.exchange(State::SUSPENDED, std::memory_order_acq_rel) !=
+                   State::DONE;
+        }
+
+        //! Called when the coroutine continues.
+        void await_resume() const noexcept {}
+
+        //! Resumes the coroutine, unless await_suspend() hasn't returned yet.
+        void complete() override {
+            if (this->m_state.exchange(State::DONE, std::memory_order_acq_rel) ==
+                State::SUSPENDED) {
+                this->m_handle.resume();
+            }
+        }
+
+     private:
+        //! Which of await_suspend() and complete() has finished first.
+        enum class State : uint8_t {
+            LOGGING,    //!< Neither.
+            SUSPENDED,  //!< await_suspend() has returned (so complete() resumes).
+            DONE,       //!< complete() has been called (so await_suspend() doesn't suspend).
+        };
+
+        std::atomic<State> m_state{State::LOGGING};  //!< See State.
+        Level m_level;                               //!< Level of the message.
+        std::coroutine_handle<> m_handle;            //!< The awaiting coroutine.
+        char m_text[MAX_MSG_LEN];                    //!< Formatted message.
+    };
+
+    //! Returns an awaitable which logs a debug level message (see DurableAwaiter).
+    //! @details i.e. `co_await Log::async_debug("Saved %d", id);`
+    static DurableAwaiter async_debug(
+        const char* fmt,  //!< [in] printf style format string.
+        ...               //!< [in] varadic list of parameters
+        ) __attribute__((format(printf, 1, 2)));
+
+    //! Returns an awaitable which logs an info level message.
+    static DurableAwaiter async_info(
+        const char* fmt,  //!< [in] printf style format string.
+        ...               //!< [in] varadic list of parameters
+        ) __attribute__((format(printf, 1, 2)));
+
+    //! Returns an awaitable which logs a warning level message.
+    static DurableAwaiter async_warning(
+        const char* fmt,  //!< [in] printf style format string.
+        ...               //!< [in] varadic list of parameters
+        ) __attribute__((format(printf, 1, 2)));
+
+    //! Returns an awaitable which logs an error level message.
+    static DurableAwaiter async_error(
+        const char* fmt,  //!< [in] printf style format string.
+        ...               //!< [in] varadic list of parameters
+        ) __attribute__((format(printf, 1, 2)));
+
+    //! Returns an awaitable which logs a fatal level message.
+    static DurableAwaiter async_fatal(
+        const char* fmt,  //!< [in] printf style format string.
+        ...               //!< [in] varadic list of parameters
+        ) __attribute__((format(printf, 1, 2)));
+
+    //! Returns an awaitable which logs a message of the indicated level.
+    static DurableAwaiter async_log(
+        Level level,      //!< [in] Level associated with this message.
+        const char* fmt,  //!< [in] printf style format string.
+        ...               //!< [in] varadic list of parameters
+        ) __attribute__((format(printf, 2, 3)));
+#endif
 };
+
+//! Runs the following statement (or block) only if a message of `level` would be logged.
+//! @details Use this around code which computes values that are only used for
+//!          logging, i.e. `LOG_IF_ENABLED(Log::Level::DEBUG) { ... }`. The
+//!          statement is removed entirely when DISABLE_LOGGING is defined.
+#define LOG_IF_ENABLED(level) \
+    if (!(LOGGING_ENABLED && Log::enabled(level))) { \
+    } else
@@ -0,0 +1,130 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   LogContext.h
+ *
+ *   @brief  Per-thread context fields which are attached to each message.
+ *
+ ****************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#include "duino_log/KeyValue.h"
+
+//! A scoped context field (i.e. a thread name or request ID) which is attached
+//! to every message logged by the thread which created it.
+//! @details Creating a LogContext pushes it onto the calling thread's context
+//!          stack, and destroying it pops it again, so it's normally a local
+//!          variable:
+//!
+//!              LogContext ctx("req", request_id);
+//!              Log::info("Started");   // [I] req=42 Started
+//!
+//!          The field is rendered (using logfmt) and appended to the prefix
+//!          of the enclosing context once, when the context is created, so
+//!          logging calls don't do any extra formatting. Sinks read the
+//!          prefix of current() by pointer, and sinks which output messages
+//!          later, or from another thread, copy it into a Snapshot.
+//!
+//!          String values are copied (up to MAX_VALUE_LEN - 1 characters).
+//!          Fields which don't fit in the prefix are left out of it, but are
+//!          still passed to the structured (key/value) encoders.
+class LogContext {
+ public:
+    //! Maximum length of the prefix, including the terminating null.
+    static constexpr size_t MAX_PREFIX_LEN = 128;
+
+    //! Maximum length of a string value, including the terminating null.
+    static constexpr size_t MAX_VALUE_LEN = 48;
+
+    //! Constructor. Pushes the context onto the calling thread's stack.
+    explicit LogContext(
+        const KeyValue& field  //!< [in] Field to attach, created using kv().
+    );
+
+    //! Constructor. Pushes the context onto the calling thread's stack.
+    template <typename T>
+    LogContext(
+        const char* key,  //!< [in] Name of the field.
+        const T& value    //!< [in] Value of the field (any type accepted by kv()).
+        )
+        : LogContext(kv(key, value)) {}
+
+    //! Destructor. Pops the context off the calling thread's stack.
+    ~LogContext();
+
+    LogContext(const LogContext&) = delete;
+    LogContext& operator=(const LogContext&) = delete;
+
+    //! Returns the innermost context of the calling thread.
+    //! @returns the context, or nullptr if the thread doesn't have one.
+    static const LogContext* current();
+
+    //! Copies the prefix of the calling thread's context.
+    //! @details The copy isn't null terminated.
+    //! @returns the number of characters copied.
+    static size_t copy_prefix(
+        char* out,     //!< [out] Place to copy the prefix to.
+        size_t maxLen  //!< [in] Maximum number of characters to copy.
+    );
+
+    //! Returns the enclosing context.
+    //! @returns the context, or nullptr if this is the outermost context.
+    const LogContext* parent() const { return this->m_parent; }
+
+    //! Returns the field attached by this context.
+    //! @returns the field.
+    const KeyValue& field() const { return this->m_field; }
+
+    //! Returns the rendered fields of this context and the contexts enclosing it.
+    //! @details i.e. `thread=worker1 req=42 ` (outermost first, each followed by a space).
+    //! @returns the null terminated prefix.
+    const char* prefix() const { return this->m_prefix; }
+
+    //! Returns the length of prefix().
+    //! @returns the length of the prefix.
+    size_t prefix_len() const { return this->m_prefix_len; }
+
+    //! Copy of a context's prefix, which remains valid after the context is destroyed.
+    struct Snapshot {
+        //! Copies the prefix of a context.
+        void capture(
+            const LogContext* context  //!< [in] Context to copy (may be nullptr).
+        ) {
+            this->len = context != nullptr ? context->m_prefix_len : 0;
+            memcpy(this->prefix, context != nullptr ? context->m_prefix : "", this->len + 1);
+        }
+
+        //! Determines if the snapshot has the same prefix as a context.
+        //! @returns true if the prefixes are the same.
+        bool matches(
+            const LogContext* context  //!< [in] Context to compare with (may be nullptr).
+        ) const {
+            if (context == nullptr) {
+                return this->len == 0;
+            }
+            return this->len == context->m_prefix_len &&
+                   memcmp(this->prefix, context->m_prefix, this->len) == 0;
+        }
+
+        size_t len = 0;                     //!< Length of `prefix`.
+        char prefix[MAX_PREFIX_LEN] = {};  //!< Null terminated prefix.
+    };
+
+ private:
+    const LogContext* m_parent;    //!< Enclosing context.
+    KeyValue m_field;              //!< Field attached by this context.
+    size_t m_prefix_len;           //!< Length of m_prefix.
+    char m_value[MAX_VALUE_LEN];   //!< Copy of a string value.
+    char m_prefix[MAX_PREFIX_LEN];  //!< Rendered fields of this and the enclosing contexts.
+};
@@ -0,0 +1,207 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   LogStats.h
+ *
+ *   @brief  Statistics about the logging hot path.
+ *
+ ****************************************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include "duino_log/Log.h"
+
+#if LOG_STATS_ENABLED
+#include <unistd.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+//! Latency histogram with logarithmic buckets.
+//! @details Like an HDR histogram, each power of two is split into 4 linear
+//!          sub-buckets, so values are recorded with a resolution of 25%
+//!          over the full 64-bit range.
+struct LogHistogram {
+    //! Number of bits used to select a sub-bucket.
+    static constexpr uint32_t SUB_BUCKET_BITS = 2;
+
+    //! Number of sub-buckets in each power of two.
+    static constexpr uint32_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+    //! Number of buckets.
+    static constexpr size_t NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    //! Returns the bucket a value belongs to.
+    //! @returns the index of the bucket.
+    static size_t bucket(
+        uint64_t value  //!< [in] Value to find the bucket for.
+    );
+
+    //! Returns the smallest value which belongs to a bucket.
+    //! @returns the value.
+    static uint64_t bucket_min(
+        size_t bucket  //!< [in] Index of the bucket.
+    );
+
+    //! Returns the number of values recorded.
+    //! @returns the number of values.
+    uint64_t total() const;
+
+    //! Returns the value below which a given percentage of the recorded values fall.
+    //! @returns the lower bound of the bucket containing the percentile, or 0
+    //!          if nothing has been recorded.
+    uint64_t percentile(
+        double percent  //!< [in] Percentile (0 to 100) to return.
+    ) const;
+
+    //! Returns (the lower bound of) the largest value recorded.
+    //! @returns the value.
+    uint64_t max() const;
+
+    uint64_t counts[NUM_BUCKETS] = {};  //!< Number of values in each bucket.
+};
+
+//! Snapshot of the logging statistics, as returned by Log::stats().
+//! @details Statistics are recorded per thread without locks, and summed
+//!          when the snapshot is taken (including threads which have exited).
+//!          Define DISABLE_LOG_STATS to compile the instrumentation out, in
+//!          which case the snapshot is all zeros.
+struct LogStats {
+    //! Number of logging levels.
+    static constexpr size_t NUM_LEVELS = static_cast<size_t>(Log::Level::DEBUG) + 1;
+
+    //! Latencies which are recorded.
+    enum class Timer : uint8_t {
+        TOTAL,   //!< Time spent in do_log (or do_log_kv), for all loggers.
+        FORMAT,  //!< Time spent formatting a line (LineLog based loggers).
+        WRITE,   //!< Time spent in write_line (LineLog based loggers).
+        STALL,   //!< Time spent waiting for room in a full queue (every stall is recorded).
+    };
+
+    //! Number of timers.
+    static constexpr size_t NUM_TIMERS = 4;
+
+    //! Writes a one line summary of the statistics.
+    //! @returns the length of the summary.
+    size_t format(
+        char* out,     //!< [out] Place to store the summary.
+        size_t maxLen  //!< [in] Size of `out`.
+    ) const;
+
+    //! Returns the histogram for a timer.
+    //! @returns the histogram.
+    const LogHistogram& latency(
+        Timer timer  //!< [in] Timer to return the histogram for.
+    ) const {
+        return this->latency_ns[static_cast<size_t>(timer)];
+    }
+
+    uint64_t messages[NUM_LEVELS] = {};    //!< Messages passed to the logger.
+    uint64_t suppressed[NUM_LEVELS] = {};  //!< Messages suppressed by the level or filter.
+    uint64_t dropped[NUM_LEVELS] = {};     //!< Messages dropped by the logger.
+    uint64_t bytes = 0;                    //!< Bytes formatted.
+    uint64_t truncated = 0;                //!< Messages which filled the line buffer.
+    LogHistogram latency_ns[NUM_TIMERS];   //!< Sampled latencies (in nsec) for each timer.
+
+    //! Operations are timed one in this many times (per thread and timer),
+    //! which keeps reading the clock off the path of most messages. Stalls
+    //! are already slow, so they're always timed.
+    static constexpr uint32_t LATENCY_SAMPLE_INTERVAL = 16;
+
+    //! Returns the current time.
+    //! @returns the time in nsec.
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    //! Starts timing an operation, if it's been selected for sampling.
+    //! @returns the time in nsec, or 0 if the operation isn't being timed.
+    static uint64_t start(
+        Timer timer  //!< [in] Timer to start.
+    );
+
+    //! Records a message which was passed to the logger.
+    static void record_message(
+        Log::Level level,  //!< [in] Level of the message.
+        uint64_t start     //!< [in] Value returned by start(Timer::TOTAL).
+    );
+
+    //! Records a message which was suppressed.
+    static void record_suppressed(
+        Log::Level level  //!< [in] Level of the message.
+    );
+
+    //! Records a message which was dropped by the logger.
+    static void record_dropped(
+        Log::Level level  //!< [in] Level of the message.
+    );
+
+    //! Records a formatted line.
+    static void record_line(
+        size_t len,     //!< [in] Length of the line.
+        bool truncated  //!< [in] true if the line filled the buffer.
+    );
+
+    //! Records the latency of an operation which has just finished.
+    static void record_latency(
+        Timer timer,    //!< [in] Timer to record.
+        uint64_t start  //!< [in] Value returned by start().
+    );
+
+    //! Takes the lock protecting the list of threads, before the process forks.
+    //! @details Called by the pthread_atfork handlers (see Log::prepare_fork()).
+    static void prepare_fork();
+
+    //! Releases the lock in the parent after the process forks.
+    static void parent_after_fork();
+
+    //! Releases the lock in the child after the process forks, and retires
+    //! the statistics of the threads which weren't copied into it.
+    static void child_after_fork();
+};
+
+#if LOG_STATS_ENABLED
+
+//! Periodically writes a summary of Log::stats() to a file descriptor.
+//! @details It's compiled out along with the statistics (see DISABLE_LOG_STATS).
+class LogStatsDumper {
+ public:
+    //! Constructor. Starts the thread which writes the summaries.
+    explicit LogStatsDumper(
+        std::chrono::milliseconds interval,  //!< [in] Time between summaries.
+        int fd = STDERR_FILENO               //!< [in] File descriptor to write to.
+    );
+
+    //! Destructor. Stops the thread.
+    ~LogStatsDumper();
+
+    //! Writes a summary now.
+    void dump() const;
+
+ private:
+    //! Thread which writes the summaries.
+    void run();
+
+    std::chrono::milliseconds m_interval;  //!< Time between summaries.
+    int m_fd;                              //!< File descriptor to write to.
+    std::mutex m_mutex;                    //!< Protects m_stop.
+    std::condition_variable m_cv;          //!< Used to wake the thread.
+    bool m_stop = false;                   //!< Set to stop the thread.
+    std::thread m_thread;                  //!< Thread which writes the summaries.
+};
+
+#endif  // LOG_STATS_ENABLED
@@ -0,0 +1,147 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   MmapFileLog.h
+ *
+ *   @brief  Logger which appends to a memory mapped file.
+ *
+ ****************************************************************************/
+
+#pragma once
+
+#if defined(__linux__)
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include "duino_log/LineLog.h"
+
+//! Logger which appends lines to a file by copying them into a memory mapping.
+//! @details The file is preallocated and mapped a window at a time. Each line
+//!          reserves space by atomically advancing a shared cursor, and is then
+//!          copied directly into the mapping, so no system calls are made until
+//!          the window is exhausted and the next one is mapped.
+//!
+//!          The file is truncated to the length of the data when the logger is
+//!          destroyed. If the process crashes, the file will be followed by the
+//!          zero filled remainder of the preallocated window, and a line which
+//!          was being copied at the time of the crash may also be zero filled.
+//!          Readers should ignore null characters (i.e. `tr -d '\0'`). When an
+//!          existing file is opened, logging resumes after the last non-null
+//!          character.
+//!
+//!          Only available on Linux.
+class MmapFileLog : public LineLog {
+ public:
+    //! Controls when the mapped data is flushed to the file with msync.
+    enum class SyncPolicy : uint8_t {
+        NONE,    //!< Leave it up to the kernel's normal writeback.
+        WINDOW,  //!< Start writeback (MS_ASYNC) of each window when it's unmapped.
+        ERROR,   //!< Same as WINDOW, and wait for ERROR and FATAL lines to be written.
+        LINE,    //!< Wait for every line to be written (slow).
+    };
+
+    //! Default size of the mapped window.
+    static constexpr size_t DEFAULT_WINDOW_SIZE = 1024 * 1024;
+
+    //! Constructor.
+    explicit MmapFileLog(
+        const char* path,                            //!< [in] Path of the log file.
+        size_t window_size = DEFAULT_WINDOW_SIZE,    //!< [in] Size of each mapped window.
+        SyncPolicy sync_policy = SyncPolicy::WINDOW  //!< [in] When to call msync.
+    );
+
+    //! Destructor.
+    ~MmapFileLog() override;
+
+    //! Determines if the log file was opened and mapped successfully.
+    //! @returns true if the log file is open.
+    bool is_open() const { return this->m_window.load(std::memory_order_acquire) != nullptr; }
+
+    //! Returns the amount of data in the log file.
+    //! @returns the offset that the next line will be written at.
+    uint64_t size() const { return this->m_cursor.load(std::memory_order_relaxed); }
+
+    //! Waits for everything logged so far to be written to the file.
+    void sync() override;
+
+    //! Takes the lock which serializes remapping.
+    void prepare_fork() override;
+
+    //! Releases the lock.
+    void parent_after_fork() override;
+
+    //! Unmaps and closes the file in the child.
+    //! @details The parent allocates space in the file using a cursor which
+    //!          the child can't share, so the child stops logging to it. A
+    //!          child which wants to log should install its own logger.
+    void child_after_fork() override;
+
+ protected:
+    //! Copies a line into the mapped file.
+    void write_line(
+        Level level,       //!< [in] Logging level associated with this line.
+        const char* line,  //!< [in] Formatted line, including the trailing newline.
+        size_t len         //!< [in] Length of `line`.
+        ) override;
+
+ private:
+    //! A mapped region of the file.
+    struct Window {
+        char* base = nullptr;             //!< Address the window is mapped at.
+        uint64_t start = 0;               //!< File offset of the start of the window.
+        uint64_t end = 0;                 //!< File offset of the end of the window.
+        std::atomic<uint32_t> users{0};  //!< Number of writers using the window.
+    };
+
+    //! Returns the current window, with its user count incremented.
+    //! @returns the current window.
+    Window* acquire_window();
+
+    //! Maps a window starting at `offset`, preallocating the file as needed.
+    //! @returns true if the window was mapped successfully.
+    bool map_window(
+        Window* window,  //!< [in] Window to map.
+        uint64_t offset  //!< [in] File offset to map (rounded down to a page).
+    );
+
+    //! Unmaps a window once nobody is using it.
+    void unmap_window(
+        Window* window  //!< [in] Window to unmap.
+    );
+
+    //! Writes a line which doesn't fit in the current window.
+    void write_slow(
+        Level level,       //!< [in] Logging level associated with this line.
+        uint64_t offset,   //!< [in] File offset reserved for the line.
+        const char* line,  //!< [in] Line to write.
+        size_t len         //!< [in] Length of `line`.
+    );
+
+    //! Performs the per line msync required by the sync policy.
+    void sync_line(
+        Level level,     //!< [in] Logging level associated with this line.
+        char* dst,       //!< [in] Address the line was copied to.
+        size_t len       //!< [in] Length of the line.
+    );
+
+    int m_fd = -1;              //!< File being logged to.
+    size_t m_window_size;       //!< Size of each window (a multiple of the page size).
+    size_t m_page_size;         //!< System page size.
+    SyncPolicy m_sync_policy;   //!< When to call msync.
+
+    std::atomic<uint64_t> m_cursor{0};        //!< Offset that the next line is written at.
+    Window m_windows[2];                      //!< Current and previous windows.
+    std::atomic<Window*> m_window{nullptr};  //!< The current window.
+    std::mutex m_remap_mutex;                 //!< Serializes remapping.
+};
+
+#endif  // defined(__linux__)
@@ -0,0 +1,82 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   RateLimitFilter.h
+ *
+ *   @brief  Filter which limits the rate of messages from each call site.
+ *
+ ****************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "duino_log/Log.h"
+
+//! Filter which applies a token bucket to each call site.
+//! @details Call sites are identified by their format string pointer, and
+//!          each gets its own bucket, so a chatty call site doesn't suppress
+//!          messages from other call sites. Limits are configured per level,
+//!          and levels without a limit aren't checked at all.
+//!
+//!          The buckets are kept in a fixed size, lock-free hash table. Each
+//!          bucket is a single atomic "theoretical arrival time" (the GCRA form
+//!          of a token bucket), so checking a message is a hash lookup, a clock
+//!          read and a compare-and-swap. If the table fills up, messages from
+//!          call sites which don't fit are allowed.
+//!
+//!          Usage: `log.set_filter(&rate_limit_filter)`.
+class RateLimitFilter : public Log::Filter {
+ public:
+    //! Number of call sites which can be tracked.
+    static constexpr size_t NUM_SLOTS = 1024;
+
+    //! Sets the limit for a level.
+    //! @details Each call site may log `burst` messages back to back, and
+    //!          `per_sec` messages per second after that. A `per_sec` of 0
+    //!          removes the limit.
+    void set_limit(
+        Log::Level level,  //!< [in] Level to set the limit for.
+        uint32_t per_sec,  //!< [in] Sustained number of messages per second.
+        uint32_t burst     //!< [in] Number of messages allowed back to back (at least 1).
+    );
+
+    //! Determines if a message should be logged.
+    //! @returns true if the call site's bucket isn't empty.
+    bool allow(Log::Level level, const char* fmt) override;
+
+    //! Returns the number of messages which have been suppressed.
+    //! @returns the number of messages.
+    uint64_t num_suppressed() const { return this->m_num_suppressed.load(std::memory_order_relaxed); }
+
+ private:
+    //! Bucket for a single call site.
+    struct Slot {
+        std::atomic<const char*> fmt{nullptr};  //!< Format string which owns this slot.
+        std::atomic<int64_t> tat{0};            //!< Theoretical arrival time (nsec).
+    };
+
+    //! Limit for a single level.
+    struct Limit {
+        std::atomic<int64_t> interval{0};   //!< Time (nsec) per message, or 0 if not limited.
+        std::atomic<int64_t> tolerance{0};  //!< How far (nsec) ahead `tat` may get.
+    };
+
+    //! Finds (or claims) the slot for a format string.
+    //! @returns the slot, or nullptr if the table is full.
+    Slot* find_slot(
+        const char* fmt  //!< [in] Format string to find the slot for.
+    );
+
+    Limit m_limits[static_cast<size_t>(Log::Level::DEBUG) + 1];  //!< Limit for each level.
+    Slot m_slots[NUM_SLOTS];                                      //!< Hash table of buckets.
+    std::atomic<uint64_t> m_num_suppressed{0};  //!< Number of suppressed messages.
+};
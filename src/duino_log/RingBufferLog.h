@@ -0,0 +1,114 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   RingBufferLog.h
+ *
+ *   @brief  Logger which keeps the most recent lines in memory.
+ *
+ ****************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "duino_log/LineLog.h"
+
+//! Flight recorder which keeps the most recent lines in a circular buffer.
+//! @details Nothing is written out during normal operation. Each line reserves
+//!          space by atomically advancing a cursor and is then copied into the
+//!          buffer, so logging is a single memcpy with no locks or system calls.
+//!
+//!          The buffer is written to `dump_fd` when a FATAL message is logged,
+//!          when dump() is called, and (once install_crash_handlers() has been
+//!          called) when the process receives a crash signal. Dumping only uses
+//!          async-signal-safe calls. A line which is being copied while the
+//!          buffer is dumped may appear garbled.
+//!
+//!          Dumping to a file descriptor and the crash handlers are only
+//!          available on POSIX systems. Elsewhere, the buffer can be read
+//!          out by passing a DumpFunc to dump().
+class RingBufferLog : public LineLog {
+ public:
+    //! Function which is passed the contents of the buffer by dump().
+    using DumpFunc = void (*)(void* param, const char* data, size_t len);
+
+    //! Default size of the buffer.
+    static constexpr size_t DEFAULT_SIZE = 64 * 1024;
+
+    //! Constructor.
+    //! @details The size is rounded up to a power of two which is at least MAX_LINE_LEN.
+    explicit RingBufferLog(
+        size_t size = DEFAULT_SIZE,  //!< [in] Size of the buffer.
+        int dump_fd = 2              //!< [in] File descriptor to dump to (stderr).
+    );
+
+    //! Destructor.
+    ~RingBufferLog() override;
+
+    //! Returns the size of the buffer.
+    //! @returns the size of the buffer.
+    size_t size() const { return this->m_mask + 1; }
+
+    //! Returns the total number of bytes logged.
+    //! @returns the number of bytes logged.
+    uint64_t bytes_logged() const { return this->m_head.load(std::memory_order_relaxed); }
+
+    //! Passes the contents of the buffer (oldest line first) to `func`.
+    //! @details `func` is called once, or twice if the contents wrap around
+    //!          the end of the buffer. This is async-signal-safe if `func` is.
+    void dump(
+        DumpFunc func,  //!< [in] Function to pass the contents to.
+        void* param     //!< [in] Parameter passed to `func`.
+    ) const;
+
+#if defined(__unix__) || defined(__APPLE__)
+    //! Writes the contents of the buffer (oldest line first) to `dump_fd`.
+    //! @details This is async-signal-safe.
+    void dump() const { this->dump(this->m_dump_fd); }
+
+    //! Writes the contents of the buffer (oldest line first) to a file descriptor.
+    //! @details This is async-signal-safe.
+    void dump(
+        int fd  //!< [in] File descriptor to write to.
+    ) const;
+
+    //! Dumps the buffer when the process receives SIGSEGV, SIGABRT, SIGBUS, SIGILL or SIGFPE.
+    //! @details After dumping, the previous handler is restored and the signal
+    //!          is raised again. Only one RingBufferLog can have the handlers
+    //!          installed, and they're removed by the destructor.
+    //! @returns true if the handlers were installed.
+    bool install_crash_handlers();
+#endif
+
+ protected:
+    //! Copies a line into the buffer.
+    void write_line(
+        Level level,       //!< [in] Logging level associated with this line.
+        const char* line,  //!< [in] Formatted line, including the trailing newline.
+        size_t len         //!< [in] Length of `line`.
+        ) override;
+
+ private:
+#if defined(__unix__) || defined(__APPLE__)
+    //! Removes the crash handlers, if this logger installed them.
+    void remove_crash_handlers();
+
+    //! Signal handler used for crash signals.
+    static void crash_handler(
+        int sig  //!< [in] Signal which was received.
+    );
+#endif
+
+    char* m_buf;                         //!< The circular buffer.
+    size_t m_mask;                       //!< Size of the buffer minus 1.
+    int m_dump_fd;                       //!< File descriptor to dump to.
+    std::atomic<uint64_t> m_head{0};  //!< Total number of bytes reserved.
+};
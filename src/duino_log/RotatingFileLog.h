@@ -0,0 +1,148 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   RotatingFileLog.h
+ *
+ *   @brief  Logger which writes to a file which is rotated by size or age.
+ *
+ ****************************************************************************/
+
+#pragma once
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "duino_log/LineLog.h"
+
+//! Codec used to compress rotated log files.
+struct RotatingFileCodec {
+    const char* ext;  //!< Extension added to compressed files (i.e. ".gz").
+
+    //! Compresses the file `src` into the file `dst`.
+    //! @returns true if the file was compressed successfully.
+    bool (*compress)(const char* src, const char* dst);
+};
+
+//! Logger which writes to a file and rotates it based on size and/or age.
+//! @details When the file is rotated, `path` is renamed to `path.1`, `path.1`
+//!          to `path.2` and so on, keeping `num_generations` rotated files.
+//!
+//!          The file that will become the next `path` is opened ahead of time
+//!          (as `path.next`) by a background thread, so rotating is just
+//!          swapping file descriptors. The background thread then closes the
+//!          old file, renames the generations and optionally compresses the
+//!          file that was just rotated. Logging never waits for any of this.
+//!          If the background thread hasn't finished with the previous
+//!          rotation, the current file keeps growing until it has.
+//!
+//!          If the process crashes after rotating to `path.next` but before
+//!          it's renamed, the rotation is finished when the log is next
+//!          opened, rather than losing the lines in `path.next`.
+//!
+//!          Only available on POSIX systems.
+class RotatingFileLog : public LineLog {
+ public:
+#if defined(DUINO_LOG_ZLIB)
+    //! Codec which gzips rotated files (requires linking with -lz).
+    static const RotatingFileCodec gzip_codec;
+#endif
+
+    //! Constructor.
+    RotatingFileLog(
+        const char* path,                          //!< [in] Path of the log file.
+        size_t max_bytes,                          //!< [in] Rotate at this size (0 = never).
+        unsigned num_generations,                  //!< [in] Number of rotated files to keep.
+        time_t max_age_secs = 0,                   //!< [in] Rotate at this age (0 = never).
+        const RotatingFileCodec* codec = nullptr  //!< [in] Codec for rotated files, or nullptr.
+    );
+
+    //! Destructor.
+    ~RotatingFileLog() override;
+
+    //! Determines if the log file was opened successfully.
+    //! @returns true if the log file is open.
+    bool is_open() const { return this->m_fd >= 0; }
+
+    //! Returns the number of rotations that have been completed.
+    //! @returns the number of completed rotations.
+    uint32_t num_rotations() const {
+        return this->m_num_rotations.load(std::memory_order_acquire);
+    }
+
+    //! Syncs the current log file to storage.
+    void sync() override;
+
+    //! Takes the lock which serializes writes.
+    void prepare_fork() override;
+
+    //! Releases the lock.
+    void parent_after_fork() override;
+
+    //! Releases the lock, and stops rotating in the child.
+    //! @details Only the parent rotates the file (the child's renames would
+    //!          race with it), so the child keeps appending to the file which
+    //!          was current when it forked.
+    void child_after_fork() override;
+
+ protected:
+    //! Writes a line to the current log file, rotating first if needed.
+    void write_line(
+        Level level,       //!< [in] Logging level associated with this line.
+        const char* line,  //!< [in] Formatted line, including the trailing newline.
+        size_t len         //!< [in] Length of `line`.
+        ) override;
+
+ private:
+    //! Entry point for the background thread.
+    void background();
+
+    //! Renames the generations and compresses the file that was just rotated.
+    void rotate_files();
+
+    //! Finishes a rotation which was interrupted by a crash, leaving `path.next` behind.
+    void recover_next();
+
+    //! Returns the name of rotated generation `gen`.
+    //! @returns the name of the file.
+    std::string generation_name(
+        unsigned gen,    //!< [in] Generation number.
+        bool compressed  //!< [in] Add the codec extension.
+    ) const;
+
+    std::string m_path;                //!< Path of the log file.
+    std::string m_next_path;           //!< Path of the pre-opened next file.
+    size_t m_max_bytes;                //!< Size to rotate at.
+    unsigned m_num_generations;        //!< Number of generations to keep.
+    time_t m_max_age_secs;             //!< Age to rotate at.
+    const RotatingFileCodec* m_codec;  //!< Codec used to compress rotated files.
+
+    std::mutex m_write_mutex;  //!< Serializes writes and swapping files.
+    int m_fd = -1;             //!< File currently being written to.
+    size_t m_size = 0;         //!< Number of bytes in the current file.
+    time_t m_open_time = 0;    //!< Time the current file was started.
+
+    std::atomic<int> m_next_fd{-1};     //!< Pre-opened next file (-1 when not ready).
+    std::atomic<int> m_retired_fd{-1};  //!< Rotated file for the background thread to close.
+    std::atomic<uint32_t> m_num_rotations{0};  //!< Number of completed rotations.
+
+    std::mutex m_bg_mutex;            //!< Protects the background thread's condition.
+    std::condition_variable m_bg_cv;  //!< Used to wake up the background thread.
+    std::atomic<bool> m_stop{false};   //!< Tells the background thread to exit.
+    std::thread m_thread;              //!< Background thread.
+};
+
+#endif  // defined(__unix__) || defined(__APPLE__)
@@ -0,0 +1,93 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   SamplingFilter.h
+ *
+ *   @brief  Filter which logs a random sample of messages.
+ *
+ ****************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "duino_log/Log.h"
+
+//! Filter which logs a random sample of the messages of each level.
+//! @details The decision uses a per-thread xorshift generator, so it's a few
+//!          instructions with no shared state, and is made before the message
+//!          is formatted. The number of messages which were sampled out is
+//!          counted per level, so the true volume can be estimated from the
+//!          logged messages.
+//!
+//!          Messages which are sampled in are passed on to `next` (if any),
+//!          so sampling can be combined with another filter, i.e. a
+//!          RateLimitFilter.
+class SamplingFilter : public Log::Filter {
+ public:
+    //! Constructor.
+    explicit SamplingFilter(
+        Log::Filter* next = nullptr  //!< [in] Filter to apply to sampled in messages.
+        )
+        : m_next(next) {}
+
+    //! Logs, on average, one in `n` messages of a level.
+    //! @details An `n` of 0 or 1 logs every message.
+    void set_one_in(
+        Log::Level level,  //!< [in] Level to set the sampling rate for.
+        uint32_t n         //!< [in] Sampling rate.
+    );
+
+    //! Logs a percentage of the messages of a level.
+    void set_percent(
+        Log::Level level,  //!< [in] Level to set the sampling rate for.
+        double percent     //!< [in] Percentage of messages to log (0 to 100).
+    );
+
+    //! Returns the fraction of the messages of a level which are logged.
+    //! @returns the fraction, between 0 and 1.
+    double sample_rate(
+        Log::Level level  //!< [in] Level to return the sampling rate for.
+    ) const;
+
+    //! Determines if a message should be logged.
+    //! @returns true if the message was sampled in (and allowed by `next`).
+    bool allow(Log::Level level, const char* fmt) override;
+
+    //! Returns the number of messages of a level which were sampled out.
+    //! @returns the number of messages.
+    uint64_t num_sampled_out(
+        Log::Level level  //!< [in] Level to return the count for.
+    ) const;
+
+ private:
+    //! Number of levels.
+    static constexpr size_t NUM_LEVELS = static_cast<size_t>(Log::Level::DEBUG) + 1;
+
+    //! Number of sets of counters. Threads are spread across them to avoid
+    //! contending for a single cache line.
+    static constexpr size_t NUM_STRIPES = 16;
+
+    //! Value of `m_threshold` which logs every message.
+    static constexpr uint64_t ALL = 1ULL << 32;
+
+    //! Sampled out counters used by a group of threads.
+    struct alignas(64) Stripe {
+        std::atomic<uint64_t> sampled_out[NUM_LEVELS] = {};  //!< Counter for each level.
+    };
+
+    Log::Filter* m_next;  //!< Filter to apply to sampled in messages.
+
+    //! A message is logged if a 32-bit random number is less than this.
+    std::atomic<uint64_t> m_threshold[NUM_LEVELS] = {ALL, ALL, ALL, ALL, ALL, ALL};
+
+    Stripe m_stripes[NUM_STRIPES];  //!< Sampled out counters.
+};
@@ -27,8 +27,10 @@
 
 // ---- Include Files -------------------------------------------------------
 
-#include <stddef.h>
 #include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 #if defined(__cplusplus)
@@ -54,7 +56,10 @@ using StrXPrintfFunc = size_t (*)(void* outParm, char ch);
 
 //! Bounded variant of strcpy.
 //! @details Copies `src` to `dst` but ensures that `dst` (including the
-//!          terminating null character) doesn't exceed `maxLen`.
+//!          terminating null character) doesn't exceed `maxLen`. Unlike
+//!          strncpy, only the characters copied (and the terminating null)
+//!          are written, and the last byte of `dst` is only written when the
+//!          string fills the buffer, so it can be used as a sentinel.
 //! @returns a pointer to `dst`
 char* StrMaxCpy(
     char* dst,        //!< [out] Place to store destination string.
@@ -72,6 +77,59 @@ char* StrMaxCat(
     size_t maxLen     //!< [in] Maximum lengh of `dst` (including the terminating null)
 );
 
+//! Bounded variant of strcpy which returns the length of the result.
+//! @details Same as StrMaxCpy(), except that the length is returned.
+//! @returns the length of the string stored in `dst` (not including the
+//!          terminating null character).
+size_t StrMaxCpyLen(
+    char* dst,        //!< [out] Place to store destination string.
+    const char* src,  //!< [in] Source string to copy.
+    size_t maxLen     //!< [in] Maximum length of `dst` (including the terminating null)
+);
+
+//! Bounded variant of strcat which returns the length of the result.
+//! @details Same as StrMaxCat(), except that the source is only scanned once.
+//! @returns the length of the string stored in `dst` (not including the
+//!          terminating null character).
+size_t StrMaxCatLen(
+    char* dst,        //!< [in/out] String to concatenate onto.
+    const char* src,  //!< [in] String to add to the end of `dst`.
+    size_t maxLen     //!< [in] Maximum lengh of `dst` (including the terminating null)
+);
+
+//! Appends a string to `dst` where the length of `dst` is already known.
+//! @details This allows a string to be built up from several pieces without
+//!          rescanning `dst` each time:
+//!
+//!              size_t len = 0;
+//!              len = StrMaxAppend(dst, len, "foo", LEN(dst));
+//!              len = StrMaxAppend(dst, len, "bar", LEN(dst));
+//!
+//!          If `dstLen` doesn't leave room for anything else, then `dst` is
+//!          truncated to `maxLen - 1` characters.
+//! @returns the length of the string stored in `dst` (not including the
+//!          terminating null character).
+size_t StrMaxAppend(
+    char* dst,        //!< [in/out] String to append onto.
+    size_t dstLen,    //!< [in] Current length of `dst`.
+    const char* src,  //!< [in] String to add to the end of `dst`.
+    size_t maxLen     //!< [in] Maximum lengh of `dst` (including the terminating null)
+);
+
+//! Converts an unsigned number into digits.
+//! @details This is the conversion used by StrPrintf() for the d, u, x, X, o
+//!          and b conversion types, for code which formats numbers itself.
+//!          The digits are stored (without a terminating null character) so
+//!          that they end just before `bufEnd`. A buffer of
+//!          CHAR_BIT * sizeof(unsigned long long) characters is always large enough.
+//! @returns the number of digits stored.
+size_t StrUnsignedToDigits(
+    char* bufEnd,          //!< [out] Digits are stored just before this.
+    unsigned long long x,  //!< [in] Number to convert.
+    uint8_t base,          //!< [in] Base to use (2 to 16).
+    bool capitalHex        //!< [in] Use "ABCDEF" rather than "abcdef".
+);
+
 //!@}
 
 #if defined(AVR)
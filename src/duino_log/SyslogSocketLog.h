@@ -0,0 +1,159 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   SyslogSocketLog.h
+ *
+ *   @brief  Logger which sends syslog records to a local datagram socket.
+ *
+ ****************************************************************************/
+
+#pragma once
+
+#if defined(__linux__)
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <syslog.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "duino_log/Log.h"
+
+//! Logger which sends syslog framed records over a non-blocking AF_UNIX datagram socket.
+//! @details Records are collected into batches which are sent with a single
+//!          sendmmsg call. A batch is sent when it fills up, when an ERROR or
+//!          FATAL message is logged, or by a background thread shortly after
+//!          the first record was added to it. The socket is non-blocking, so
+//!          if the collector falls behind, records are dropped (and counted)
+//!          rather than blocking the caller.
+//!
+//!          Only available on Linux.
+class SyslogSocketLog : public Log {
+ public:
+    //! Record framing.
+    enum class Format : uint8_t {
+        RFC3164,  //!< `<PRI>Mmm dd hh:mm:ss TAG[PID]: MSG`, as sent by syslog(3).
+        RFC5424,  //!< `<PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID - - MSG`
+    };
+
+    //! Maximum number of records sent by a single sendmmsg call.
+    static constexpr size_t BATCH_SIZE = 32;
+
+    //! Maximum length of a record (longer records are truncated).
+    static constexpr size_t MAX_RECORD_LEN = 512;
+
+    //! Maximum time a record waits for the rest of its batch.
+    static constexpr std::chrono::milliseconds FLUSH_INTERVAL{10};
+
+    //! Constructor.
+    explicit SyslogSocketLog(
+        const char* app_name,              //!< [in] Application name (TAG or APP-NAME).
+        Format format = Format::RFC3164,   //!< [in] Record framing.
+        const char* path = "/dev/log",     //!< [in] Path of the collector's socket.
+        int facility = LOG_USER            //!< [in] Syslog facility (i.e. LOG_USER, LOG_LOCAL0).
+    );
+
+    //! Destructor.
+    ~SyslogSocketLog() override;
+
+    //! Determines if the socket was created successfully.
+    //! @returns true if the socket is open.
+    bool is_open() const { return this->m_fd >= 0; }
+
+    //! Sends any records which are waiting to be batched.
+    void flush();
+
+    //! Sends any records which are waiting to be batched.
+    //! @details Once a record has been sent, persisting it is up to the collector.
+    void sync() override { this->flush(); }
+
+    //! Sends the current batch and takes the lock.
+    void prepare_fork() override;
+
+    //! Releases the lock.
+    void parent_after_fork() override;
+
+    //! Releases the lock, and starts a background thread for the child.
+    //! @details The child's records carry its own process ID.
+    void child_after_fork() override;
+
+    //! Returns the number of records sent to the collector.
+    //! @returns the number of records sent.
+    uint64_t num_sent() const { return this->m_num_sent.load(std::memory_order_relaxed); }
+
+    //! Returns the number of records dropped because the collector wasn't keeping up.
+    //! @returns the number of records dropped.
+    uint64_t num_dropped() const { return this->m_num_dropped.load(std::memory_order_relaxed); }
+
+    //! Maps a logging level to a syslog severity.
+    //! @returns the syslog severity (i.e. LOG_ERR).
+    static int severity(
+        Level level  //!< [in] Logging level to map.
+    );
+
+    //! Formats a syslog record.
+    //! @details The message is preceded by the prefix of the calling thread's LogContext.
+    //! @returns the length of the record.
+    size_t format_record(
+        char* record,     //!< [out] Place to store the record.
+        size_t maxLen,    //!< [in] Size of `record`.
+        Level level,      //!< [in] Logging level associated with this message.
+        const char* fmt,  //!< [in] Printf style format string.
+        va_list args      //!< [in] Arguments associated with format string.
+        ) const __attribute__((format(printf, 5, 0)));
+
+ protected:
+    //! Formats a record and adds it to the current batch.
+    void do_log(
+        Level level,      //!< Logging level associated with this message.
+        const char* fmt,  //!< Printf style format string
+        va_list args      //!< Arguments associated with format string.
+        ) override;
+
+ private:
+    //! Sends the current batch. Must be called with m_mutex held.
+    void send_batch();
+
+    //! Entry point for the background thread.
+    void background();
+
+    //! A record waiting to be sent.
+    struct Record {
+        size_t len;                  //!< Length of the record.
+        Level level;                 //!< Level of the record.
+        char data[MAX_RECORD_LEN];  //!< The record.
+    };
+
+    Format m_format;           //!< Record framing.
+    int m_facility;            //!< Syslog facility.
+    std::string m_app_name;    //!< Application name.
+    std::string m_hostname;    //!< Host name (RFC 5424 only).
+    unsigned m_pid;            //!< Process ID.
+    struct sockaddr_un m_addr;  //!< Address of the collector.
+    int m_fd = -1;              //!< Socket used to send records.
+
+    std::mutex m_mutex;               //!< Protects the batch.
+    std::condition_variable m_cv;     //!< Wakes up the background thread.
+    Record m_batch[BATCH_SIZE];       //!< Records waiting to be sent.
+    size_t m_count = 0;               //!< Number of records in m_batch.
+    bool m_stop = false;              //!< Tells the background thread to exit.
+    std::thread m_thread;             //!< Background thread.
+
+    std::atomic<uint64_t> m_num_sent{0};     //!< Number of records sent.
+    std::atomic<uint64_t> m_num_dropped{0};  //!< Number of records dropped.
+};
+
+#endif  // defined(__linux__)
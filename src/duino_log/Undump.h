@@ -0,0 +1,69 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   Undump.h
+ *
+ *   @brief  Routines for converting DumpMem output back into binary data.
+ *
+ ****************************************************************************/
+
+#pragma once
+
+// ---- Include Files -------------------------------------------------------
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+/**
+ * @addtogroup Log
+ * @{
+ */
+
+//! Result of parsing a single line of DumpLine output.
+enum class UndumpResult : uint8_t {
+    OK,       //!< The line contained data.
+    NO_DATA,  //!< The line was a "No Data" line.
+    INVALID,  //!< The line wasn't produced by DumpLine.
+};
+
+//! Parses a single line produced by DumpLine() back into binary data.
+//! @details The line may optionally be terminated by a newline, and a trailing
+//!          COLOR_NO_COLOR (as added by the color loggers) is ignored.
+//!
+//!          If `prefix` is nullptr, then the prefix is determined
+//!          automatically and everything before the address (or before the
+//!          hex data for NO_ADDR lines) is considered to be the prefix. A
+//!          prefix which looks like an address is ambiguous, in which case
+//!          the expected prefix should be passed in.
+//! @returns the result of parsing the line.
+UndumpResult ParseDumpLine(
+    const char* line,     //!< [in] Line to parse.
+    size_t lineLen,       //!< [in] Length of `line`.
+    const char* prefix,   //!< [in] Expected prefix, or nullptr to detect it.
+    size_t* address,      //!< [out] Address from the line, or NO_ADDR.
+    uint8_t* data,        //!< [out] Place to store the data (at least 16 bytes).
+    size_t* numBytes      //!< [out] Number of bytes stored in `data`.
+);
+
+//! Converts DumpMem() output read from `in` back into binary data.
+//! @details Lines which weren't produced by DumpLine() are skipped, which
+//!          allows a dump to be recovered from a log containing other
+//!          messages. The data from each line is written to `out` in the
+//!          order that it's encountered, and addresses are ignored.
+//! @returns the number of bytes written to `out`.
+size_t UndumpStream(
+    std::istream& in,             //!< [in] Stream containing the dump output.
+    std::ostream& out,            //!< [in] Stream to write the binary data to.
+    const char* prefix = nullptr  //!< [in] Expected prefix, or nullptr to detect it.
+);
+
+/** @} */
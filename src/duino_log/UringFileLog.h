@@ -0,0 +1,149 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   UringFileLog.h
+ *
+ *   @brief  Logger which writes to a file from a dedicated thread using io_uring.
+ *
+ ****************************************************************************/
+
+#pragma once
+
+#if defined(__linux__)
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "duino_log/LineLog.h"
+
+//! io_uring state used by UringFileLog (defined in UringFileLog.cpp).
+struct UringRing;
+
+//! Logger which appends lines to a file using batched asynchronous writes.
+//! @details Lines are copied into one of a small set of buffers. A dedicated
+//!          thread writes each buffer once it fills up (or FLUSH_INTERVAL after
+//!          data was added to it), so the logging threads never make system
+//!          calls unless all of the buffers are waiting to be written.
+//!
+//!          The writes are submitted through io_uring, with the buffers and
+//!          the file registered with the kernel (fixed buffers and fixed
+//!          files). If io_uring isn't available (old kernel, blocked by
+//!          seccomp, or not compiled in), all of the buffers which are ready
+//!          are written with a single writev call instead.
+//!
+//!          Only available on Linux.
+class UringFileLog : public LineLog {
+ public:
+    //! Number of buffers.
+    static constexpr size_t NUM_BUFFERS = 4;
+
+    //! Size of each buffer.
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+    //! Maximum time a line waits in a partially filled buffer.
+    static constexpr std::chrono::milliseconds FLUSH_INTERVAL{10};
+
+    //! Constructor.
+    explicit UringFileLog(
+        const char* path,       //!< [in] Path of the log file (appended to).
+        bool use_uring = true  //!< [in] Use io_uring if it's available.
+    );
+
+    //! Destructor.
+    ~UringFileLog() override;
+
+    //! Determines if the log file was opened (and the buffers allocated) successfully.
+    //! @returns true if the log file is open.
+    bool is_open() const { return this->m_fd >= 0; }
+
+    //! Determines if writes are being submitted through io_uring.
+    //! @returns true if io_uring is being used, false if writev is being used.
+    bool uses_uring() const { return this->m_ring.load(std::memory_order_acquire) != nullptr; }
+
+    //! Waits until everything logged so far has been written to the file.
+    void flush();
+
+    //! Writes everything logged so far to the file, and syncs it to storage.
+    void sync() override;
+
+    //! Writes everything logged so far to the file, and takes the lock.
+    void prepare_fork() override;
+
+    //! Releases the lock.
+    void parent_after_fork() override;
+
+    //! Closes the file in the child.
+    //! @details The parent writes at offsets which it keeps track of itself,
+    //!          so the child can't share the file. A child which wants to log
+    //!          should install its own logger.
+    void child_after_fork() override;
+
+ protected:
+    //! Copies a line into the current buffer.
+    void write_line(
+        Level level,       //!< [in] Logging level associated with this line.
+        const char* line,  //!< [in] Formatted line, including the trailing newline.
+        size_t len         //!< [in] Length of `line`.
+        ) override;
+
+ private:
+    //! State of a buffer.
+    enum class State : uint8_t {
+        FREE,     //!< Available to be filled.
+        FILLING,  //!< Lines are being added to it.
+        READY,    //!< Waiting to be written.
+        WRITING,  //!< Being written by the logging thread.
+    };
+
+    //! A buffer of lines.
+    struct Buffer {
+        char* data = nullptr;         //!< Buffer contents.
+        size_t len = 0;               //!< Number of bytes used.
+        State state = State::FREE;  //!< State of the buffer.
+    };
+
+    //! Hands the buffer being filled to the logging thread and starts filling the next one.
+    //! @details Waits if the next buffer hasn't been written yet.
+    void next_buffer(
+        std::unique_lock<std::mutex>& lock  //!< [in] Lock holding m_mutex.
+    );
+
+    //! Entry point for the logging thread.
+    void background();
+
+    //! Writes buffers (which are in file order) to the file.
+    void write_buffers(
+        size_t first,  //!< [in] Index of the first buffer to write.
+        size_t count   //!< [in] Number of buffers to write.
+    );
+
+    int m_fd = -1;                //!< File being logged to.
+    uint64_t m_offset = 0;        //!< File offset of the next buffer to be written.
+    //! io_uring state (nullptr when using writev).
+    //! @details Atomic, since the logging thread clears it if io_uring fails.
+    std::atomic<UringRing*> m_ring{nullptr};
+
+    std::mutex m_mutex;                  //!< Protects the buffers.
+    std::condition_variable m_bg_cv;    //!< Wakes up the logging thread.
+    std::condition_variable m_free_cv;  //!< Signalled when buffers are written.
+    Buffer m_buffers[NUM_BUFFERS];       //!< The buffers, used in order.
+    size_t m_fill = 0;                   //!< Index of the buffer being filled.
+    size_t m_write = 0;                  //!< Index of the next buffer to write.
+    uint64_t m_filled = 0;               //!< Number of buffers handed to the logging thread.
+    uint64_t m_written = 0;              //!< Number of buffers written.
+    bool m_stop = false;                 //!< Tells the logging thread to exit.
+    std::thread m_thread;                //!< Logging thread.
+};
+
+#endif  // defined(__linux__)
@@ -1,8 +1,22 @@
 # This list of files only includes the files requried for testing
 
 SOURCES_CPP += \
+	AsyncLog.cpp \
+	BinaryLog.cpp \
     LinuxColorLog.cpp \
 	Log.cpp \
+	LogContext.cpp \
+	LogStats.cpp \
 	DumpMem.cpp \
+	KeyValue.cpp \
+	LineLog.cpp \
+	MmapFileLog.cpp \
+	RateLimitFilter.cpp \
+	RingBufferLog.cpp \
+	RotatingFileLog.cpp \
+	SamplingFilter.cpp \
 	Str.cpp \
-	StrPrintf.cpp
+	StrPrintf.cpp \
+	SyslogSocketLog.cpp \
+	Undump.cpp \
+	UringFileLog.cpp
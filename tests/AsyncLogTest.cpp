@@ -0,0 +1,508 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   AsyncLogTest.cpp
+ *
+ *   @brief  Tests for functions in AsyncLog.cpp
+ *
+ ****************************************************************************/
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "duino_log/AsyncLog.h"
+#include "duino_log/LineLog.h"
+#include "duino_log/LogContext.h"
+#include "duino_log/LogStats.h"
+
+//! Sink which records the lines it's given, and can be made to block.
+class SinkLog : public LineLog {
+ public:
+    SinkLog() : LineLog(Install::LATER) {}
+
+    //! Returns the lines output so far.
+    std::vector<std::string> get_lines() {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->lines;
+    }
+
+    //! Makes write_line block until release() is called.
+    void hold() {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->holding = true;
+    }
+
+    //! Waits until write_line is blocked.
+    void wait_until_held() {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->cv.wait(lock, [this] { return this->held; });
+    }
+
+    //! Unblocks write_line.
+    void release() {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->holding = false;
+        this->cv.notify_all();
+    }
+
+    //! Records that the sink was synced.
+    void sync() override {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->lines.emplace_back("sync");
+    }
+
+ protected:
+    //! Records the line.
+    void write_line(Level, const char* line, size_t len) override {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->lines.emplace_back(line, len);
+        this->held = this->holding;
+        this->cv.notify_all();
+        this->cv.wait(lock, [this] { return !this->holding; });
+        this->held = false;
+    }
+
+ private:
+    std::mutex mutex;                //!< Protects the members below.
+    std::condition_variable cv;      //!< Signals changes to holding and held.
+    std::vector<std::string> lines;  //!< Lines output so far.
+    bool holding = false;            //!< Set to make write_line block.
+    bool held = false;               //!< Set while write_line is blocked.
+};
+
+//! Completion which records the sink's output at the time it's called.
+class LinesCompletion : public Log::Completion {
+ public:
+    explicit LinesCompletion(SinkLog* sink) : sink{sink} {}
+
+    //! Records the sink's output.
+    void complete() override {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->lines = this->sink->get_lines();
+        this->done = true;
+        this->cv.notify_all();
+    }
+
+    //! Waits for complete() to be called.
+    //! @returns the sink's output when it was called.
+    std::vector<std::string> wait() {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->cv.wait(lock, [this] { return this->done; });
+        return this->lines;
+    }
+
+ private:
+    SinkLog* sink;                   //!< Sink whose output is recorded.
+    std::mutex mutex;                //!< Protects the members below.
+    std::condition_variable cv;      //!< Signalled when complete() is called.
+    std::vector<std::string> lines;  //!< Sink's output when complete() was called.
+    bool done = false;               //!< Set once complete() has been called.
+};
+
+#if LOG_COROUTINES_ENABLED
+//! Coroutine type which runs as soon as it's called, and isn't awaited.
+struct Detached {
+    //! Promise type required by the compiler.
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+//! Logs an audit message, and records the sink's output once it's durable.
+static Detached audit(SinkLog* sink, std::promise<std::vector<std::string>>* result) {
+    co_await Log::async_info("Audit %d", 42);
+    result->set_value(sink->get_lines());
+}
+#endif
+
+TEST(AsyncLogTest, Simple) {
+    SinkLog sink;
+    AsyncLog log(&sink);
+
+    Log::info("Test %d", 1);
+    Log::error("Test %s", "two");
+    log.flush();
+    EXPECT_EQ(sink.get_lines(), (std::vector<std::string>{"[I] Test 1\n", "[E] Test two\n"}));
+}
+
+TEST(AsyncLogTest, ContextAndKeyValue) {
+    SinkLog sink;
+    AsyncLog log(&sink);
+
+    {
+        LogContext ctx("req", 7);
+        Log::info("Started");
+        Log::info_kv("Done", kv("bytes", 10));
+    }
+    Log::info("Idle");
+    log.flush();
+    EXPECT_EQ(
+        sink.get_lines(),
+        (std::vector<std::string>{
+            "[I] req=7 Started\n",
+            "[I] level=info msg=Done req=7 bytes=10\n",
+            "[I] Idle\n"}));
+}
+
+TEST(AsyncLogTest, SinkLevel) {
+    SinkLog sink;
+    AsyncLog log(&sink);
+    sink.set_level(Log::Level::WARNING);
+
+    Log::info("Info");
+    Log::warning("Warning");
+    log.flush();
+    EXPECT_EQ(sink.get_lines(), (std::vector<std::string>{"[W] Warning\n"}));
+}
+
+TEST(AsyncLogTest, MergedByTime) {
+    SinkLog sink;
+    AsyncLog log(&sink);
+
+    // Block the background thread, so that the following messages are all
+    // merged in the same pass.
+    sink.hold();
+    Log::info("First");
+    sink.wait_until_held();
+    for (int i = 0; i < 4; i++) {
+        std::thread thread([i] { Log::info("Thread %d", i); });
+        thread.join();
+    }
+    Log::info("Last");
+    sink.release();
+    log.flush();
+
+    EXPECT_EQ(
+        sink.get_lines(),
+        (std::vector<std::string>{
+            "[I] First\n",
+            "[I] Thread 0\n",
+            "[I] Thread 1\n",
+            "[I] Thread 2\n",
+            "[I] Thread 3\n",
+            "[I] Last\n"}));
+
+    // The rings of the threads which exited are released once they're empty.
+    log.flush();
+    EXPECT_EQ(log.num_rings(), 1u);
+}
+
+TEST(AsyncLogTest, Dropped) {
+    SinkLog sink;
+    AsyncLog log(&sink, 2);
+
+    sink.hold();
+    Log::info("Held");
+    sink.wait_until_held();
+    // "Held" still occupies the ring until the sink returns.
+    for (int i = 0; i < 4; i++) {
+        Log::info("Message %d", i);
+    }
+    EXPECT_EQ(log.num_dropped(), 3u);
+    sink.release();
+    log.flush();
+    EXPECT_EQ(sink.get_lines(), (std::vector<std::string>{"[I] Held\n", "[I] Message 0\n"}));
+}
+
+TEST(AsyncLogTest, Backpressure) {
+    SinkLog sink;
+    AsyncLog log(&sink, 2);
+    AsyncLog::Backpressure policy;
+    policy.block_level = Log::Level::ERROR;
+    policy.spins = 10;
+    policy.yields = 2;
+    log.set_backpressure(policy);
+    EXPECT_EQ(log.get_backpressure().block_level, Log::Level::ERROR);
+
+    sink.hold();
+    std::atomic<bool> done{false};
+    std::thread thread([&sink, &done] {
+        Log::info("Held");
+        sink.wait_until_held();
+        Log::error("Error 1");
+        Log::info("Dropped");
+        Log::error("Error 2");  // Waits for room.
+        done = true;
+    });
+
+    // Give the thread time to park.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(done);
+    sink.release();
+    thread.join();
+    log.flush();
+
+    EXPECT_EQ(
+        sink.get_lines(),
+        (std::vector<std::string>{"[I] Held\n", "[E] Error 1\n", "[E] Error 2\n"}));
+    EXPECT_EQ(log.num_dropped(), 1u);
+    EXPECT_EQ(log.num_stalled(), 1u);
+    EXPECT_GE(log.stall_ns(), 10000000u);
+#if LOG_STATS_ENABLED
+    EXPECT_GE(Log::stats().latency(LogStats::Timer::STALL).total(), 1u);
+#endif
+}
+
+TEST(AsyncLogTest, BackpressureManyThreads) {
+    static constexpr int NUM_THREADS = 8;
+    static constexpr int NUM_MESSAGES = 2000;
+
+    SinkLog sink;
+    AsyncLog log(&sink, 4);
+    AsyncLog::Backpressure policy;
+    policy.block_level = Log::Level::DEBUG;
+    policy.spins = 0;
+    policy.yields = 0;
+    log.set_backpressure(policy);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; t++) {
+        threads.emplace_back([] {
+            for (int i = 0; i < NUM_MESSAGES; i++) {
+                Log::info("Message %d", i);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    log.flush();
+    EXPECT_EQ(log.num_dropped(), 0u);
+    EXPECT_EQ(sink.get_lines().size(), static_cast<size_t>(NUM_THREADS * NUM_MESSAGES));
+}
+
+TEST(AsyncLogTest, MultipleThreads) {
+    static constexpr int NUM_THREADS = 8;
+    static constexpr int NUM_MESSAGES = 1000;
+
+    SinkLog sink;
+    AsyncLog log(&sink, NUM_MESSAGES);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; t++) {
+        threads.emplace_back([t] {
+            for (int i = 0; i < NUM_MESSAGES; i++) {
+                Log::info("%d %d", t, i);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    log.flush();
+    EXPECT_EQ(log.num_dropped(), 0u);
+
+    // Each thread's messages are output in order.
+    std::vector<std::string> lines = sink.get_lines();
+    ASSERT_EQ(lines.size(), static_cast<size_t>(NUM_THREADS * NUM_MESSAGES));
+    int next[NUM_THREADS] = {};
+    for (const auto& line : lines) {
+        char* end;
+        long t = strtol(line.c_str() + 4, &end, 10);
+        long i = strtol(end, nullptr, 10);
+        ASSERT_GE(t, 0);
+        ASSERT_LT(t, NUM_THREADS);
+        EXPECT_EQ(i, next[t]++);
+    }
+
+    log.flush();
+    EXPECT_EQ(log.num_rings(), 0u);
+}
+
+TEST(AsyncLogTest, Durable) {
+    SinkLog sink;
+    AsyncLog log(&sink);
+    LinesCompletion completion(&sink);
+
+    Log::info("Before");
+    Log::log_durable(&completion, Log::Level::INFO, "Audit %d", 1);
+    EXPECT_EQ(
+        completion.wait(), (std::vector<std::string>{"[I] Before\n", "[I] Audit 1\n", "sync"}));
+
+    log.sync();
+    EXPECT_EQ(sink.get_lines().back(), "sync");
+}
+
+TEST(AsyncLogTest, DurableSuppressed) {
+    SinkLog sink;
+    AsyncLog log(&sink);
+    log.set_level(Log::Level::ERROR);
+    LinesCompletion completion(&sink);
+
+    // The message isn't logged, so the completion is called right away.
+    Log::log_durable(&completion, Log::Level::INFO, "Audit %d", 1);
+    EXPECT_EQ(completion.wait(), std::vector<std::string>{});
+}
+
+TEST(AsyncLogTest, DurableSynchronous) {
+    SinkLog sink;
+    Log::replace(&sink);
+    LinesCompletion completion(&sink);
+
+    // Loggers which aren't asynchronous write and sync before returning.
+    Log::log_durable(&completion, Log::Level::ERROR, "Audit %d", 2);
+    EXPECT_EQ(completion.wait(), (std::vector<std::string>{"[E] Audit 2\n", "sync"}));
+    Log::replace(nullptr);
+}
+
+#if LOG_COROUTINES_ENABLED
+TEST(AsyncLogTest, Coroutine) {
+    SinkLog sink;
+    AsyncLog log(&sink);
+
+    std::promise<std::vector<std::string>> result;
+    std::future<std::vector<std::string>> lines = result.get_future();
+    audit(&sink, &result);
+    EXPECT_EQ(lines.get(), (std::vector<std::string>{"[I] Audit 42\n", "sync"}));
+}
+#endif
+
+TEST(AsyncLogTest, FormatterPool) {
+    SinkLog sink;
+    AsyncLog log(&sink, AsyncLog::DEFAULT_RING_SIZE, 3);
+    EXPECT_EQ(log.num_formatters(), 3u);
+
+    {
+        LogContext ctx("req", 7);
+        // The string is copied when the message is logged.
+        std::string name = "abc";
+        Log::info("%s=%5d %c %x", name.c_str(), 42, 'z', 255);
+        name = "xyz";
+    }
+    Log::info_kv("Done", kv("bytes", 10));
+    log.flush();
+    EXPECT_EQ(
+        sink.get_lines(),
+        (std::vector<std::string>{"[I] req=7 abc=   42 z ff\n", "[I] level=info msg=Done bytes=10\n"}));
+}
+
+TEST(AsyncLogTest, FormatterPoolOrder) {
+    static constexpr int NUM_THREADS = 4;
+    static constexpr int NUM_MESSAGES = 3000;
+
+    SinkLog sink;
+    AsyncLog log(&sink, 1024, 2);
+    AsyncLog::Backpressure policy;
+    policy.block_level = Log::Level::DEBUG;
+    log.set_backpressure(policy);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; t++) {
+        threads.emplace_back([t] {
+            for (int i = 0; i < NUM_MESSAGES; i++) {
+                Log::info("%d %d", t, i);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    log.flush();
+
+    // Each thread's messages are output in order, even though they were
+    // formatted in parallel.
+    std::vector<std::string> lines = sink.get_lines();
+    ASSERT_EQ(lines.size(), static_cast<size_t>(NUM_THREADS * NUM_MESSAGES));
+    int next[NUM_THREADS] = {};
+    for (const auto& line : lines) {
+        char* end;
+        long t = strtol(line.c_str() + 4, &end, 10);
+        long i = strtol(end, nullptr, 10);
+        ASSERT_GE(t, 0);
+        ASSERT_LT(t, NUM_THREADS);
+        EXPECT_EQ(i, next[t]++);
+    }
+}
+
+//! Sink which logs three more messages (through the current logger) for each message.
+class EchoLog : public LineLog {
+ public:
+    EchoLog() : LineLog(Install::LATER) {}
+
+    //! Number of messages output.
+    std::atomic<int> num_messages{0};
+
+ protected:
+    //! Counts the line, and echoes it unless it's an echo itself.
+    void write_line(Level, const char* line, size_t) override {
+        if (strncmp(line, "[I] Echo", 8) != 0) {
+            this->num_messages++;
+            for (int i = 0; i < 3; i++) {
+                Log::info("Echo");
+            }
+        }
+    }
+};
+
+TEST(AsyncLogTest, BackendThreadsDontWait) {
+    static constexpr int NUM_MESSAGES = 1000;
+
+    EchoLog sink;
+    AsyncLog log(&sink, 2, 2);
+    AsyncLog::Backpressure policy;
+    policy.block_level = Log::Level::DEBUG;
+    log.set_backpressure(policy);
+
+    // The background thread's ring fills up with echoes, which it drops
+    // rather than waiting for itself to make room.
+    for (int i = 0; i < NUM_MESSAGES; i++) {
+        Log::info("Message %d", i);
+    }
+    log.flush();
+    EXPECT_EQ(sink.num_messages, NUM_MESSAGES);
+    EXPECT_GT(log.num_dropped(), 0u);
+}
+
+TEST(AsyncLogTest, ParseCpuList) {
+    std::vector<unsigned> cpus;
+    EXPECT_TRUE(AsyncLog::parse_cpu_list("0-3,8,10-11\n", &cpus));
+    EXPECT_EQ(cpus, (std::vector<unsigned>{0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_TRUE(AsyncLog::parse_cpu_list("5", &cpus));
+    EXPECT_EQ(cpus, (std::vector<unsigned>{5}));
+
+    EXPECT_FALSE(AsyncLog::parse_cpu_list("", &cpus));
+    EXPECT_FALSE(AsyncLog::parse_cpu_list("\n", &cpus));
+    EXPECT_FALSE(AsyncLog::parse_cpu_list("3-1", &cpus));
+    EXPECT_FALSE(AsyncLog::parse_cpu_list("1-", &cpus));
+    EXPECT_FALSE(AsyncLog::parse_cpu_list("1,x", &cpus));
+}
+
+#if defined(__linux__)
+TEST(AsyncLogTest, Affinity) {
+    SinkLog sink;
+    AsyncLog log(&sink, AsyncLog::DEFAULT_RING_SIZE, 1);
+
+    EXPECT_FALSE(log.set_affinity({}));
+    EXPECT_FALSE(log.set_numa_node(100000));
+    EXPECT_TRUE(log.set_affinity({0}));
+    if (access("/sys/devices/system/node/node0", F_OK) == 0) {
+        EXPECT_TRUE(log.set_numa_node(0));
+    }
+
+    Log::info("Pinned");
+    log.flush();
+    EXPECT_EQ(sink.get_lines(), (std::vector<std::string>{"[I] Pinned\n"}));
+}
+#endif  // defined(__linux__)
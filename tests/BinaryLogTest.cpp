@@ -0,0 +1,236 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   BinaryLogTest.cpp
+ *
+ *   @brief  Tests for functions in BinaryLog.cpp
+ *
+ ****************************************************************************/
+
+#include <stdarg.h>
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+#include "duino_log/BinaryLog.h"
+#include "duino_log/Str.h"
+#include "duino_util/Util.h"
+
+//! Encodes the arguments and decodes them again.
+//! @returns the decoded message.
+static std::string round_trip(const char* fmt, ...) {
+    uint8_t buf[BinaryLog::MAX_ARG_LEN];
+    va_list args;
+    va_start(args, fmt);
+    size_t len = BinaryLog::encode_args(fmt, args, buf, LEN(buf));
+    va_end(args);
+    return BinaryLogDecoder::format(fmt, buf, len);
+}
+
+//! Formats the message directly with vStrXPrintf.
+//! @returns the formatted message.
+static std::string expected(const char* fmt, ...) {
+    char str[256];
+    va_list args;
+    va_start(args, fmt);
+    vStrBPrintf(str, LEN(str), fmt, args);
+    va_end(args);
+    return str;
+}
+
+//! Checks that a round trip through the binary encoding matches vStrXPrintf.
+#define CHECK_ROUND_TRIP(fmt, ...) EXPECT_EQ(round_trip(fmt, ##__VA_ARGS__), expected(fmt, ##__VA_ARGS__))
+
+TEST(BinaryLogTest, RoundTripIntegers) {
+    CHECK_ROUND_TRIP("Int %d %i %d", 42, -1, INT32_MIN);
+    CHECK_ROUND_TRIP("Unsigned %u %x %X %o", 0u, 0xdeadbeefu, 0xabcu, 0777u);
+    CHECK_ROUND_TRIP("Long %ld %lu %lx", -123456789L, 123456789UL, 0xfeedUL);
+    CHECK_ROUND_TRIP("LongLong %lld %llu %llx", INT64_MIN, UINT64_MAX, 0x123456789abcdefULL);
+    CHECK_ROUND_TRIP("Size %zu %zx %zd", static_cast<size_t>(12345), static_cast<size_t>(0xff),
+                     static_cast<size_t>(-2));
+    CHECK_ROUND_TRIP("Short %hd %hhu", 12, 34);
+    CHECK_ROUND_TRIP("Binary %b %08b", 5u, 3u);
+    CHECK_ROUND_TRIP("Flags [%-6d] [%+d] [% d] [%#x] [%05d] [%.4d]", 1, 2, 3, 0x10, -4, 5);
+}
+
+TEST(BinaryLogTest, RoundTripStarArgs) {
+    CHECK_ROUND_TRIP("[%*d] [%-*d]", 6, 42, 5, -3);
+    CHECK_ROUND_TRIP("[%.*s] [%*.*s]", 3, "abcdef", 8, 2, "xyz");
+    CHECK_ROUND_TRIP("[%*.*lld]", -10, 4, 77LL);
+}
+
+TEST(BinaryLogTest, RoundTripStringsAndChars) {
+    CHECK_ROUND_TRIP("Str '%s' '%10s' '%-10s' '%.2s'", "hello", "right", "left", "truncated");
+    CHECK_ROUND_TRIP("Empty '%s'", "");
+    CHECK_ROUND_TRIP("Char '%c' '%3c' '%-3c'", 'a', 'b', 'c');
+
+    // Precision means the string doesn't need to be null terminated.
+    char unterminated[3] = {'a', 'b', 'c'};
+    CHECK_ROUND_TRIP("%.3s", unterminated);
+}
+
+TEST(BinaryLogTest, RoundTripOddFormats) {
+    CHECK_ROUND_TRIP("No args");
+    EXPECT_EQ(round_trip(""), "");
+    CHECK_ROUND_TRIP("Percent %% %d", 7);
+    CHECK_ROUND_TRIP("Invalid %q %d", 8);
+    CHECK_ROUND_TRIP("Trailing %");
+}
+
+TEST(BinaryLogTest, TruncatedArgs) {
+    // When the arguments don't fit, the message stops at the first one missing.
+    std::string big(BinaryLog::MAX_ARG_LEN * 2, 'x');
+    std::string msg = round_trip("%d %s %d", 1, big.c_str(), 2);
+    EXPECT_EQ(msg.substr(0, 4), "1 xx");
+    EXPECT_LE(msg.size(), BinaryLog::MAX_ARG_LEN);
+    EXPECT_EQ(msg.find('2'), std::string::npos);
+}
+
+TEST(BinaryLogTest, LogAndDecode) {
+    char* data = nullptr;
+    size_t dataLen = 0;
+    FILE* fs = open_memstream(&data, &dataLen);
+    ASSERT_NE(fs, nullptr);
+    {
+        BinaryLog log(fs);
+        log.set_level(Log::Level::DEBUG);
+        Log::error("Error %x", 0xbad);
+        Log::debug("Debug");
+        for (int i = 0; i < 100; i++) {
+            Log::info("Iteration %d of %s", i, "test");
+        }
+    }
+    fclose(fs);
+    std::string bin(data, dataLen);
+    free(data);
+
+    std::istringstream in(bin);
+    BinaryLogDecoder decoder(in);
+
+    ASSERT_EQ(decoder.next(), BinaryLogDecoder::Result::RECORD);
+    EXPECT_EQ(decoder.level(), Log::Level::ERROR);
+    EXPECT_EQ(decoder.message(), "Error bad");
+    EXPECT_GT(decoder.timestamp_us(), 0u);
+    uint64_t prevTime = decoder.timestamp_us();
+
+    ASSERT_EQ(decoder.next(), BinaryLogDecoder::Result::RECORD);
+    EXPECT_EQ(decoder.level(), Log::Level::DEBUG);
+    EXPECT_EQ(decoder.message(), "Debug");
+
+    size_t textLen = 0;
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ(decoder.next(), BinaryLogDecoder::Result::RECORD);
+        EXPECT_EQ(decoder.level(), Log::Level::INFO);
+        EXPECT_EQ(decoder.message(), expected("Iteration %d of %s", i, "test"));
+        EXPECT_GE(decoder.timestamp_us(), prevTime);
+        prevTime = decoder.timestamp_us();
+        textLen += decoder.message().size() + 5;  // "[I] " and newline
+    }
+    EXPECT_EQ(decoder.next(), BinaryLogDecoder::Result::END);
+
+    // Each format string is only stored once, so the binary log is much smaller.
+    EXPECT_LT(bin.size() * 2, textLen);
+}
+
+TEST(BinaryLogTest, LogAndDecodeContext) {
+    char* data = nullptr;
+    size_t dataLen = 0;
+    FILE* fs = open_memstream(&data, &dataLen);
+    ASSERT_NE(fs, nullptr);
+    {
+        BinaryLog log(fs);
+        Log::info("No context");
+        {
+            LogContext ctx("req", 42);
+            Log::info("First");
+            Log::info("Second");
+        }
+        Log::info("No context again");
+    }
+    fclose(fs);
+    std::string bin(data, dataLen);
+    free(data);
+
+    // The context is only written when it changes.
+    EXPECT_EQ(bin.find("req=42 "), bin.rfind("req=42 "));
+
+    std::istringstream in(bin);
+    BinaryLogDecoder decoder(in);
+    const char* expectedContext[] = {"", "req=42 ", "req=42 ", ""};
+    const char* expectedMessage[] = {"No context", "First", "Second", "No context again"};
+    for (size_t i = 0; i < LEN(expectedMessage); i++) {
+        ASSERT_EQ(decoder.next(), BinaryLogDecoder::Result::RECORD);
+        EXPECT_EQ(decoder.context(), expectedContext[i]);
+        EXPECT_EQ(decoder.message(), expectedMessage[i]);
+    }
+    EXPECT_EQ(decoder.next(), BinaryLogDecoder::Result::END);
+}
+
+TEST(BinaryLogTest, NonLiteralFormats) {
+    static constexpr size_t NUM_FORMATS = BinaryLog::MAX_FORMATS + 10;
+
+    char* data = nullptr;
+    size_t dataLen = 0;
+    FILE* fs = open_memstream(&data, &dataLen);
+    ASSERT_NE(fs, nullptr);
+    {
+        BinaryLog log(fs);
+        // The same buffer holds a different format string each time.
+        char fmt[32];
+        for (size_t i = 0; i < NUM_FORMATS; i++) {
+            snprintf(fmt, sizeof(fmt), "Format %zu %%d", i);
+            Log::info(fmt, 7);
+        }
+        // Formats seen before reuse their ID, even past the limit.
+        snprintf(fmt, sizeof(fmt), "Format %d %%d", 0);
+        Log::info(fmt, 8);
+    }
+    fclose(fs);
+    std::string bin(data, dataLen);
+    free(data);
+
+    // Only MAX_FORMATS format strings are stored, and the rest of the
+    // messages are stored already formatted.
+    size_t numStored = 0;
+    for (size_t pos = bin.find("%d"); pos != std::string::npos; pos = bin.find("%d", pos + 1)) {
+        numStored++;
+    }
+    EXPECT_EQ(numStored, BinaryLog::MAX_FORMATS);
+
+    std::istringstream in(bin);
+    BinaryLogDecoder decoder(in);
+    for (size_t i = 0; i < NUM_FORMATS; i++) {
+        ASSERT_EQ(decoder.next(), BinaryLogDecoder::Result::RECORD);
+        EXPECT_EQ(decoder.message(), "Format " + std::to_string(i) + " 7");
+    }
+    ASSERT_EQ(decoder.next(), BinaryLogDecoder::Result::RECORD);
+    EXPECT_EQ(decoder.message(), "Format 0 8");
+    EXPECT_EQ(decoder.next(), BinaryLogDecoder::Result::END);
+}
+
+TEST(BinaryLogTest, DecodeCorrupt) {
+    std::istringstream empty("");
+    EXPECT_EQ(BinaryLogDecoder(empty).next(), BinaryLogDecoder::Result::END);
+
+    std::istringstream badMagic("NOTALOG!");
+    EXPECT_EQ(BinaryLogDecoder(badMagic).next(), BinaryLogDecoder::Result::CORRUPT);
+
+    // A record which refers to a format which was never defined.
+    std::string bin = std::string(BinaryLog::MAGIC) + "\x14\x02\x05";
+    std::istringstream badId(bin);
+    EXPECT_EQ(BinaryLogDecoder(badId).next(), BinaryLogDecoder::Result::CORRUPT);
+
+    // A truncated record.
+    bin = std::string(BinaryLog::MAGIC) + std::string("\x01\x00\x02%d\x14\x02\x00\x05", 9);
+    std::istringstream truncated(bin);
+    EXPECT_EQ(BinaryLogDecoder(truncated).next(), BinaryLogDecoder::Result::CORRUPT);
+}
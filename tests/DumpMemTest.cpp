@@ -21,6 +21,7 @@
 #include <string>
 #include <sstream>
 
+#include "duino_log/ConsoleColor.h"
 #include "duino_log/DumpMem.h"
 #include "duino_log/Log.h"
 #include "duino_log/Str.h"
@@ -44,7 +45,7 @@ class DumpMemLogger : public Log {
         va_list args      //!< [in] Arguments associated with the format string.
         ) noexcept override {
         (void)level;
-        char line[100];
+        char line[200];
 
         vStrPrintf(line, LEN(line), fmt, args);
 
@@ -64,7 +65,7 @@ class DumpMemTestFixture : public ::testing::Test {
 TEST(DumpLineTest, DumpLineNoData) {
     char line[100];
 
-    DumpLine("Test", 0, data, 0, LEN(line), line);
+    EXPECT_EQ(DumpLine("Test", 0, data, 0, LEN(line), line), 13);
 
     EXPECT_STREQ(line, "Test: No Data");
 }
@@ -88,7 +89,7 @@ TEST(DumpLineTest, DumpLineOneByteNoAddr) {
 TEST(DumpLineTest, DumpLineOneLine) {
     char line[100];
 
-    DumpLine("Test", 0, data, 16, LEN(line), line);
+    EXPECT_EQ(DumpLine("Test", 0, data, 16, LEN(line), line), 76);
 
     EXPECT_STREQ(
         line, "Test: 0000: 00 01 02 31 32 33 41 42 43 11 12 13 36 37 38 39 ...123ABC...6789");
@@ -97,7 +98,7 @@ TEST(DumpLineTest, DumpLineOneLine) {
 TEST(DumpLineTest, DumpLineOneLineTruncated) {
     char line[65];
 
-    DumpLine("Test", 0, data, 16, LEN(line), line);
+    EXPECT_EQ(DumpLine("Test", 0, data, 16, LEN(line), line), 60);
 
     EXPECT_STREQ(line, "Test: 0000: 00 01 02 31 32 33 41 42 43 11 12 13 36 37 38 39 ");
 }
@@ -139,6 +140,15 @@ TEST_F(DumpMemTestFixture, DumpMemOnePlusLines) {
         "Test: 0010: 20 21 22 23 24 25 61 62                          !\"#$%ab");
 }
 
+TEST_F(DumpMemTestFixture, DumpMemTwoLinesNoAddr) {
+    DumpMem("Test", NO_ADDR, data, 32);
+
+    EXPECT_STREQ(
+        logger.str.c_str(),
+        "Test: 00 01 02 31 32 33 41 42 43 11 12 13 36 37 38 39 ...123ABC...6789\n"
+        "Test: 20 21 22 23 24 25 61 62 63 64 65 66 67 68 69 6a  !\"#$%abcdefghij");
+}
+
 TEST_F(DumpMemTestFixture, DumpMemTwoLines) {
     DumpMem("Test", 0, data, 32);
 
@@ -185,3 +195,139 @@ TEST(DumpMemStreamTest, DataFullConstructor) {
         "\nTest: 0000: 00 01 02 31 32 33 41 42 43 11 12 13 36 37 38 39 ...123ABC...6789\n"
         "Test: 0010: 20 21 22 23 24 25 61 62                          !\"#$%ab\n");
 }
+
+TEST(DumpDiffLineTest, NoData) {
+    char line[200];
+
+    EXPECT_EQ(DumpDiffLine("Test", 0, data, data, 0, false, LEN(line), line), 13);
+
+    EXPECT_STREQ(line, "Test: No Data");
+}
+
+TEST(DumpDiffLineTest, OneByteDiffers) {
+    uint8_t other[16];
+    char line[200];
+
+    memcpy(other, data, sizeof(other));
+    other[2] = 0xff;
+    EXPECT_EQ(DumpDiffLine("Test", 0, data, other, 4, false, LEN(line), line), 74);
+
+    EXPECT_STREQ(
+        line,
+        "Test: 0000: 00 01 02*31                                     | 00 01 ff*31 ");
+}
+
+TEST(DumpDiffLineTest, SameBufferShortLine) {
+    char line[200];
+
+    EXPECT_EQ(DumpDiffLine("Test", 0, data, data, 4, false, LEN(line), line), 74);
+
+    EXPECT_STREQ(
+        line,
+        "Test: 0000: 00 01 02 31                                     | 00 01 02 31 ");
+}
+
+TEST(DumpDiffLineTest, Color) {
+    uint8_t other[16];
+    char line[200];
+
+    memcpy(other, data, sizeof(other));
+    other[1] = 0xff;
+    size_t len = DumpDiffLine("", NO_ADDR, data, other, 2, true, LEN(line), line);
+
+    EXPECT_STREQ(
+        line,
+        "00 " COLOR_RED "01" COLOR_NO_COLOR
+        "                                           | 00 " COLOR_RED "ff" COLOR_NO_COLOR " ");
+    EXPECT_EQ(len, strlen(line));
+}
+
+TEST_F(DumpMemTestFixture, DumpDiffNoData) {
+    DumpDiff("Test", 0, data, data, 0);
+    EXPECT_STREQ(logger.str.c_str(), "Test: No Data");
+}
+
+TEST_F(DumpMemTestFixture, DumpDiffIdentical) {
+    DumpDiff("Test", 0, data, data, sizeof(data));
+    EXPECT_STREQ(logger.str.c_str(), "Test: No Differences");
+}
+
+TEST_F(DumpMemTestFixture, DumpDiffSkipsIdenticalLines) {
+    uint8_t a[64];
+    uint8_t b[64];
+
+    memset(a, 0x41, sizeof(a));
+    memcpy(b, a, sizeof(b));
+    b[0x23] = 0x42;
+
+    DumpDiff("Test", 0x100, a, b, sizeof(a));
+
+    EXPECT_STREQ(
+        logger.str.c_str(),
+        "Test: *\n"
+        "Test: 0120: 41 41 41 41*41 41 41 41 41 41 41 41 41 41 41 41 "
+        "| 41 41 41 42*41 41 41 41 41 41 41 41 41 41 41 41 \n"
+        "Test: *");
+}
+
+TEST_F(DumpMemTestFixture, DumpDiffLargeBuffer) {
+    std::string a(4096, 'x');
+    std::string b(a);
+
+    b[4000] = 'y';
+    b[4095] = 'y';
+
+    DumpDiff("", NO_ADDR, a.data(), b.data(), a.size());
+
+    EXPECT_STREQ(
+        logger.str.c_str(),
+        "*\n"
+        "78*78 78 78 78 78 78 78 78 78 78 78 78 78 78 78 "
+        "| 79*78 78 78 78 78 78 78 78 78 78 78 78 78 78 78 \n"
+        "*\n"
+        "78 78 78 78 78 78 78 78 78 78 78 78 78 78 78 78*"
+        "| 78 78 78 78 78 78 78 78 78 78 78 78 78 78 78 79*");
+}
+
+TEST(DumpMemStreamTest, DataNoAddr) {
+    std::ostringstream output;
+
+    output << dump("Test", NO_ADDR, data, 24);
+
+    EXPECT_STREQ(
+        output.str().c_str(),
+        "\nTest: 00 01 02 31 32 33 41 42 43 11 12 13 36 37 38 39 ...123ABC...6789\n"
+        "Test: 20 21 22 23 24 25 61 62                          !\"#$%ab\n");
+}
+
+TEST(DumpMemStreamTest, LargeAddress) {
+    if constexpr (sizeof(size_t) > 4) {
+        std::ostringstream output;
+
+        output << dump("Test", static_cast<size_t>(0x1fffffff0), data, 24);
+
+        EXPECT_STREQ(
+            output.str().c_str(),
+            "\nTest: 1fffffff0: 00 01 02 31 32 33 41 42 43 11 12 13 36 37 38 39 "
+            "...123ABC...6789\n"
+            "Test: 200000000: 20 21 22 23 24 25 61 62                          !\"#$%ab\n");
+    }
+}
+
+TEST(DumpMemStreamTest, ManyLines) {
+    std::ostringstream output;
+    std::string expected = "\n";
+    uint8_t bytes[16 * 40];
+
+    memset(bytes, 0x41, sizeof(bytes));
+    for (size_t i = 0; i < LEN(bytes); i += 16) {
+        char line[100];
+        DumpLine("Test", i, &bytes[i], 16, LEN(line), line);
+        expected.append(line);
+        expected.push_back('\n');
+    }
+
+    output << dump("Test", 0, bytes, sizeof(bytes));
+
+    EXPECT_EQ(output.str(), expected);
+}
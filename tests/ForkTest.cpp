@@ -0,0 +1,257 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   ForkTest.cpp
+ *
+ *   @brief  Tests for forking while other threads are logging.
+ *
+ ****************************************************************************/
+
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "duino_log/AsyncLog.h"
+#include "duino_log/LinuxColorLog.h"
+#include "duino_log/LogStats.h"
+#include "duino_log/MmapFileLog.h"
+#include "duino_log/RotatingFileLog.h"
+#include "duino_log/UringFileLog.h"
+
+//! Test fixture which creates a temporary directory for the log files.
+class ForkTest : public ::testing::Test {
+ protected:
+    static constexpr int NUM_THREADS = 4;  //!< Number of threads logging while forking.
+    static constexpr int NUM_FORKS = 20;   //!< Number of children to fork.
+
+    void SetUp() override {
+        char dir[] = "/tmp/ForkTest.XXXXXX";
+        ASSERT_NE(mkdtemp(dir), nullptr);
+        this->dir = dir;
+        this->path = this->dir + "/test.log";
+    }
+
+    void TearDown() override {
+        std::string cmd = "rm -rf " + this->dir;
+        EXPECT_EQ(system(cmd.c_str()), 0);
+    }
+
+    //! Reads the contents of a file.
+    static std::string read_file(const std::string& name) {
+        std::ifstream in(name);
+        std::stringstream contents;
+        contents << in.rdbuf();
+        return contents.str();
+    }
+
+    //! Counts the number of times each message appears in a log file.
+    //! @details The level prefix and any color codes are removed from the lines.
+    //! @returns the number of times each message appears.
+    static std::unordered_map<std::string, int> count_messages(const std::string& contents) {
+        std::unordered_map<std::string, int> counts;
+        std::istringstream in(contents);
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t start = line.find("] ");
+            start = (start == std::string::npos) ? 0 : start + 2;
+            size_t end = line.find('\x1b', start);
+            counts[line.substr(start, end == std::string::npos ? end : end - start)]++;
+        }
+        return counts;
+    }
+
+    //! Forks a child which runs `child`.
+    //! @returns true if `child` returned true in the child.
+    template <typename Fn>
+    static bool run_child(Fn child) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            // If the child deadlocks, it's killed rather than hanging the test.
+            alarm(10);
+            _exit(child() ? 0 : 1);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    //! Starts threads which log until `stop` is set.
+    void start_logging() {
+        for (int t = 0; t < NUM_THREADS; t++) {
+            this->threads.emplace_back([this, t] {
+                int i = 0;
+                while (!this->stop.load()) {
+                    Log::info("thread %d message %d", t, i++);
+                }
+                this->num_messages[t] = i;
+            });
+        }
+    }
+
+    //! Stops the threads started by start_logging().
+    void stop_logging() {
+        this->stop.store(true);
+        for (auto& thread : this->threads) {
+            thread.join();
+        }
+    }
+
+    //! Checks that each message logged by the threads was output once.
+    void check_messages(std::unordered_map<std::string, int>& counts) {
+        for (int t = 0; t < NUM_THREADS; t++) {
+            EXPECT_GT(this->num_messages[t], 0);
+            for (int i = 0; i < this->num_messages[t]; i++) {
+                std::string message = "thread " + std::to_string(t) + " message " + std::to_string(i);
+                ASSERT_EQ(counts[message], 1) << message;
+            }
+        }
+    }
+
+    std::string dir;                       //!< Temporary directory.
+    std::string path;                      //!< Path of the log file.
+    std::atomic<bool> stop{false};         //!< Tells the logging threads to stop.
+    std::vector<std::thread> threads;      //!< Logging threads.
+    int num_messages[NUM_THREADS] = {};  //!< Number of messages logged by each thread.
+};
+
+TEST_F(ForkTest, AsyncLog) {
+    {
+        RotatingFileLog sink(this->path.c_str(), 1 << 30, 1);
+        AsyncLog log(&sink, 64, 2, Log::Install::LATER);
+        AsyncLog::Backpressure policy;
+        policy.block_level = Log::Level::DEBUG;
+        log.set_backpressure(policy);
+        Log::replace(&log);
+
+        this->start_logging();
+        for (int f = 0; f < NUM_FORKS; f++) {
+            EXPECT_TRUE(run_child([&log, f] {
+                Log::info("child %d", f);
+                log.flush();
+                // The threads which were logging in the parent don't keep the
+                // logger pinned in the child.
+                return Log::replace(nullptr) == &log;
+            }));
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        this->stop_logging();
+        Log::replace(nullptr);
+    }
+
+    // Each child's message is output once, and the messages which were
+    // waiting when the children forked aren't output again by them.
+    auto counts = count_messages(read_file(this->path));
+    for (int f = 0; f < NUM_FORKS; f++) {
+        EXPECT_EQ(counts["child " + std::to_string(f)], 1);
+    }
+    this->check_messages(counts);
+}
+
+TEST_F(ForkTest, LinuxColorLog) {
+    FILE* fs = fopen(this->path.c_str(), "w");
+    ASSERT_NE(fs, nullptr);
+    // Fully buffered, so that a fork which doesn't flush would duplicate lines.
+    setvbuf(fs, nullptr, _IOFBF, 65536);
+    {
+        LinuxColorLog log(fs);
+        this->start_logging();
+        for (int f = 0; f < NUM_FORKS; f++) {
+            EXPECT_TRUE(run_child([f] {
+                Log::info("child %d", f);
+                return true;
+            }));
+        }
+        this->stop_logging();
+        Log::replace(nullptr);
+    }
+    fclose(fs);
+
+    auto counts = count_messages(read_file(this->path));
+    for (int f = 0; f < NUM_FORKS; f++) {
+        EXPECT_EQ(counts["child " + std::to_string(f)], 1);
+    }
+    this->check_messages(counts);
+}
+
+TEST_F(ForkTest, UringFileLogClosedInChild) {
+    {
+        UringFileLog log(this->path.c_str());
+        ASSERT_TRUE(log.is_open());
+        this->start_logging();
+        EXPECT_TRUE(run_child([&log] {
+            Log::info("child");
+            log.flush();
+            return !log.is_open();
+        }));
+        this->stop_logging();
+        EXPECT_TRUE(log.is_open());
+        Log::replace(nullptr);
+    }
+    auto counts = count_messages(read_file(this->path));
+    EXPECT_EQ(counts.count("child"), 0u);
+    this->check_messages(counts);
+}
+
+TEST_F(ForkTest, MmapFileLogClosedInChild) {
+    {
+        MmapFileLog log(this->path.c_str());
+        ASSERT_TRUE(log.is_open());
+        this->start_logging();
+        EXPECT_TRUE(run_child([&log] {
+            Log::info("child");
+            return !log.is_open();
+        }));
+        this->stop_logging();
+        EXPECT_TRUE(log.is_open());
+        Log::replace(nullptr);
+    }
+    auto counts = count_messages(read_file(this->path));
+    EXPECT_EQ(counts.count("child"), 0u);
+    this->check_messages(counts);
+}
+
+#if LOG_STATS_ENABLED
+
+TEST_F(ForkTest, StatsWhileThreadsStartAndExit) {
+    LinuxColorLog log(stdout);
+    log.set_level(Log::Level::INFO);
+
+    // Each thread registers its statistics on its first message, and
+    // retires them when it exits, so the registry is constantly locked.
+    std::thread churn([this] {
+        while (!this->stop.load()) {
+            std::thread([] { Log::debug("suppressed"); }).join();
+        }
+    });
+    // The window where the registry is locked is small, so it takes a lot
+    // of forks to hit it.
+    for (int f = 0; f < 500; f++) {
+        EXPECT_TRUE(run_child([] {
+            uint64_t suppressed = Log::stats().suppressed[static_cast<size_t>(Log::Level::DEBUG)];
+            std::thread([] { Log::debug("suppressed"); }).join();
+            return Log::stats().suppressed[static_cast<size_t>(Log::Level::DEBUG)] == suppressed + 1;
+        }));
+    }
+    this->stop.store(true);
+    churn.join();
+    Log::replace(nullptr);
+}
+
+#endif  // LOG_STATS_ENABLED
@@ -0,0 +1,176 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   KeyValueTest.cpp
+ *
+ *   @brief  Tests for functions in KeyValue.cpp
+ *
+ ****************************************************************************/
+
+#include <stdarg.h>
+#include <gtest/gtest.h>
+
+#include <climits>
+#include <string>
+#include <string_view>
+
+#include "duino_log/KeyValue.h"
+#include "duino_log/LineLog.h"
+#include "duino_util/Util.h"
+
+//! Logger which records the messages passed to do_log.
+class TestKvLog : public Log {
+ public:
+    Level last_level;  //!< Level of the last message.
+    std::string line;  //!< Last message.
+
+ protected:
+    //! Records the message.
+    void do_log(Level level, const char* fmt, va_list args) override {
+        char log_line[Log::MAX_KV_LEN];
+        this->last_level = level;
+        vStrPrintf(log_line, LEN(log_line), fmt, args);
+        this->line = log_line;
+    }
+};
+
+//! Logger which records the lines passed to write_line.
+class TestKvLineLog : public LineLog {
+ public:
+    std::string line;  //!< Accumulated output.
+
+ protected:
+    //! Records the line.
+    void write_line(Level level, const char* line, size_t len) override {
+        (void)level;
+        this->line.append(line, len);
+    }
+};
+
+//! Helper which encodes its arguments using encode_logfmt.
+template <typename... Fields>
+static std::string logfmt(const char* msg, const Fields&... fields) {
+    const KeyValue kvs[] = {fields..., KeyValue()};
+    char out[256];
+    size_t len = Log::encode_logfmt(out, LEN(out), Log::Level::INFO, msg, kvs, sizeof...(fields));
+    EXPECT_EQ(len, strlen(out));
+    return out;
+}
+
+//! Helper which encodes its arguments using encode_json.
+template <typename... Fields>
+static std::string json(const char* msg, const Fields&... fields) {
+    const KeyValue kvs[] = {fields..., KeyValue()};
+    char out[256];
+    size_t len = Log::encode_json(out, LEN(out), Log::Level::INFO, msg, kvs, sizeof...(fields));
+    EXPECT_EQ(len, strlen(out));
+    return out;
+}
+
+TEST(KeyValueTest, Logfmt) {
+    std::string path = "/index.html";
+    std::string_view view = "view";
+    EXPECT_EQ(
+        logfmt("Done", kv("id", 42), kv("path", path), kv("v", view)),
+        "level=info msg=Done id=42 path=/index.html v=view");
+    EXPECT_EQ(
+        logfmt("Request done", kv("neg", -7), kv("ok", true), kv("bad", false)),
+        "level=info msg=\"Request done\" neg=-7 ok=true bad=false");
+    EXPECT_EQ(
+        logfmt("x", kv("min", LLONG_MIN), kv("max", ULLONG_MAX)),
+        "level=info msg=x min=-9223372036854775808 max=18446744073709551615");
+    EXPECT_EQ(logfmt("x", kv("c", 'A'), kv("u8", (uint8_t)200)), "level=info msg=x c=65 u8=200");
+    EXPECT_EQ(logfmt("x", kv("null", (const char*)nullptr)), "level=info msg=x null=(null)");
+}
+
+TEST(KeyValueTest, LogfmtQuoting) {
+    EXPECT_EQ(logfmt("x", kv("s", "")), "level=info msg=x s=\"\"");
+    EXPECT_EQ(logfmt("x", kv("s", "a=b")), "level=info msg=x s=\"a=b\"");
+    EXPECT_EQ(logfmt("x", kv("s", "say \"hi\"")), "level=info msg=x s=\"say \\\"hi\\\"\"");
+    EXPECT_EQ(logfmt("x", kv("s", "a\\b")), "level=info msg=x s=\"a\\\\b\"");
+    EXPECT_EQ(logfmt("x", kv("s", "line1\nline2")), "level=info msg=x s=\"line1\\nline2\"");
+    // Special characters after the first 8 characters.
+    EXPECT_EQ(
+        logfmt("x", kv("s", "abcdefghij klm")), "level=info msg=x s=\"abcdefghij klm\"");
+    EXPECT_EQ(logfmt("x", kv("s", "abcdefghijklmnop")), "level=info msg=x s=abcdefghijklmnop");
+}
+
+TEST(KeyValueTest, Json) {
+    EXPECT_EQ(json("Done"), "{\"level\":\"info\",\"msg\":\"Done\"}");
+    EXPECT_EQ(
+        json("Request done", kv("id", 42), kv("path", "/a b"), kv("ok", true)),
+        "{\"level\":\"info\",\"msg\":\"Request done\",\"id\":42,\"path\":\"/a b\",\"ok\":true}");
+    EXPECT_EQ(
+        json("x", kv("neg", INT64_MIN)),
+        "{\"level\":\"info\",\"msg\":\"x\",\"neg\":-9223372036854775808}");
+}
+
+TEST(KeyValueTest, JsonEscaping) {
+    EXPECT_EQ(
+        json("x", kv("s", "\"\\\n\r\t\b\f")),
+        "{\"level\":\"info\",\"msg\":\"x\",\"s\":\"\\\"\\\\\\n\\r\\t\\b\\f\"}");
+    EXPECT_EQ(
+        json("x", kv("s", "\x01\x1f")),
+        "{\"level\":\"info\",\"msg\":\"x\",\"s\":\"\\u0001\\u001f\"}");
+    EXPECT_EQ(
+        json("x", kv("s", std::string("a\0b", 3))),
+        "{\"level\":\"info\",\"msg\":\"x\",\"s\":\"a\\u0000b\"}");
+    EXPECT_EQ(
+        json("x", kv("s", "0123456789abcdef\"0123456789abcdef")),
+        "{\"level\":\"info\",\"msg\":\"x\",\"s\":\"0123456789abcdef\\\"0123456789abcdef\"}");
+    // Characters with the high bit set are passed through.
+    EXPECT_EQ(json("x", kv("s", "caf\xc3\xa9")), "{\"level\":\"info\",\"msg\":\"x\",\"s\":\"caf\xc3\xa9\"}");
+}
+
+TEST(KeyValueTest, Truncated) {
+    const KeyValue kvs[] = {kv("id", 42), kv("path", "/this/is/too/long")};
+    char out[40];
+
+    EXPECT_EQ(
+        Log::encode_json(out, LEN(out), Log::Level::ERROR, "Done", kvs, LEN(kvs)),
+        strlen("{\"level\":\"error\",\"msg\":\"Done\",\"id\":42}"));
+    EXPECT_STREQ(out, "{\"level\":\"error\",\"msg\":\"Done\",\"id\":42}");
+
+    EXPECT_EQ(Log::encode_logfmt(out, 20, Log::Level::ERROR, "Done", kvs, LEN(kvs)), 19);
+    EXPECT_STREQ(out, "level=error msg=Don");
+
+    EXPECT_EQ(Log::encode_json(out, 2, Log::Level::ERROR, "Done", kvs, LEN(kvs)), 0);
+    EXPECT_STREQ(out, "");
+}
+
+TEST(KeyValueTest, DefaultDoLogKv) {
+    TestKvLog log;
+
+    Log::warning_kv("Slow", kv("ms", 250));
+    EXPECT_EQ(log.last_level, Log::Level::WARNING);
+    EXPECT_EQ(log.line, "level=warning msg=Slow ms=250");
+
+    log.kv_format = Log::KvFormat::JSON;
+    Log::error_kv("Failed", kv("errno", 2));
+    EXPECT_EQ(log.last_level, Log::Level::ERROR);
+    EXPECT_EQ(log.line, "{\"level\":\"error\",\"msg\":\"Failed\",\"errno\":2}");
+
+    log.set_level(Log::Level::INFO);
+    log.line.clear();
+    Log::debug_kv("Hidden", kv("id", 1));
+    EXPECT_EQ(log.line, "");
+}
+
+TEST(KeyValueTest, LineLog) {
+    TestKvLineLog log;
+
+    Log::info_kv("Request done", kv("id", 42));
+    log.kv_format = Log::KvFormat::JSON;
+    Log::debug_kv("Done");
+    EXPECT_EQ(
+        log.line,
+        "level=info msg=\"Request done\" id=42\n"
+        "{\"level\":\"debug\",\"msg\":\"Done\"}\n");
+}
@@ -0,0 +1,110 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   LineLogTest.cpp
+ *
+ *   @brief  Tests for functions in LineLog.cpp
+ *
+ ****************************************************************************/
+
+#include <stdarg.h>
+#include <gtest/gtest.h>
+#include <string>
+
+#include "duino_log/LineLog.h"
+#include "duino_util/Util.h"
+
+//! Logger which records the lines passed to write_line.
+class TestLineLog : public LineLog {
+ public:
+    Level last_level;  //!< Level of the last line.
+    std::string line;  //!< Accumulated output.
+
+ protected:
+    //! Records the line.
+    void write_line(Level level, const char* line, size_t len) override {
+        this->last_level = level;
+        this->line.append(line, len);
+    }
+};
+
+//! Helper function for calling format_line.
+static size_t format(char* line, size_t lineLen, Log::Level level, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    size_t len = LineLog::format_line(line, lineLen, level, fmt, args);
+    va_end(args);
+    return len;
+}
+
+TEST(LineLogTest, FormatLine) {
+    char line[32];
+
+    EXPECT_EQ(format(line, LEN(line), Log::Level::INFO, "Test %d", 42), 12);
+    EXPECT_STREQ(line, "[I] Test 42\n");
+
+    EXPECT_EQ(format(line, LEN(line), Log::Level::NONE, ""), 1);
+    EXPECT_STREQ(line, "\n");
+}
+
+TEST(LineLogTest, FormatLineTruncated) {
+    char line[10];
+
+    EXPECT_EQ(format(line, LEN(line), Log::Level::ERROR, "This is too long"), 9);
+    EXPECT_STREQ(line, "[E] This\n");
+
+    EXPECT_EQ(format(line, 4, Log::Level::ERROR, "Test"), 3);
+    EXPECT_STREQ(line, "[E\n");
+}
+
+TEST(LineLogTest, WriteLine) {
+    TestLineLog log;
+
+    Log::warning("Warning %s", "message");
+    EXPECT_EQ(log.last_level, Log::Level::WARNING);
+    Log::debug("Debug");
+    EXPECT_EQ(log.last_level, Log::Level::DEBUG);
+    EXPECT_EQ(log.line, "[W] Warning message\n[D] Debug\n");
+}
+
+TEST(LineLogTest, Dedup) {
+    TestLineLog log;
+    log.set_dedup(Log::Level::ERROR, true);
+
+    for (int i = 0; i < 5; i++) {
+        Log::error("Disk full");
+    }
+    Log::error("Disk ok");
+    Log::error("Disk ok");
+    // Levels which aren't collapsed still output the count first.
+    Log::info("Info");
+    Log::info("Info");
+    EXPECT_EQ(
+        log.line,
+        "[E] Disk full\n"
+        "[E] last message repeated 4 times\n"
+        "[E] Disk ok\n"
+        "[E] last message repeated 1 times\n"
+        "[I] Info\n"
+        "[I] Info\n");
+
+    log.line.clear();
+    Log::error("Disk full");
+    Log::error("Disk full");
+    Log::error("Disk full");
+    log.flush_repeats();
+    log.set_dedup(Log::Level::ERROR, false);
+    Log::error("Disk full");
+    EXPECT_EQ(
+        log.line,
+        "[E] Disk full\n"
+        "[E] last message repeated 2 times\n"
+        "[E] Disk full\n");
+}
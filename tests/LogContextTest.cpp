@@ -0,0 +1,164 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   LogContextTest.cpp
+ *
+ *   @brief  Tests for functions in LogContext.cpp
+ *
+ ****************************************************************************/
+
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+
+#include "duino_log/LineLog.h"
+#include "duino_log/LogContext.h"
+#include "duino_log/Str.h"
+
+//! Logger which records the lines passed to write_line.
+class ContextLineLog : public LineLog {
+ public:
+    std::string line;  //!< Accumulated output.
+
+ protected:
+    //! Records the line.
+    void write_line(Level, const char* line, size_t len) override {
+        this->line.append(line, len);
+    }
+};
+
+//! Logger which isn't a LineLog, and puts the context in front of each
+//! message itself (like LinuxColorLog).
+class ContextPrefixLog : public Log {
+ public:
+    std::string line;  //!< Accumulated output.
+
+ protected:
+    //! Records the context prefix and the message.
+    void do_log(Level, const char* fmt, va_list args) override {
+        char msg[256];
+        this->line.append(msg, LogContext::copy_prefix(msg, sizeof(msg)));
+        this->line.append(msg, vStrPrintf(msg, sizeof(msg), fmt, args));
+        this->line += '\n';
+    }
+};
+
+TEST(LogContextTest, Stack) {
+    EXPECT_EQ(LogContext::current(), nullptr);
+    {
+        LogContext thread("thread", "worker1");
+        EXPECT_EQ(LogContext::current(), &thread);
+        EXPECT_STREQ(thread.prefix(), "thread=worker1 ");
+        {
+            LogContext req("req", 42);
+            EXPECT_EQ(LogContext::current(), &req);
+            EXPECT_EQ(req.parent(), &thread);
+            EXPECT_STREQ(req.prefix(), "thread=worker1 req=42 ");
+            EXPECT_EQ(req.prefix_len(), 22u);
+        }
+        EXPECT_EQ(LogContext::current(), &thread);
+    }
+    EXPECT_EQ(LogContext::current(), nullptr);
+}
+
+TEST(LogContextTest, ValueCopied) {
+    std::string user = "Dave Hylands";
+    LogContext ctx("user", user);
+    user = "Somebody else";
+    EXPECT_STREQ(ctx.prefix(), "user=\"Dave Hylands\" ");
+    EXPECT_EQ(ctx.field().type, KeyValue::Type::STRING);
+    EXPECT_EQ(std::string(ctx.field().s.str, ctx.field().s.len), "Dave Hylands");
+
+    std::string longValue(100, 'x');
+    LogContext longCtx("long", longValue);
+    EXPECT_EQ(longCtx.field().s.len, LogContext::MAX_VALUE_LEN - 1);
+}
+
+TEST(LogContextTest, PrefixFull) {
+    std::string value(LogContext::MAX_VALUE_LEN - 1, 'x');
+    LogContext a("a", value);
+    LogContext b("b", value);
+    LogContext c("c", value);
+    EXPECT_EQ(c.prefix_len(), 2 * (value.size() + 3));
+
+    // Fields which don't fit are left out, but smaller ones may still fit.
+    LogContext d("d", 1);
+    EXPECT_EQ(d.prefix_len(), c.prefix_len() + 4);
+    EXPECT_LT(d.prefix_len(), LogContext::MAX_PREFIX_LEN);
+}
+
+TEST(LogContextTest, PerThread) {
+    LogContext ctx("thread", "main");
+    const LogContext* other = &ctx;
+    std::thread thread([&other] {
+        other = LogContext::current();
+    });
+    thread.join();
+    EXPECT_EQ(other, nullptr);
+    EXPECT_EQ(LogContext::current(), &ctx);
+}
+
+TEST(LogContextTest, LineLog) {
+    ContextLineLog log;
+
+    Log::info("Before");
+    {
+        LogContext ctx("req", 7);
+        Log::info("During %d", 1);
+    }
+    Log::info("After");
+    EXPECT_EQ(log.line, "[I] Before\n[I] req=7 During 1\n[I] After\n");
+}
+
+TEST(LogContextTest, KeyValue) {
+    ContextLineLog log;
+
+    LogContext thread("thread", "io");
+    LogContext req("req", 7);
+    Log::info_kv("Done", kv("bytes", 10));
+    log.kv_format = Log::KvFormat::JSON;
+    Log::info_kv("Done", kv("bytes", 10));
+    EXPECT_EQ(
+        log.line,
+        "level=info msg=Done thread=io req=7 bytes=10\n"
+        "{\"level\":\"info\",\"msg\":\"Done\",\"thread\":\"io\",\"req\":7,\"bytes\":10}\n");
+}
+
+TEST(LogContextTest, KeyValueNotLineLog) {
+    ContextPrefixLog log;
+
+    LogContext req("req", 42);
+    Log::info_kv("Done", kv("id", 1));
+    log.kv_format = Log::KvFormat::JSON;
+    Log::info_kv("Done", kv("id", 1));
+    // The context is only output once, by do_log().
+    EXPECT_EQ(
+        log.line,
+        "req=42 level=info msg=Done id=1\n"
+        "req=42 {\"level\":\"info\",\"msg\":\"Done\",\"id\":1}\n");
+}
+
+TEST(LogContextTest, Snapshot) {
+    LogContext::Snapshot snapshot;
+    EXPECT_TRUE(snapshot.matches(nullptr));
+    {
+        LogContext ctx("req", 7);
+        EXPECT_FALSE(snapshot.matches(&ctx));
+        snapshot.capture(&ctx);
+        EXPECT_TRUE(snapshot.matches(&ctx));
+        EXPECT_FALSE(snapshot.matches(nullptr));
+    }
+    EXPECT_STREQ(snapshot.prefix, "req=7 ");
+    EXPECT_EQ(snapshot.len, 6u);
+
+    snapshot.capture(nullptr);
+    EXPECT_STREQ(snapshot.prefix, "");
+    EXPECT_EQ(snapshot.len, 0u);
+}
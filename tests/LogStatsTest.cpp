@@ -0,0 +1,180 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   LogStatsTest.cpp
+ *
+ *   @brief  Tests for functions in LogStats.cpp
+ *
+ ****************************************************************************/
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+
+#include "duino_log/LineLog.h"
+#include "duino_log/LogStats.h"
+
+//! Logger which discards the lines passed to write_line.
+class NullLineLog : public LineLog {
+ protected:
+    //! Discards the line.
+    void write_line(Level level, const char* line, size_t len) override {
+        (void)level;
+        (void)line;
+        (void)len;
+    }
+};
+
+TEST(LogHistogramTest, Buckets) {
+    for (uint64_t value = 0; value < 4; value++) {
+        EXPECT_EQ(LogHistogram::bucket(value), value);
+        EXPECT_EQ(LogHistogram::bucket_min(value), value);
+    }
+    EXPECT_EQ(LogHistogram::bucket(4), 4);
+    EXPECT_EQ(LogHistogram::bucket(7), 7);
+    EXPECT_EQ(LogHistogram::bucket(8), 8);
+    EXPECT_EQ(LogHistogram::bucket(9), 8);
+    EXPECT_EQ(LogHistogram::bucket(10), 9);
+    EXPECT_EQ(LogHistogram::bucket(UINT64_MAX), LogHistogram::NUM_BUCKETS - 1);
+
+    // Each bucket starts where the previous one ended.
+    for (size_t i = 1; i < LogHistogram::NUM_BUCKETS; i++) {
+        uint64_t min = LogHistogram::bucket_min(i);
+        EXPECT_EQ(LogHistogram::bucket(min), i);
+        EXPECT_EQ(LogHistogram::bucket(min - 1), i - 1);
+    }
+}
+
+TEST(LogHistogramTest, Percentile) {
+    LogHistogram hist;
+    EXPECT_EQ(hist.percentile(50.0), 0);
+    EXPECT_EQ(hist.max(), 0);
+
+    for (uint64_t value = 1; value <= 100; value++) {
+        hist.counts[LogHistogram::bucket(value * 1000)]++;
+    }
+    EXPECT_EQ(hist.total(), 100);
+    // Values are reported as the lower bound of their bucket (within 25%).
+    EXPECT_LE(hist.percentile(50.0), 50000);
+    EXPECT_GT(hist.percentile(50.0), 50000 * 3 / 4);
+    EXPECT_LE(hist.percentile(99.0), 99000);
+    EXPECT_GT(hist.percentile(99.0), 99000 * 3 / 4);
+    EXPECT_EQ(hist.max(), LogHistogram::bucket_min(LogHistogram::bucket(100000)));
+}
+
+#if LOG_STATS_ENABLED
+
+//! Returns the statistics recorded since `before`.
+static LogStats since(const LogStats& before) {
+    LogStats stats = Log::stats();
+    for (size_t i = 0; i < LogStats::NUM_LEVELS; i++) {
+        stats.messages[i] -= before.messages[i];
+        stats.suppressed[i] -= before.suppressed[i];
+        stats.dropped[i] -= before.dropped[i];
+    }
+    stats.bytes -= before.bytes;
+    stats.truncated -= before.truncated;
+    for (size_t t = 0; t < LogStats::NUM_TIMERS; t++) {
+        for (size_t i = 0; i < LogHistogram::NUM_BUCKETS; i++) {
+            stats.latency_ns[t].counts[i] -= before.latency_ns[t].counts[i];
+        }
+    }
+    return stats;
+}
+
+//! Returns the index of a level.
+static size_t idx(Log::Level level) {
+    return static_cast<size_t>(level);
+}
+
+TEST(LogStatsTest, Counters) {
+    NullLineLog log;
+    log.set_level(Log::Level::INFO);
+    LogStats before = Log::stats();
+
+    Log::info("Line %d", 1);
+    Log::error("Line %d", 2);
+    Log::log(Log::Level::WARNING, "Line %d", 3);
+    Log::info_kv("Line", kv("n", 4));
+    Log::debug("Suppressed");
+    Log::debug("Suppressed");
+    Log::info("%s", std::string(LineLog::MAX_LINE_LEN, 'x').c_str());
+
+    LogStats stats = since(before);
+    EXPECT_EQ(stats.messages[idx(Log::Level::INFO)], 3);
+    EXPECT_EQ(stats.messages[idx(Log::Level::ERROR)], 1);
+    EXPECT_EQ(stats.messages[idx(Log::Level::WARNING)], 1);
+    EXPECT_EQ(stats.suppressed[idx(Log::Level::DEBUG)], 2);
+    EXPECT_EQ(stats.suppressed[idx(Log::Level::INFO)], 0);
+    EXPECT_EQ(stats.truncated, 1);
+    EXPECT_EQ(
+        stats.bytes,
+        strlen("[I] Line 1\n[E] Line 2\n[W] Line 3\nlevel=info msg=Line n=4\n") +
+            LineLog::MAX_LINE_LEN - 1);
+
+}
+
+TEST(LogStatsTest, Latency) {
+    NullLineLog log;
+    LogStats before = Log::stats();
+
+    // Latencies are sampled.
+    for (uint32_t i = 0; i < LogStats::LATENCY_SAMPLE_INTERVAL * 2; i++) {
+        Log::info("Line %" PRIu32, i);
+    }
+
+    LogStats stats = since(before);
+    EXPECT_EQ(stats.latency(LogStats::Timer::TOTAL).total(), 2);
+    EXPECT_EQ(stats.latency(LogStats::Timer::FORMAT).total(), 2);
+    EXPECT_EQ(stats.latency(LogStats::Timer::WRITE).total(), 2);
+    EXPECT_GT(stats.latency(LogStats::Timer::TOTAL).max(), 0);
+}
+
+TEST(LogStatsTest, ExitedThreads) {
+    NullLineLog log;
+    LogStats before = Log::stats();
+
+    std::thread thread([] {
+        for (int i = 0; i < 100; i++) {
+            Log::debug("Thread line %d", i);
+        }
+    });
+    thread.join();
+    Log::debug("Main line");
+
+    EXPECT_EQ(since(before).messages[idx(Log::Level::DEBUG)], 101);
+}
+
+TEST(LogStatsTest, Dumper) {
+    NullLineLog log;
+    Log::info("Line");
+
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    {
+        LogStatsDumper dumper(std::chrono::milliseconds(10), fds[1]);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    close(fds[1]);
+
+    char buf[4096];
+    ssize_t len = read(fds[0], buf, sizeof(buf) - 1);
+    close(fds[0]);
+    ASSERT_GT(len, 0);
+    buf[len] = '\0';
+    std::string summary(buf);
+    EXPECT_EQ(summary.rfind("log stats: messages F=", 0), 0) << summary;
+    EXPECT_NE(summary.find(" total_ns(p50/p99/max)="), std::string::npos) << summary;
+    EXPECT_EQ(summary.back(), '\n');
+}
+
+#endif  // LOG_STATS_ENABLED
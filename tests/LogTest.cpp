@@ -16,7 +16,12 @@
 
 #include <stdarg.h>
 #include <gtest/gtest.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
 #include <string>
+#include <tuple>
 #include <sstream>
 
 #include "duino_log/Log.h"
@@ -118,6 +123,11 @@ TEST(LogTest, LogMessagges) {
     EXPECT_EQ(log.last_level, Log::Level::INFO);
     EXPECT_STREQ(log.line.c_str(), "This is an info log\nSecond line");
 
+    log.line.clear();
+    Log::log(Log::Level::WARNING, "This is a warning log");
+    EXPECT_EQ(log.last_level, Log::Level::WARNING);
+    EXPECT_STREQ(log.line.c_str(), "This is a warning log");
+
     log.line.clear();
     test_vlog("This is a vlog log");
     EXPECT_EQ(log.last_level, Log::Level::INFO);
@@ -158,6 +168,148 @@ TEST(LogTest, LogMessaggesTurnedOffByLogLevel) {
     EXPECT_STREQ(log.line.c_str(), "");
 }
 
+//! Filter which only allows messages with a particular format string.
+class FormatFilter : public Log::Filter {
+ public:
+    explicit FormatFilter(const char* allowed) : allowed{allowed} {}
+
+    bool allow(Log::Level level, const char* fmt) override {
+        (void)level;
+        return strcmp(fmt, this->allowed) == 0;
+    }
+
+    const char* allowed;  //!< Format string which is allowed.
+};
+
+//! Test that lazy arguments are only computed for messages which are logged.
+TEST(LogTest, LazyMessages) {
+    TestLog log;
+    int calls = 0;
+
+    Log::debug_lazy("Value %d", [&] { return ++calls; });
+    EXPECT_EQ(calls, 1);
+    EXPECT_STREQ(log.line.c_str(), "Value 1");
+
+    log.line.clear();
+    Log::info_lazy("%s has %d items", [&] {
+        calls++;
+        return std::make_tuple(std::string("list"), 3);
+    });
+    EXPECT_EQ(calls, 2);
+    EXPECT_EQ(log.last_level, Log::Level::INFO);
+    EXPECT_STREQ(log.line.c_str(), "list has 3 items");
+
+    log.line.clear();
+    Log::error_lazy([&] {
+        calls++;
+        return std::string("Summary");
+    });
+    EXPECT_EQ(calls, 3);
+    EXPECT_EQ(log.last_level, Log::Level::ERROR);
+    EXPECT_STREQ(log.line.c_str(), "Summary");
+
+    log.line.clear();
+    log.set_level(Log::Level::INFO);
+    Log::debug_lazy("Value %d", [&] { return ++calls; });
+    Log::debug_lazy([&] {
+        calls++;
+        return "Summary";
+    });
+    EXPECT_EQ(calls, 3);
+    EXPECT_STREQ(log.line.c_str(), "");
+
+    // The filter is consulted before the arguments are computed.
+    FormatFilter filter("Allowed %d");
+    log.set_filter(&filter);
+    Log::warning_lazy("Blocked %d", [&] { return ++calls; });
+    EXPECT_EQ(calls, 3);
+    Log::warning_lazy("Allowed %d", [&] { return ++calls; });
+    EXPECT_EQ(calls, 4);
+    EXPECT_STREQ(log.line.c_str(), "Allowed 4");
+    log.set_filter(nullptr);
+}
+
+//! Test that LOG_IF_ENABLED only runs its block when the level is enabled.
+TEST(LogTest, LogIfEnabled) {
+    int calls = 0;
+    LOG_IF_ENABLED(Log::Level::FATAL) {
+        calls++;
+    }
+    EXPECT_EQ(calls, 0);
+
+    TestLog log;
+    log.set_level(Log::Level::WARNING);
+    LOG_IF_ENABLED(Log::Level::DEBUG) {
+        calls++;
+    }
+    EXPECT_EQ(calls, 0);
+    LOG_IF_ENABLED(Log::Level::WARNING) {
+        calls++;
+        Log::warning("Computed %d", calls);
+    }
+    EXPECT_EQ(calls, 1);
+    EXPECT_STREQ(log.line.c_str(), "Computed 1");
+
+    if (calls == 0)
+        LOG_IF_ENABLED(Log::Level::ERROR) calls += 10;
+    else
+        calls += 100;
+    EXPECT_EQ(calls, 101);
+}
+
+//! Reads what's been written to a pipe.
+static std::string read_pipe(int fd) {
+    char buf[Log::MAX_EMERGENCY_LEN * 2];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    return std::string(buf, n > 0 ? static_cast<size_t>(n) : 0);
+}
+
+//! Signal handler which logs using Log::emergency().
+static void emergency_handler(int sig) {
+    Log::emergency("Caught signal %d", sig);
+}
+
+//! Test that emergency messages bypass the logger.
+TEST(LogTest, Emergency) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    Log::set_emergency_fd(fds[1]);
+
+    {
+        TestLog log;
+        log.set_level(Log::Level::NONE);
+        Log::emergency("Crashed at 0x%x with %d", 0x1234, 11);
+        EXPECT_STREQ(log.line.c_str(), "");
+    }
+    EXPECT_EQ(read_pipe(fds[0]), "[F] Crashed at 0x1234 with 11\n");
+
+    // Without a logger, and with an empty message.
+    errno = EAGAIN;
+    Log::emergency("%s", "");
+    EXPECT_EQ(errno, EAGAIN);
+    EXPECT_EQ(read_pipe(fds[0]), "[F] \n");
+
+    // Long messages are truncated, but keep their newline.
+    std::string long_msg(Log::MAX_EMERGENCY_LEN * 2, 'x');
+    Log::emergency("%s", long_msg.c_str());
+    std::string line = read_pipe(fds[0]);
+    EXPECT_EQ(line.size(), Log::MAX_EMERGENCY_LEN - 1);
+    EXPECT_EQ(line.back(), '\n');
+
+    // From a signal handler.
+    struct sigaction action = {};
+    struct sigaction prev_action;
+    action.sa_handler = emergency_handler;
+    ASSERT_EQ(sigaction(SIGUSR1, &action, &prev_action), 0);
+    raise(SIGUSR1);
+    sigaction(SIGUSR1, &prev_action, nullptr);
+    EXPECT_EQ(read_pipe(fds[0]), "[F] Caught signal " + std::to_string(SIGUSR1) + "\n");
+
+    Log::set_emergency_fd(2);
+    close(fds[0]);
+    close(fds[1]);
+}
+
 //! These test the logger != nullptr portion of the if test
 TEST(LogTest, NoLogger) {
     Log::debug("This is a debug log");
@@ -167,4 +319,6 @@ TEST(LogTest, NoLogger) {
     Log::fatal("This is a fatal log");
     Log::log(Log::Level::INFO, "This is an info log");
     test_vlog("This is a vlog log");
+    Log::debug_lazy("This is a lazy log %d", [] { return 1; });
+    EXPECT_FALSE(Log::enabled(Log::Level::FATAL));
 }
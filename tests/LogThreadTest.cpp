@@ -0,0 +1,154 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   LogThreadTest.cpp
+ *
+ *   @brief  Tests for using the Log class from multiple threads.
+ *
+ *   These are most useful when run under ThreadSanitizer.
+ *
+ ****************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "duino_log/LineLog.h"
+#include "duino_log/SamplingFilter.h"
+
+//! Logger which checks that it's still alive whenever it's used.
+class CheckedLog : public LineLog {
+ public:
+    //! Value of `m_magic` while the logger is alive.
+    static constexpr uint32_t ALIVE = 0x600d10c;
+
+    //! Constructor.
+    explicit CheckedLog(
+        Install install = Install::NOW  //!< [in] When to make this the current logger.
+        )
+        : LineLog(install) {
+        this->m_magic.store(ALIVE);
+    }
+
+    //! Destructor.
+
+    ~CheckedLog() override {
+        this->detach();
+        this->m_magic.store(0);
+    }
+
+    static std::atomic<uint64_t> num_lines;  //!< Lines written by all CheckedLogs.
+    static std::atomic<uint64_t> num_dead;   //!< Lines written to a destroyed CheckedLog.
+
+ protected:
+    //! Counts the line, and checks that the logger is alive.
+    void write_line(Level level, const char* line, size_t len) override {
+        (void)level;
+        (void)line;
+        (void)len;
+        // Spend some time in the logger, so that replacing it races with this.
+        std::this_thread::yield();
+        if (this->m_magic.load() != ALIVE) {
+            num_dead++;
+        }
+        num_lines++;
+    }
+
+ private:
+    std::atomic<uint32_t> m_magic{0};  //!< Set to ALIVE while the logger is alive.
+};
+
+std::atomic<uint64_t> CheckedLog::num_lines{0};
+std::atomic<uint64_t> CheckedLog::num_dead{0};
+
+//! Starts threads which log until `stop` is set.
+static std::vector<std::thread> start_workers(std::atomic<bool>* stop) {
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; t++) {
+        workers.emplace_back([stop, t] {
+            uint32_t i = 0;
+            while (!stop->load(std::memory_order_relaxed)) {
+                Log::info("Worker %d line %" PRIu32, t, i);
+                Log::debug("Worker %d debug %" PRIu32, t, i);
+                Log::info_kv("Worker", kv("t", t), kv("i", i));
+                i++;
+            }
+        });
+    }
+    return workers;
+}
+
+TEST(LogThreadTest, ChangeSettingsWhileLogging) {
+    CheckedLog log;
+    SamplingFilter filter;
+    filter.set_one_in(Log::Level::DEBUG, 4);
+    CheckedLog::num_lines = 0;
+
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> workers = start_workers(&stop);
+    for (int i = 0; i < 200; i++) {
+        log.set_level(i % 2 == 0 ? Log::Level::INFO : Log::Level::DEBUG);
+        log.set_filter(i % 3 == 0 ? &filter : nullptr);
+        log.kv_format = i % 2 == 0 ? Log::KvFormat::JSON : Log::KvFormat::LOGFMT;
+        log.set_dedup(Log::Level::DEBUG, i % 2 == 0);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    stop = true;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    log.set_filter(nullptr);
+    EXPECT_GT(CheckedLog::num_lines, 0);
+}
+
+TEST(LogThreadTest, ReplaceLoggerWhileLogging) {
+    CheckedLog::num_lines = 0;
+    CheckedLog::num_dead = 0;
+
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> workers = start_workers(&stop);
+    for (int i = 0; i < 200; i++) {
+        delete Log::replace(new CheckedLog(Log::Install::LATER));
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    // Remove the last logger.
+    delete Log::replace(nullptr);
+    stop = true;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    EXPECT_GT(CheckedLog::num_lines, 0);
+    EXPECT_EQ(CheckedLog::num_dead, 0);
+}
+
+TEST(LogThreadTest, DetachFromWithinLogger) {
+    //! Logger which detaches itself the first time it's used.
+    class SelfDetachingLog : public LineLog {
+     public:
+        int num_lines = 0;  //!< Number of lines written.
+
+     protected:
+        void write_line(Level level, const char* line, size_t len) override {
+            (void)level;
+            (void)line;
+            (void)len;
+            this->num_lines++;
+            this->detach();
+        }
+    };
+
+    SelfDetachingLog log;
+    Log::info("First");
+    Log::info("Second");
+    EXPECT_EQ(log.num_lines, 1);
+}
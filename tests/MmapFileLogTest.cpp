@@ -0,0 +1,145 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   MmapFileLogTest.cpp
+ *
+ *   @brief  Tests for functions in MmapFileLog.cpp
+ *
+ ****************************************************************************/
+
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cinttypes>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "duino_log/MmapFileLog.h"
+
+//! Test fixture which creates a temporary file name for the log file.
+class MmapFileLogTest : public ::testing::Test {
+ protected:
+    void SetUp() override {
+        char path[] = "/tmp/MmapFileLogTest.XXXXXX";
+        int fd = mkstemp(path);
+        ASSERT_GE(fd, 0);
+        close(fd);
+        this->path = path;
+    }
+
+    void TearDown() override { unlink(this->path.c_str()); }
+
+    //! Reads the contents of the log file.
+    std::string read_file() const {
+        std::ifstream in(this->path);
+        std::stringstream contents;
+        contents << in.rdbuf();
+        return contents.str();
+    }
+
+    std::string path;  //!< Path of the log file.
+};
+
+TEST_F(MmapFileLogTest, Simple) {
+    {
+        MmapFileLog log(this->path.c_str());
+        ASSERT_TRUE(log.is_open());
+        Log::info("Line %d", 1);
+        Log::error("Line %d", 2);
+        EXPECT_EQ(log.size(), 22);
+    }
+    EXPECT_EQ(this->read_file(), "[I] Line 1\n[E] Line 2\n");
+}
+
+TEST_F(MmapFileLogTest, Append) {
+    {
+        MmapFileLog log(this->path.c_str());
+        Log::info("Line 1");
+    }
+    {
+        MmapFileLog log(this->path.c_str(), 4096, MmapFileLog::SyncPolicy::LINE);
+        Log::info("Line 2");
+    }
+    EXPECT_EQ(this->read_file(), "[I] Line 1\n[I] Line 2\n");
+}
+
+TEST_F(MmapFileLogTest, Remap) {
+    std::string expected;
+    {
+        // Use the smallest window so that lines straddle windows.
+        MmapFileLog log(this->path.c_str(), 1, MmapFileLog::SyncPolicy::ERROR);
+        ASSERT_TRUE(log.is_open());
+        for (uint32_t i = 0; i < 2000; i++) {
+            Log::error("This is line %" PRIu32, i);
+            expected += "[E] This is line " + std::to_string(i) + "\n";
+        }
+    }
+    EXPECT_EQ(this->read_file(), expected);
+}
+
+TEST_F(MmapFileLogTest, MultipleThreads) {
+    static constexpr uint32_t NUM_THREADS = 4;
+    static constexpr uint32_t NUM_LINES = 5000;
+    {
+        MmapFileLog log(this->path.c_str(), 8192);
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < NUM_THREADS; t++) {
+            threads.emplace_back([t] {
+                for (uint32_t i = 0; i < NUM_LINES; i++) {
+                    Log::info("Thread %" PRIu32 " line %" PRIu32, t, i);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    std::istringstream contents(this->read_file());
+    std::set<std::string> lines;
+    std::string line;
+    while (std::getline(contents, line)) {
+        lines.insert(line);
+    }
+    EXPECT_EQ(lines.size(), NUM_THREADS * NUM_LINES);
+    EXPECT_EQ(lines.count("[I] Thread 3 line 4999"), 1);
+}
+
+TEST_F(MmapFileLogTest, Crash) {
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        // Simulate a crash by exiting without running the destructor.
+        auto log = new MmapFileLog(this->path.c_str());
+        Log::info("Before crash");
+        _exit(0);
+        delete log;
+    }
+    int status;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+
+    // The file contains the line followed by the null filled window.
+    std::string contents = this->read_file();
+    EXPECT_EQ(contents.size(), MmapFileLog::DEFAULT_WINDOW_SIZE);
+    EXPECT_STREQ(contents.c_str(), "[I] Before crash\n");
+
+    // Logging resumes after the data.
+    {
+        MmapFileLog log(this->path.c_str());
+        Log::info("After crash");
+    }
+    EXPECT_EQ(this->read_file(), "[I] Before crash\n[I] After crash\n");
+}
@@ -0,0 +1,115 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   RateLimitFilterTest.cpp
+ *
+ *   @brief  Tests for functions in RateLimitFilter.cpp
+ *
+ ****************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "duino_log/LineLog.h"
+#include "duino_log/RateLimitFilter.h"
+
+//! Logger which counts the lines passed to write_line.
+class CountingLog : public LineLog {
+ public:
+    std::atomic<uint32_t> num_lines{0};  //!< Number of lines written.
+    std::string last_line;               //!< Last line written.
+
+ protected:
+    //! Counts the line.
+    void write_line(Level level, const char* line, size_t len) override {
+        (void)level;
+        this->num_lines++;
+        this->last_line.assign(line, len);
+    }
+};
+
+TEST(RateLimitFilterTest, Burst) {
+    RateLimitFilter filter;
+    filter.set_limit(Log::Level::ERROR, 1, 3);
+
+    CountingLog log;
+    log.set_filter(&filter);
+    for (int i = 0; i < 10; i++) {
+        Log::error("Error %d", i);
+    }
+    EXPECT_EQ(log.num_lines, 3);
+    EXPECT_EQ(log.last_line, "[E] Error 2\n");
+    EXPECT_EQ(filter.num_suppressed(), 7);
+
+    // Other levels and other call sites aren't affected.
+    for (int i = 0; i < 10; i++) {
+        Log::info("Info %d", i);
+    }
+    Log::error("Another error");
+    EXPECT_EQ(log.num_lines, 14);
+    log.set_filter(nullptr);
+}
+
+TEST(RateLimitFilterTest, Refill) {
+    RateLimitFilter filter;
+    filter.set_limit(Log::Level::WARNING, 100, 1);
+
+    EXPECT_TRUE(filter.allow(Log::Level::WARNING, "fmt"));
+    EXPECT_FALSE(filter.allow(Log::Level::WARNING, "fmt"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_TRUE(filter.allow(Log::Level::WARNING, "fmt"));
+
+    // Removing the limit allows everything.
+    filter.set_limit(Log::Level::WARNING, 0, 0);
+    for (int i = 0; i < 10; i++) {
+        EXPECT_TRUE(filter.allow(Log::Level::WARNING, "fmt"));
+    }
+}
+
+TEST(RateLimitFilterTest, TableFull) {
+    RateLimitFilter filter;
+    filter.set_limit(Log::Level::INFO, 1, 1);
+
+    // Once the table fills up, new call sites are allowed.
+    std::vector<char> formats(RateLimitFilter::NUM_SLOTS * 2 * 8);
+    for (size_t i = 0; i < formats.size(); i += 8) {
+        const char* fmt = &formats[i];
+        EXPECT_TRUE(filter.allow(Log::Level::INFO, fmt));
+    }
+    EXPECT_FALSE(filter.allow(Log::Level::INFO, &formats[0]));
+}
+
+TEST(RateLimitFilterTest, MultipleThreads) {
+    static constexpr uint32_t NUM_THREADS = 4;
+    RateLimitFilter filter;
+    filter.set_limit(Log::Level::ERROR, 1, 50);
+
+    std::atomic<uint32_t> num_allowed{0};
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < NUM_THREADS; t++) {
+        threads.emplace_back([&filter, &num_allowed] {
+            for (uint32_t i = 0; i < 10000; i++) {
+                if (filter.allow(Log::Level::ERROR, "Shared call site")) {
+                    num_allowed++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    // The test might straddle a refill.
+    EXPECT_GE(num_allowed, 50);
+    EXPECT_LE(num_allowed, 51);
+}
@@ -0,0 +1,164 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   RingBufferLogTest.cpp
+ *
+ *   @brief  Tests for functions in RingBufferLog.cpp
+ *
+ ****************************************************************************/
+
+#include <gtest/gtest.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cinttypes>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "duino_log/RingBufferLog.h"
+
+//! Test fixture which creates a temporary file to dump to.
+class RingBufferLogTest : public ::testing::Test {
+ protected:
+    void SetUp() override {
+        char path[] = "/tmp/RingBufferLogTest.XXXXXX";
+        this->fd = mkstemp(path);
+        ASSERT_GE(this->fd, 0);
+        this->path = path;
+    }
+
+    void TearDown() override {
+        close(this->fd);
+        unlink(this->path.c_str());
+    }
+
+    //! Reads the contents of the dump file.
+    std::string read_file() const {
+        std::ifstream in(this->path);
+        std::stringstream contents;
+        contents << in.rdbuf();
+        return contents.str();
+    }
+
+    std::string path;  //!< Path of the dump file.
+    int fd = -1;       //!< File descriptor of the dump file.
+};
+
+TEST_F(RingBufferLogTest, Simple) {
+    RingBufferLog log(1024, this->fd);
+    EXPECT_EQ(log.size(), 1024);
+    Log::info("Line %d", 1);
+    Log::warning("Line %d", 2);
+    EXPECT_EQ(log.bytes_logged(), 22);
+    EXPECT_EQ(this->read_file(), "");
+
+    log.dump();
+    EXPECT_EQ(this->read_file(), "[I] Line 1\n[W] Line 2\n");
+}
+
+//! DumpFunc which appends to a std::string.
+static void append_to_string(void* param, const char* data, size_t len) {
+    static_cast<std::string*>(param)->append(data, len);
+}
+
+TEST_F(RingBufferLogTest, DumpFunc) {
+    RingBufferLog log(RingBufferLog::MAX_LINE_LEN, this->fd);
+    std::string contents;
+    for (int i = 0; i < 100; i++) {
+        Log::info("Line %d", i);
+    }
+    log.dump(append_to_string, &contents);
+    log.dump();
+    EXPECT_EQ(contents, this->read_file());
+    EXPECT_EQ(contents.substr(contents.size() - 12), "[I] Line 99\n");
+}
+
+TEST_F(RingBufferLogTest, SizeRoundedUp) {
+    RingBufferLog small(1, this->fd);
+    EXPECT_EQ(small.size(), LineLog::MAX_LINE_LEN);
+}
+
+TEST_F(RingBufferLogTest, Empty) {
+    RingBufferLog log(1024, this->fd);
+    log.dump();
+    EXPECT_EQ(this->read_file(), "");
+}
+
+TEST_F(RingBufferLogTest, Wrap) {
+    RingBufferLog log(1024, this->fd);
+    for (uint32_t i = 0; i < 1000; i++) {
+        Log::info("This is line %" PRIu32, i);
+    }
+    log.dump();
+
+    // The dump starts with a complete line, and ends with the last one.
+    std::string contents = this->read_file();
+    EXPECT_LE(contents.size(), log.size());
+    EXPECT_GT(contents.size(), log.size() - 32);
+    EXPECT_EQ(contents.substr(0, 4), "[I] ");
+    std::string last = "[I] This is line 999\n";
+    EXPECT_EQ(contents.substr(contents.size() - last.size()), last);
+
+    std::istringstream lines(contents);
+    std::string line;
+    uint32_t expected = 0;
+    bool first = true;
+    while (std::getline(lines, line)) {
+        uint32_t num = std::stoul(line.substr(17));
+        if (!first) {
+            EXPECT_EQ(num, expected);
+        }
+        first = false;
+        expected = num + 1;
+    }
+    EXPECT_EQ(expected, 1000);
+}
+
+TEST_F(RingBufferLogTest, DumpOnFatal) {
+    RingBufferLog log(1024, this->fd);
+    Log::debug("Debug");
+    EXPECT_EQ(this->read_file(), "");
+    Log::fatal("Fatal");
+    EXPECT_EQ(this->read_file(), "[D] Debug\n[F] Fatal\n");
+}
+
+TEST_F(RingBufferLogTest, DumpOnCrash) {
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        RingBufferLog log(1024, this->fd);
+        log.install_crash_handlers();
+        Log::debug("Before crash");
+        abort();
+    }
+    int status;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+
+    // The default action still runs after the dump.
+    EXPECT_TRUE(WIFSIGNALED(status));
+    EXPECT_EQ(WTERMSIG(status), SIGABRT);
+    EXPECT_EQ(this->read_file(), "[D] Before crash\n");
+}
+
+TEST_F(RingBufferLogTest, CrashHandlersRemoved) {
+    struct sigaction before;
+    struct sigaction after;
+    sigaction(SIGSEGV, nullptr, &before);
+    {
+        RingBufferLog log(1024, this->fd);
+        EXPECT_TRUE(log.install_crash_handlers());
+        EXPECT_TRUE(log.install_crash_handlers());
+    }
+    sigaction(SIGSEGV, nullptr, &after);
+    EXPECT_EQ(before.sa_handler, after.sa_handler);
+}
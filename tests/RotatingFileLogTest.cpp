@@ -0,0 +1,199 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   RotatingFileLogTest.cpp
+ *
+ *   @brief  Tests for functions in RotatingFileLog.cpp
+ *
+ ****************************************************************************/
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "duino_log/RotatingFileLog.h"
+
+//! Test fixture which creates a temporary directory for the log files.
+class RotatingFileLogTest : public ::testing::Test {
+ protected:
+    void SetUp() override {
+        char dir[] = "/tmp/RotatingFileLogTest.XXXXXX";
+        ASSERT_NE(mkdtemp(dir), nullptr);
+        this->dir = dir;
+        this->path = this->dir + "/test.log";
+    }
+
+    void TearDown() override {
+        std::string cmd = "rm -rf " + this->dir;
+        EXPECT_EQ(system(cmd.c_str()), 0);
+    }
+
+    //! Reads the contents of a file.
+    static std::string read_file(const std::string& name) {
+        std::ifstream in(name);
+        std::stringstream contents;
+        contents << in.rdbuf();
+        return contents.str();
+    }
+
+    //! Determines if a file exists.
+    static bool exists(const std::string& name) { return access(name.c_str(), F_OK) == 0; }
+
+    //! Waits for a condition to become true.
+    template <typename Pred>
+    static bool wait_for(Pred pred) {
+        for (int i = 0; i < 500; i++) {
+            if (pred()) {
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    }
+
+    std::string dir;   //!< Temporary directory.
+    std::string path;  //!< Path of the log file.
+};
+
+TEST_F(RotatingFileLogTest, NoRotation) {
+    {
+        RotatingFileLog log(this->path.c_str(), 0, 2);
+        ASSERT_TRUE(log.is_open());
+        Log::info("Line %d", 1);
+        Log::error("Line %d", 2);
+    }
+    EXPECT_EQ(read_file(this->path), "[I] Line 1\n[E] Line 2\n");
+    EXPECT_FALSE(exists(this->path + ".next"));
+}
+
+TEST_F(RotatingFileLogTest, RotateBySize) {
+    RotatingFileLog log(this->path.c_str(), 20, 2);
+    ASSERT_TRUE(log.is_open());
+
+    // Each line is 11 bytes, so each file holds one line.
+    for (uint32_t i = 1; i <= 4; i++) {
+        ASSERT_TRUE(wait_for([&] { return exists(this->path + ".next"); }));
+        Log::info("Line %04" PRIu32, i);
+        ASSERT_TRUE(wait_for([&] { return log.num_rotations() == i - 1; }));
+    }
+
+    EXPECT_EQ(read_file(this->path), "[I] Line 0004\n");
+    EXPECT_EQ(read_file(this->path + ".1"), "[I] Line 0003\n");
+    EXPECT_EQ(read_file(this->path + ".2"), "[I] Line 0002\n");
+    EXPECT_FALSE(exists(this->path + ".3"));
+}
+
+TEST_F(RotatingFileLogTest, RotateByAge) {
+    RotatingFileLog log(this->path.c_str(), 0, 1, 1);
+    ASSERT_TRUE(log.is_open());
+
+    ASSERT_TRUE(wait_for([&] { return exists(this->path + ".next"); }));
+    Log::info("Old");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    Log::info("New");
+    ASSERT_TRUE(wait_for([&] { return log.num_rotations() == 1; }));
+
+    EXPECT_EQ(read_file(this->path), "[I] New\n");
+    EXPECT_EQ(read_file(this->path + ".1"), "[I] Old\n");
+}
+
+//! Writes a file.
+static void write_file(const std::string& name, const std::string& contents) {
+    std::ofstream out(name);
+    out << contents;
+}
+
+TEST_F(RotatingFileLogTest, RecoverNext) {
+    // The process crashed after rotating to path.next, but before renaming it.
+    write_file(this->path, "[I] Old\n");
+    write_file(this->path + ".next", "[I] Newer\n");
+    {
+        RotatingFileLog log(this->path.c_str(), 0, 2);
+        ASSERT_TRUE(log.is_open());
+        Log::info("New");
+    }
+    EXPECT_EQ(read_file(this->path), "[I] Newer\n[I] New\n");
+    EXPECT_EQ(read_file(this->path + ".1"), "[I] Old\n");
+    EXPECT_FALSE(exists(this->path + ".next"));
+}
+
+TEST_F(RotatingFileLogTest, RecoverNextAfterRename) {
+    // The process crashed after renaming path to path.1.
+    write_file(this->path + ".1", "[I] Old\n");
+    write_file(this->path + ".next", "[I] Newer\n");
+    {
+        RotatingFileLog log(this->path.c_str(), 0, 2);
+        ASSERT_TRUE(log.is_open());
+        Log::info("New");
+    }
+    EXPECT_EQ(read_file(this->path), "[I] Newer\n[I] New\n");
+    EXPECT_EQ(read_file(this->path + ".1"), "[I] Old\n");
+    EXPECT_FALSE(exists(this->path + ".2"));
+}
+
+TEST_F(RotatingFileLogTest, EmptyNextIsRemoved) {
+    write_file(this->path, "[I] Old\n");
+    write_file(this->path + ".next", "");
+    {
+        RotatingFileLog log(this->path.c_str(), 0, 2);
+        ASSERT_TRUE(log.is_open());
+        Log::info("New");
+    }
+    EXPECT_EQ(read_file(this->path), "[I] Old\n[I] New\n");
+    EXPECT_FALSE(exists(this->path + ".1"));
+}
+
+//! Codec which just copies the file, for testing.
+static bool copy_codec_compress(const char* src, const char* dst) {
+    std::ifstream in(src);
+    std::ofstream out(dst);
+    out << in.rdbuf();
+    return true;
+}
+
+TEST_F(RotatingFileLogTest, Codec) {
+    static const RotatingFileCodec copy_codec = {".copy", copy_codec_compress};
+    RotatingFileLog log(this->path.c_str(), 10, 2, 0, &copy_codec);
+    ASSERT_TRUE(log.is_open());
+
+    for (uint32_t i = 1; i <= 3; i++) {
+        ASSERT_TRUE(wait_for([&] { return exists(this->path + ".next"); }));
+        Log::info("Line %" PRIu32, i);
+        ASSERT_TRUE(wait_for([&] { return log.num_rotations() == i - 1; }));
+    }
+
+    EXPECT_EQ(read_file(this->path), "[I] Line 3\n");
+    EXPECT_EQ(read_file(this->path + ".1.copy"), "[I] Line 2\n");
+    EXPECT_EQ(read_file(this->path + ".2.copy"), "[I] Line 1\n");
+    EXPECT_FALSE(exists(this->path + ".1"));
+}
+
+#if defined(DUINO_LOG_ZLIB)
+TEST_F(RotatingFileLogTest, Gzip) {
+    RotatingFileLog log(this->path.c_str(), 10, 1, 0, &RotatingFileLog::gzip_codec);
+    ASSERT_TRUE(log.is_open());
+
+    for (uint32_t i = 1; i <= 2; i++) {
+        ASSERT_TRUE(wait_for([&] { return exists(this->path + ".next"); }));
+        Log::info("Line %" PRIu32, i);
+        ASSERT_TRUE(wait_for([&] { return log.num_rotations() == i - 1; }));
+    }
+
+    std::string cmd = "gzip -t " + this->path + ".1.gz";
+    EXPECT_EQ(system(cmd.c_str()), 0);
+    EXPECT_FALSE(exists(this->path + ".1"));
+}
+#endif
@@ -0,0 +1,123 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   SamplingFilterTest.cpp
+ *
+ *   @brief  Tests for functions in SamplingFilter.cpp
+ *
+ ****************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include "duino_log/LineLog.h"
+#include "duino_log/RateLimitFilter.h"
+#include "duino_log/SamplingFilter.h"
+
+//! Logger which counts the lines passed to write_line.
+class SampledLog : public LineLog {
+ public:
+    std::atomic<uint32_t> num_lines{0};  //!< Number of lines written.
+
+ protected:
+    //! Counts the line.
+    void write_line(Level level, const char* line, size_t len) override {
+        (void)level;
+        (void)line;
+        (void)len;
+        this->num_lines++;
+    }
+};
+
+TEST(SamplingFilterTest, OneIn) {
+    static constexpr uint32_t NUM_MESSAGES = 100000;
+    SamplingFilter filter;
+    filter.set_one_in(Log::Level::DEBUG, 10);
+    EXPECT_NEAR(filter.sample_rate(Log::Level::DEBUG), 0.1, 1e-6);
+    EXPECT_DOUBLE_EQ(filter.sample_rate(Log::Level::INFO), 1.0);
+
+    SampledLog log;
+    log.set_filter(&filter);
+    for (uint32_t i = 0; i < NUM_MESSAGES; i++) {
+        Log::debug("Debug %" PRIu32, i);
+        Log::info("Info %" PRIu32, i);
+    }
+    log.set_filter(nullptr);
+
+    uint32_t num_debug = log.num_lines - NUM_MESSAGES;
+    EXPECT_GT(num_debug, NUM_MESSAGES / 10 * 9 / 10);
+    EXPECT_LT(num_debug, NUM_MESSAGES / 10 * 11 / 10);
+    EXPECT_EQ(filter.num_sampled_out(Log::Level::DEBUG), NUM_MESSAGES - num_debug);
+    EXPECT_EQ(filter.num_sampled_out(Log::Level::INFO), 0);
+}
+
+TEST(SamplingFilterTest, Percent) {
+    SamplingFilter filter;
+    filter.set_percent(Log::Level::DEBUG, 0.0);
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_FALSE(filter.allow(Log::Level::DEBUG, "fmt"));
+    }
+    EXPECT_EQ(filter.num_sampled_out(Log::Level::DEBUG), 1000);
+
+    filter.set_percent(Log::Level::DEBUG, 100.0);
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_TRUE(filter.allow(Log::Level::DEBUG, "fmt"));
+    }
+
+    filter.set_percent(Log::Level::DEBUG, 25.0);
+    EXPECT_DOUBLE_EQ(filter.sample_rate(Log::Level::DEBUG), 0.25);
+    uint32_t num_allowed = 0;
+    for (int i = 0; i < 100000; i++) {
+        num_allowed += filter.allow(Log::Level::DEBUG, "fmt");
+    }
+    EXPECT_GT(num_allowed, 22500);
+    EXPECT_LT(num_allowed, 27500);
+}
+
+TEST(SamplingFilterTest, Next) {
+    RateLimitFilter rate_limit;
+    rate_limit.set_limit(Log::Level::DEBUG, 1, 5);
+    SamplingFilter filter(&rate_limit);
+    filter.set_one_in(Log::Level::DEBUG, 2);
+
+    uint32_t num_allowed = 0;
+    for (int i = 0; i < 1000; i++) {
+        num_allowed += filter.allow(Log::Level::DEBUG, "fmt");
+    }
+    EXPECT_EQ(num_allowed, 5);
+    EXPECT_EQ(filter.num_sampled_out(Log::Level::DEBUG) + rate_limit.num_suppressed(), 995);
+}
+
+TEST(SamplingFilterTest, MultipleThreads) {
+    static constexpr uint32_t NUM_THREADS = 4;
+    static constexpr uint32_t NUM_MESSAGES = 50000;
+    SamplingFilter filter;
+    filter.set_one_in(Log::Level::DEBUG, 4);
+
+    std::atomic<uint32_t> num_allowed{0};
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < NUM_THREADS; t++) {
+        threads.emplace_back([&filter, &num_allowed] {
+            for (uint32_t i = 0; i < NUM_MESSAGES; i++) {
+                if (filter.allow(Log::Level::DEBUG, "fmt")) {
+                    num_allowed++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(num_allowed + filter.num_sampled_out(Log::Level::DEBUG), NUM_THREADS * NUM_MESSAGES);
+    EXPECT_GT(num_allowed, NUM_THREADS * NUM_MESSAGES / 4 * 9 / 10);
+    EXPECT_LT(num_allowed, NUM_THREADS * NUM_MESSAGES / 4 * 11 / 10);
+}
@@ -18,6 +18,7 @@
 
 #include <stdarg.h>
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <string>
 #include <sstream>
 
@@ -92,3 +93,100 @@ TEST(StrMaxCatTest, Truncated) {
     EXPECT_EQ(result, dst);
     EXPECT_EQ(strlen(dst), 11);
 }
+
+TEST(StrMaxCpyLenTest, Normal) {
+    char dst[20];
+
+    memset(dst, 'x', sizeof(dst));
+    EXPECT_EQ(StrMaxCpyLen(dst, "This ", 0), 0);
+    EXPECT_EQ(dst[0], 'x');
+
+    EXPECT_EQ(StrMaxCpyLen(dst, "This ", 1), 0);
+    EXPECT_STREQ(dst, "");
+
+    EXPECT_EQ(StrMaxCpyLen(dst, "This ", LEN(dst)), 5);
+    EXPECT_STREQ(dst, "This ");
+
+    EXPECT_EQ(StrMaxCpyLen(dst, "This is a test to see", LEN(dst)), 19);
+    EXPECT_STREQ(dst, "This is a test to s");
+}
+
+TEST(StrMaxCpyLenTest, Sentinel) {
+    char dst[8];
+
+    // The last byte should only be written if the string fills the buffer.
+    dst[7] = 'S';
+    EXPECT_EQ(StrMaxCpyLen(dst, "123456", LEN(dst)), 6);
+    EXPECT_STREQ(dst, "123456");
+    EXPECT_EQ(dst[7], 'S');
+
+    EXPECT_EQ(StrMaxCpyLen(dst, "1234567", LEN(dst)), 7);
+    EXPECT_STREQ(dst, "1234567");
+    EXPECT_EQ(dst[7], '\0');
+}
+
+TEST(StrMaxCatLenTest, Normal) {
+    char dst[12];
+
+    EXPECT_EQ(StrMaxCpyLen(dst, "This ", LEN(dst)), 5);
+    EXPECT_EQ(StrMaxCatLen(dst, "is", LEN(dst)), 7);
+    EXPECT_STREQ(dst, "This is");
+    EXPECT_EQ(StrMaxCatLen(dst, " a test", LEN(dst)), 11);
+    EXPECT_STREQ(dst, "This is a t");
+
+    // The destination is already too long, so it gets truncated.
+    EXPECT_EQ(StrMaxCatLen(dst, "more", 5), 4);
+    EXPECT_STREQ(dst, "This");
+
+    EXPECT_EQ(StrMaxCatLen(dst, "more", 0), 0);
+    EXPECT_STREQ(dst, "This");
+}
+
+TEST(StrMaxAppendTest, Normal) {
+    char dst[12];
+    size_t len = 0;
+
+    dst[0] = '\0';
+    len = StrMaxAppend(dst, len, "This ", LEN(dst));
+    EXPECT_EQ(len, 5);
+    len = StrMaxAppend(dst, len, "is", LEN(dst));
+    EXPECT_EQ(len, 7);
+    EXPECT_STREQ(dst, "This is");
+    len = StrMaxAppend(dst, len, " a test", LEN(dst));
+    EXPECT_EQ(len, 11);
+    EXPECT_STREQ(dst, "This is a t");
+    len = StrMaxAppend(dst, len, "more", LEN(dst));
+    EXPECT_EQ(len, 11);
+    EXPECT_STREQ(dst, "This is a t");
+}
+
+TEST(StrMaxCpyTest, AllAlignmentsAndLengths) {
+    char src[80];
+    char dst[64];
+
+    for (size_t i = 0; i < sizeof(src); i++) {
+        src[i] = 'a' + (i % 26);
+    }
+
+    // Exercise the byte and word portions of the copy for every source
+    // alignment, string length and buffer size.
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t strLen = 0; strLen < 40; strLen++) {
+            char saved = src[offset + strLen];
+            src[offset + strLen] = '\0';
+            for (size_t maxLen = 1; maxLen <= 48; maxLen++) {
+                memset(dst, 'S', sizeof(dst));
+                size_t expectedLen = std::min(strLen, maxLen - 1);
+
+                EXPECT_EQ(StrMaxCpyLen(dst, &src[offset], maxLen), expectedLen);
+                EXPECT_EQ(memcmp(dst, &src[offset], expectedLen), 0);
+                EXPECT_EQ(dst[expectedLen], '\0');
+                for (size_t i = expectedLen + 1; i < sizeof(dst); i++) {
+                    ASSERT_EQ(dst[i], 'S') << "offset " << offset << " strLen " << strLen
+                                           << " maxLen " << maxLen;
+                }
+            }
+            src[offset + strLen] = saved;
+        }
+    }
+}
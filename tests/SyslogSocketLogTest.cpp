@@ -0,0 +1,151 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   SyslogSocketLogTest.cpp
+ *
+ *   @brief  Tests for functions in SyslogSocketLog.cpp
+ *
+ ****************************************************************************/
+
+#include <gtest/gtest.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <regex>
+#include <string>
+
+#include "duino_log/SyslogSocketLog.h"
+
+//! Test fixture which creates a socket standing in for the syslog collector.
+class SyslogSocketLogTest : public ::testing::Test {
+ protected:
+    void SetUp() override {
+        char dir[] = "/tmp/SyslogSocketLogTest.XXXXXX";
+        ASSERT_NE(mkdtemp(dir), nullptr);
+        this->dir = dir;
+        this->path = this->dir + "/log";
+        ASSERT_TRUE(this->bind_collector());
+    }
+
+    void TearDown() override {
+        if (this->fd >= 0) {
+            close(this->fd);
+        }
+        unlink(this->path.c_str());
+        rmdir(this->dir.c_str());
+    }
+
+    //! Creates the collector socket.
+    bool bind_collector() {
+        this->fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, this->path.c_str());
+        return bind(this->fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0;
+    }
+
+    //! Receives a record from the collector socket.
+    //! @returns the record, or an empty string if nothing arrived.
+    std::string receive(int timeout_ms = 1000) {
+        struct pollfd pfd = {this->fd, POLLIN, 0};
+        if (poll(&pfd, 1, timeout_ms) != 1) {
+            return "";
+        }
+        char buf[1024];
+        ssize_t len = recv(this->fd, buf, sizeof(buf), 0);
+        return len > 0 ? std::string(buf, len) : "";
+    }
+
+    std::string dir;   //!< Temporary directory.
+    std::string path;  //!< Path of the collector socket.
+    int fd = -1;       //!< Collector socket.
+};
+
+TEST(SyslogSocketLog, Severity) {
+    EXPECT_EQ(SyslogSocketLog::severity(Log::Level::FATAL), LOG_CRIT);
+    EXPECT_EQ(SyslogSocketLog::severity(Log::Level::ERROR), LOG_ERR);
+    EXPECT_EQ(SyslogSocketLog::severity(Log::Level::WARNING), LOG_WARNING);
+    EXPECT_EQ(SyslogSocketLog::severity(Log::Level::INFO), LOG_INFO);
+    EXPECT_EQ(SyslogSocketLog::severity(Log::Level::DEBUG), LOG_DEBUG);
+    EXPECT_EQ(SyslogSocketLog::severity(Log::Level::NONE), LOG_NOTICE);
+}
+
+TEST_F(SyslogSocketLogTest, Rfc3164) {
+    SyslogSocketLog log("test", SyslogSocketLog::Format::RFC3164, this->path.c_str(), LOG_LOCAL0);
+    ASSERT_TRUE(log.is_open());
+    Log::warning("Warning %d", 42);
+
+    // Sent by the background thread, since warnings aren't sent immediately.
+    std::string record = this->receive();
+    std::regex expected(R"(<132>[A-Z][a-z]{2} [ 1-3]\d \d\d:\d\d:\d\d test\[\d+\]: Warning 42)");
+    EXPECT_TRUE(std::regex_match(record, expected)) << record;
+    EXPECT_EQ(log.num_sent(), 1);
+}
+
+TEST_F(SyslogSocketLogTest, Rfc5424) {
+    SyslogSocketLog log("app", SyslogSocketLog::Format::RFC5424, this->path.c_str());
+    Log::error("Error %s", "message");
+
+    std::string record = this->receive(0);
+    std::regex expected(
+        R"(<11>1 \d{4}-\d\d-\d\dT\d\d:\d\d:\d\d\.\d{6}Z \S+ app \d+ - - Error message)");
+    EXPECT_TRUE(std::regex_match(record, expected)) << record;
+}
+
+TEST_F(SyslogSocketLogTest, Batching) {
+    // Stay below net.unix.max_dgram_qlen (which defaults to 10), since the
+    // collector doesn't read until the batch has been sent.
+    static constexpr size_t NUM_RECORDS = 8;
+    SyslogSocketLog log("test", SyslogSocketLog::Format::RFC3164, this->path.c_str());
+    for (size_t i = 0; i < NUM_RECORDS; i++) {
+        Log::info("Info %zu", i);
+    }
+    log.flush();
+    EXPECT_EQ(log.num_sent(), NUM_RECORDS);
+    EXPECT_EQ(log.num_dropped(), 0);
+    for (size_t i = 0; i < NUM_RECORDS; i++) {
+        std::string record = this->receive(0);
+        std::string suffix = ": Info " + std::to_string(i);
+        ASSERT_GE(record.size(), suffix.size());
+        EXPECT_EQ(record.substr(record.size() - suffix.size()), suffix);
+    }
+}
+
+TEST_F(SyslogSocketLogTest, DropWhenFull) {
+    // The collector never reads, so its queue fills up.
+    static constexpr size_t NUM_RECORDS = 10000;
+    SyslogSocketLog log("test", SyslogSocketLog::Format::RFC3164, this->path.c_str());
+    for (size_t i = 0; i < NUM_RECORDS; i++) {
+        Log::info("Info %zu", i);
+    }
+    log.flush();
+    EXPECT_GT(log.num_sent(), 0);
+    EXPECT_GT(log.num_dropped(), 0);
+    EXPECT_EQ(log.num_sent() + log.num_dropped(), NUM_RECORDS);
+}
+
+TEST_F(SyslogSocketLogTest, CollectorRestarted) {
+    close(this->fd);
+    unlink(this->path.c_str());
+
+    SyslogSocketLog log("test", SyslogSocketLog::Format::RFC3164, this->path.c_str());
+    Log::error("Nobody listening");
+    EXPECT_EQ(log.num_dropped(), 1);
+
+    ASSERT_TRUE(this->bind_collector());
+    Log::error("Listening");
+    EXPECT_EQ(log.num_sent(), 1);
+    std::string record = this->receive(0);
+    EXPECT_NE(record.find(": Listening"), std::string::npos);
+}
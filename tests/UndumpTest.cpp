@@ -0,0 +1,234 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   UndumpTest.cpp
+ *
+ *   @brief  Tests for functions in Undump.cpp
+ *
+ ****************************************************************************/
+
+// ---- Include Files -------------------------------------------------------
+
+#include <stdarg.h>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <sstream>
+
+#include "duino_log/ConsoleColor.h"
+#include "duino_log/DumpMem.h"
+#include "duino_log/Log.h"
+#include "duino_log/Undump.h"
+#include "duino_util/Util.h"
+
+static uint8_t data[] = {
+    0x00, 0x01, 0x02, 0x31, 0x32, 0x33, 0x41, 0x42, 0x43, 0x11, 0x12, 0x13, 0x36, 0x37, 0x38, 0x39,
+    0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+};
+
+//! Logger which accumulates each logged line followed by a newline.
+class UndumpLogger : public Log {
+ public:
+    std::string str;  //!< String that output is accumulated into.
+
+ protected:
+    //! Function that actually performs the logging.
+    void do_log(
+        Level level,      //!< [in] Logging level associated with the current messgae.
+        const char* fmt,  //!< [in] Printf style format string.
+        va_list args      //!< [in] Arguments associated with the format string.
+        ) noexcept override {
+        (void)level;
+        char line[200];
+
+        vStrPrintf(line, LEN(line), fmt, args);
+        this->str.append(line);
+        this->str.push_back('\n');
+    }
+};
+
+//! Helper which parses a line and returns the data as a string.
+static UndumpResult parse(
+    const char* line,    //!< [in] Line to parse.
+    const char* prefix,  //!< [in] Expected prefix.
+    size_t* address,     //!< [out] Parsed address.
+    std::string* bytes   //!< [out] Parsed data.
+) {
+    uint8_t buf[DUMP_LINE_WIDTH];
+    size_t numBytes;
+    auto result = ParseDumpLine(line, strlen(line), prefix, address, buf, &numBytes);
+    bytes->assign(reinterpret_cast<const char*>(buf), numBytes);
+    return result;
+}
+
+TEST(ParseDumpLineTest, FullLine) {
+    size_t address;
+    std::string bytes;
+
+    EXPECT_EQ(
+        parse(
+            "Test: 0010: 20 21 22 23 24 25 61 62 63 64 65 66 67 68 69 6a  !\"#$%abcdefghij",
+            nullptr, &address, &bytes),
+        UndumpResult::OK);
+    EXPECT_EQ(address, 0x10);
+    EXPECT_EQ(bytes, std::string(reinterpret_cast<const char*>(&data[16]), 16));
+}
+
+TEST(ParseDumpLineTest, PartialLineWithExpectedPrefix) {
+    size_t address;
+    std::string bytes;
+
+    EXPECT_EQ(
+        parse(
+            "Test: 0010: 20 21 22 23 24 25 61 62                          !\"#$%ab\n", "Test",
+            &address, &bytes),
+        UndumpResult::OK);
+    EXPECT_EQ(address, 0x10);
+    EXPECT_EQ(bytes, std::string(reinterpret_cast<const char*>(&data[16]), 8));
+
+    EXPECT_EQ(
+        parse(
+            "Test: 0010: 20 21 22 23 24 25 61 62                          !\"#$%ab\n", "Other",
+            &address, &bytes),
+        UndumpResult::INVALID);
+}
+
+TEST(ParseDumpLineTest, NoAddr) {
+    size_t address;
+    std::string bytes;
+
+    EXPECT_EQ(
+        parse("Test: 00                                              .", nullptr, &address, &bytes),
+        UndumpResult::OK);
+    EXPECT_EQ(address, NO_ADDR);
+    EXPECT_EQ(bytes, std::string(1, '\0'));
+
+    EXPECT_EQ(
+        parse("00                                              .", "", &address, &bytes),
+        UndumpResult::OK);
+    EXPECT_EQ(address, NO_ADDR);
+    EXPECT_EQ(bytes, std::string(1, '\0'));
+}
+
+TEST(ParseDumpLineTest, NoData) {
+    size_t address;
+    std::string bytes;
+
+    EXPECT_EQ(parse("Test: No Data", nullptr, &address, &bytes), UndumpResult::NO_DATA);
+    EXPECT_EQ(parse("No Data\r\n", "", &address, &bytes), UndumpResult::NO_DATA);
+    EXPECT_EQ(bytes.size(), 0);
+}
+
+TEST(ParseDumpLineTest, DataEndingInNoData) {
+    size_t address;
+    std::string bytes;
+
+    // The ASCII portion looks like a "No Data" line with a prefix of "abcdefg".
+    EXPECT_EQ(
+        parse(
+            "Test: 0020: 61 62 63 64 65 66 67 3a 20 4e 6f 20 44 61 74 61 abcdefg: No Data",
+            nullptr, &address, &bytes),
+        UndumpResult::OK);
+    EXPECT_EQ(address, 0x20);
+    EXPECT_EQ(bytes, "abcdefg: No Data");
+}
+
+TEST(ParseDumpLineTest, ColorLogLine) {
+    size_t address;
+    std::string bytes;
+
+    EXPECT_EQ(
+        parse(
+            "[I] Test: 0000: 00 01 02 31 32 33 41 42 43 11 12 13 36 37 38 39 "
+            "...123ABC...6789" COLOR_NO_COLOR "\r\n",
+            nullptr, &address, &bytes),
+        UndumpResult::OK);
+    EXPECT_EQ(address, 0);
+    EXPECT_EQ(bytes, std::string(reinterpret_cast<const char*>(data), 16));
+}
+
+TEST(ParseDumpLineTest, Invalid) {
+    size_t address;
+    std::string bytes;
+
+    EXPECT_EQ(parse("", nullptr, &address, &bytes), UndumpResult::INVALID);
+    EXPECT_EQ(parse("Test: 42", nullptr, &address, &bytes), UndumpResult::INVALID);
+    // ASCII portion doesn't match the hex portion.
+    EXPECT_EQ(
+        parse("Test: 0000: 41                                              B", nullptr, &address,
+              &bytes),
+        UndumpResult::INVALID);
+    // Bad hex digit.
+    EXPECT_EQ(
+        parse("Test: 0000: 4g                                              A", nullptr, &address,
+              &bytes),
+        UndumpResult::INVALID);
+}
+
+TEST(UndumpStreamTest, SkipsOtherLines) {
+    std::istringstream input(
+        "Some other log message\n"
+        "Test: 0000: 00 01 02 31 32 33 41 42 43 11 12 13 36 37 38 39 ...123ABC...6789\n"
+        "Test: *\n"
+        "Test: 0010: 20 21 22 23 24 25 61 62                          !\"#$%ab\n");
+    std::ostringstream output;
+
+    EXPECT_EQ(UndumpStream(input, output), 24);
+    EXPECT_EQ(output.str(), std::string(reinterpret_cast<const char*>(data), 24));
+}
+
+TEST(UndumpStreamTest, RoundTrip) {
+    static const char* prefixes[] = {"", "Test", "   Data", "[I] abcd", "beef"};
+    std::mt19937 rng(1234);
+
+    for (int iter = 0; iter < 200; iter++) {
+        std::string bytes(rng() % 300, '\0');
+        for (auto& ch : bytes) {
+            ch = static_cast<char>(rng());
+        }
+        const char* prefix = prefixes[iter % LEN(prefixes)];
+        size_t address = (iter & 4) ? NO_ADDR : rng() % 0x10000;
+
+        std::string dumped;
+        {
+            UndumpLogger logger;
+            DumpMem(prefix, address, bytes.data(), bytes.size());
+            dumped = logger.str;
+        }
+        std::istringstream input(dumped);
+        std::ostringstream output;
+
+        EXPECT_EQ(UndumpStream(input, output, prefix), bytes.size());
+        EXPECT_EQ(output.str(), bytes) << "Failed for:\n" << dumped;
+
+        // Detecting the prefix works as long as the prefix doesn't look like an address.
+        if (strcmp(prefix, "beef") != 0) {
+            std::istringstream input2(dumped);
+            std::ostringstream output2;
+            EXPECT_EQ(UndumpStream(input2, output2), bytes.size());
+            EXPECT_EQ(output2.str(), bytes) << "Failed for:\n" << dumped;
+        }
+    }
+}
+
+TEST(UndumpStreamTest, RoundTripStream) {
+    std::string bytes(5000, '\0');
+    std::mt19937 rng(5678);
+    for (auto& ch : bytes) {
+        ch = static_cast<char>(rng());
+    }
+
+    std::stringstream dumped;
+    dumped << dump("Test", 0x100000000ull & SIZE_MAX, bytes.data(), bytes.size());
+
+    std::ostringstream output;
+    EXPECT_EQ(UndumpStream(dumped, output), bytes.size());
+    EXPECT_EQ(output.str(), bytes);
+}
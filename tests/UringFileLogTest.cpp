@@ -0,0 +1,134 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   UringFileLogTest.cpp
+ *
+ *   @brief  Tests for functions in UringFileLog.cpp
+ *
+ ****************************************************************************/
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cinttypes>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "duino_log/UringFileLog.h"
+
+//! Test fixture which creates a temporary log file, and runs each test with
+//! and without io_uring.
+class UringFileLogTest : public ::testing::TestWithParam<bool> {
+ protected:
+    void SetUp() override {
+        char path[] = "/tmp/UringFileLogTest.XXXXXX";
+        int fd = mkstemp(path);
+        ASSERT_GE(fd, 0);
+        close(fd);
+        this->path = path;
+    }
+
+    void TearDown() override { unlink(this->path.c_str()); }
+
+    //! Reads the contents of the log file.
+    std::string read_file() const {
+        std::ifstream in(this->path);
+        std::stringstream contents;
+        contents << in.rdbuf();
+        return contents.str();
+    }
+
+    std::string path;  //!< Path of the log file.
+};
+
+TEST_P(UringFileLogTest, Simple) {
+    {
+        UringFileLog log(this->path.c_str(), GetParam());
+        ASSERT_TRUE(log.is_open());
+        if (!GetParam()) {
+            EXPECT_FALSE(log.uses_uring());
+        }
+        Log::info("Line %d", 1);
+        Log::error("Line %d", 2);
+    }
+    EXPECT_EQ(this->read_file(), "[I] Line 1\n[E] Line 2\n");
+}
+
+TEST_P(UringFileLogTest, Flush) {
+    UringFileLog log(this->path.c_str(), GetParam());
+    Log::info("Line 1");
+    log.flush();
+    EXPECT_EQ(this->read_file(), "[I] Line 1\n");
+
+    // The logging thread writes partially filled buffers by itself.
+    Log::info("Line 2");
+    std::this_thread::sleep_for(UringFileLog::FLUSH_INTERVAL * 10);
+    EXPECT_EQ(this->read_file(), "[I] Line 1\n[I] Line 2\n");
+}
+
+TEST_P(UringFileLogTest, Append) {
+    {
+        UringFileLog log(this->path.c_str(), GetParam());
+        Log::info("Line 1");
+    }
+    {
+        UringFileLog log(this->path.c_str(), GetParam());
+        Log::info("Line 2");
+    }
+    EXPECT_EQ(this->read_file(), "[I] Line 1\n[I] Line 2\n");
+}
+
+TEST_P(UringFileLogTest, ManyBuffers) {
+    std::string expected;
+    {
+        UringFileLog log(this->path.c_str(), GetParam());
+        for (uint32_t i = 0; i < 50000; i++) {
+            Log::info("This is line %" PRIu32, i);
+            expected += "[I] This is line " + std::to_string(i) + "\n";
+        }
+    }
+    EXPECT_GT(expected.size(), UringFileLog::BUFFER_SIZE * UringFileLog::NUM_BUFFERS);
+    EXPECT_EQ(this->read_file(), expected);
+}
+
+TEST_P(UringFileLogTest, MultipleThreads) {
+    static constexpr uint32_t NUM_THREADS = 4;
+    static constexpr uint32_t NUM_LINES = 20000;
+    {
+        UringFileLog log(this->path.c_str(), GetParam());
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < NUM_THREADS; t++) {
+            threads.emplace_back([t] {
+                for (uint32_t i = 0; i < NUM_LINES; i++) {
+                    Log::info("Thread %" PRIu32 " line %" PRIu32, t, i);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    std::istringstream contents(this->read_file());
+    std::set<std::string> lines;
+    std::string line;
+    while (std::getline(contents, line)) {
+        lines.insert(line);
+    }
+    EXPECT_EQ(lines.size(), NUM_THREADS * NUM_LINES);
+    EXPECT_EQ(lines.count("[I] Thread 3 line 19999"), 1);
+}
+
+INSTANTIATE_TEST_SUITE_P(Uring, UringFileLogTest, ::testing::Values(true, false));
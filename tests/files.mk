@@ -1,8 +1,24 @@
 # Note: DeathTest.cpp comes from duino_util/tests
 
 TEST_SOURCES_CPP += \
+	AsyncLogTest.cpp \
+	BinaryLogTest.cpp \
 	DeathTest.cpp \
 	DumpMemTest.cpp \
+	ForkTest.cpp \
+	KeyValueTest.cpp \
+	LineLogTest.cpp \
 	LogTest.cpp \
+	LogContextTest.cpp \
+	LogStatsTest.cpp \
+	LogThreadTest.cpp \
+	MmapFileLogTest.cpp \
+	RateLimitFilterTest.cpp \
+	RingBufferLogTest.cpp \
+	RotatingFileLogTest.cpp \
+	SamplingFilterTest.cpp \
 	StrTest.cpp \
-	StrPrintfTest.cpp
+	StrPrintfTest.cpp \
+	SyslogSocketLogTest.cpp \
+	UndumpTest.cpp \
+	UringFileLogTest.cpp
@@ -0,0 +1,109 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   duino_logdecode.cpp
+ *
+ *   @brief  Host tool which converts a BinaryLog file into text.
+ *
+ *   Usage: duino_logdecode [-p] [-t] [input-file]
+ *
+ *   Reads a binary log written by BinaryLog from input-file (or stdin) and
+ *   writes the text to stdout, exactly as LinuxColorLog would have printed it.
+ *
+ *   Options:
+ *      -p  Plain output (no colors), the same as LineLog based loggers.
+ *      -t  Prefix each line with its UTC timestamp.
+ *
+ *   Build with:
+ *
+ *      g++ -O2 -std=c++17 -Isrc tools/duino_logdecode.cpp src/BinaryLog.cpp \
+ *          src/KeyValue.cpp src/LineLog.cpp src/LinuxColorLog.cpp src/Log.cpp \
+ *          src/LogContext.cpp src/LogStats.cpp src/Str.cpp src/StrPrintf.cpp \
+ *          -lpthread -o duino_logdecode
+ *
+ ****************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+
+#include "duino_log/BinaryLog.h"
+#include "duino_log/ConsoleColor.h"
+#include "duino_log/LineLog.h"
+#include "duino_log/LinuxColorLog.h"
+
+//! Prints the usage message.
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-p] [-t] [input-file]\n", prog);
+}
+
+//! Main entry point.
+//! @returns the exit code for the program.
+int main(int argc, char** argv) {
+    bool plain = false;
+    bool timestamps = false;
+    int argi = 1;
+
+    while (argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0') {
+        if (strcmp(argv[argi], "-p") == 0) {
+            plain = true;
+        } else if (strcmp(argv[argi], "-t") == 0) {
+            timestamps = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        argi++;
+    }
+    if (argc - argi > 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::ifstream inFile;
+    std::istream* in = &std::cin;
+    if (argi < argc && strcmp(argv[argi], "-") != 0) {
+        inFile.open(argv[argi], std::ios::binary);
+        if (!inFile) {
+            fprintf(stderr, "%s: Unable to open '%s'\n", argv[0], argv[argi]);
+            return 1;
+        }
+        in = &inFile;
+    }
+
+    BinaryLogDecoder decoder(*in);
+    BinaryLogDecoder::Result result;
+    while ((result = decoder.next()) == BinaryLogDecoder::Result::RECORD) {
+        if (timestamps) {
+            time_t secs = decoder.timestamp_us() / 1000000;
+            struct tm tm;
+            char timeStr[32];
+            strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", gmtime_r(&secs, &tm));
+            printf("%s.%06u ", timeStr, static_cast<unsigned>(decoder.timestamp_us() % 1000000));
+        }
+        auto level = static_cast<unsigned>(decoder.level());
+        if (plain) {
+            printf(
+                "%s%s%s\n", LineLog::level_str[level], decoder.context().c_str(),
+                decoder.message().c_str());
+        } else {
+            printf(
+                "%s%s%s%s\n", LinuxColorLog::level_str[level], decoder.context().c_str(),
+                decoder.message().c_str(), COLOR_NO_COLOR);
+        }
+    }
+    if (result == BinaryLogDecoder::Result::CORRUPT) {
+        fprintf(stderr, "%s: Corrupt binary log\n", argv[0]);
+        return 1;
+    }
+    return 0;
+}
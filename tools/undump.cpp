@@ -0,0 +1,87 @@
+/****************************************************************************
+ *
+ *   @copyright Copyright (c) 2024 Dave Hylands     <dhylands@gmail.com>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the MIT License version as described in the
+ *   LICENSE file in the root of this repository.
+ *
+ ****************************************************************************/
+/**
+ *   @file   undump.cpp
+ *
+ *   @brief  Host tool which converts DumpMem output back into binary data.
+ *
+ *   Usage: undump [-p prefix] [input-file [output-file]]
+ *
+ *   Reads DumpMem output (which may be mixed in with other log messages)
+ *   from input-file (or stdin) and writes the binary data to output-file
+ *   (or stdout).
+ *
+ *   Build with:
+ *
+ *      g++ -O2 -std=c++17 -Isrc tools/undump.cpp src/Undump.cpp -o undump
+ *
+ ****************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "duino_log/Undump.h"
+
+//! Prints the usage message.
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-p prefix] [input-file [output-file]]\n", prog);
+}
+
+//! Main entry point.
+//! @returns the exit code for the program.
+int main(int argc, char** argv) {
+    const char* prefix = nullptr;
+    int argi = 1;
+
+    while (argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0') {
+        if (strcmp(argv[argi], "-p") == 0 && argi + 1 < argc) {
+            prefix = argv[argi + 1];
+            argi += 2;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - argi > 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::ios::sync_with_stdio(false);
+
+    std::ifstream inFile;
+    std::istream* in = &std::cin;
+    if (argi < argc && strcmp(argv[argi], "-") != 0) {
+        inFile.open(argv[argi]);
+        if (!inFile) {
+            fprintf(stderr, "%s: Unable to open '%s'\n", argv[0], argv[argi]);
+            return 1;
+        }
+        in = &inFile;
+    }
+    argi++;
+
+    std::ofstream outFile;
+    std::ostream* out = &std::cout;
+    if (argi < argc && strcmp(argv[argi], "-") != 0) {
+        outFile.open(argv[argi], std::ios::binary);
+        if (!outFile) {
+            fprintf(stderr, "%s: Unable to create '%s'\n", argv[0], argv[argi]);
+            return 1;
+        }
+        out = &outFile;
+    }
+
+    UndumpStream(*in, *out, prefix);
+    out->flush();
+    return out->good() ? 0 : 1;
+}